@@ -0,0 +1,147 @@
+#include "autotune.h"
+#include "featureCache.h"
+#include "profiler.h"
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <omp.h>
+#include <unistd.h>
+
+namespace {
+
+// A candidate replaces the current best of a stage only if it is faster by this factor (timing noise)
+constexpr double kMinGain = 0.97;
+
+// RANSAC seed of the tuning runs when the caller uses random seeds: every worker draws the same hypotheses from
+// run to run, but with several workers the adaptive stop (and so the RANSAC work) still depends on their timing
+constexpr unsigned kAutotuneSeed = 759;
+
+using StageTimes = std::array<double, kLoopStages>;
+using StageSettings = std::array<LoopSettings, kLoopStages>;
+
+void applySettings(const StageSettings& settings) {
+    for (int s = 0; s < kLoopStages; ++s) {
+        LoopTuning::instance().set(static_cast<LoopStage>(s), settings[s]);
+    }
+}
+
+// Fastest time of every stage over repeats runs of the pipeline
+StageTimes timeStages(const std::vector<cv::Mat>& imgs, const StitchOptions& options, int repeats) {
+    LoopTuning& tuning = LoopTuning::instance();
+    StageTimes best;
+    best.fill(std::numeric_limits<double>::max());
+    for (int r = 0; r < repeats; ++r) {
+        tuning.takeTimes();
+        stitchImg(imgs, options);
+        const StageTimes times = tuning.takeTimes();
+        for (int s = 0; s < kLoopStages; ++s) {
+            best[s] = std::min(best[s], times[s]);
+        }
+    }
+    return best;
+}
+
+// Keep the candidate for the stages it makes faster
+void keepFaster(const StageTimes& times, const StageSettings& candidate, StageTimes& best_ms, StageSettings& best) {
+    for (int s = 0; s < kLoopStages; ++s) {
+        if (times[s] < best_ms[s] * kMinGain) {
+            best_ms[s] = times[s];
+            best[s] = candidate[s];
+        }
+    }
+}
+
+} // namespace
+
+std::vector<StageTuning> autotuneLoops(const std::vector<cv::Mat>& imgs, const StitchOptions& options, const AutotuneOptions& tune) {
+    if (imgs.size() < 2) {
+        throw std::invalid_argument("Error: autotuning needs at least two images.");
+    }
+    if (tune.repeats < 1) {
+        throw std::invalid_argument("Error: repeats must be positive.");
+    }
+    StitchOptions run_options = options;
+    if (run_options.ransac_seed == 0) {
+        run_options.ransac_seed = kAutotuneSeed;
+    }
+
+    // 1. detection is not a tuned stage: serve it from the cache after the first run
+    FeatureCache& cache = FeatureCache::instance();
+    std::filesystem::path temp_cache;
+    if (!cache.enabled()) {
+        temp_cache = std::filesystem::temp_directory_path() / ("stitch_autotune_" + std::to_string(::getpid()));
+        cache.setDirectory(temp_cache.string());
+    }
+
+    // 2. the tuning runs are not part of the profiled run: record nothing until the caller's state is back
+    Profiler& profiler = Profiler::instance();
+    const bool profiling = profiler.enabled();
+    profiler.enable(false);
+
+    LoopTuning& tuning = LoopTuning::instance();
+    auto finish = [&] {
+        tuning.setMeasuring(false);
+        profiler.enable(profiling);
+        if (!temp_cache.empty()) {
+            cache.setDirectory("");
+            std::error_code ec;
+            std::filesystem::remove_all(temp_cache, ec);
+        }
+    };
+    tuning.reset();
+    tuning.setMeasuring(true);
+    std::vector<StageTuning> result;
+    try {
+        stitchImg(imgs, run_options);  // warm-up: OpenMP threads, detectors, feature cache
+        const StageTimes default_ms = timeStages(imgs, run_options, tune.repeats);
+        StageTimes best_ms = default_ms;
+        StageSettings best;
+
+        // 3. schedule and chunk with the whole team
+        for (LoopSchedule schedule : {LoopSchedule::Static, LoopSchedule::Dynamic, LoopSchedule::Guided}) {
+            for (int chunk : tune.chunks) {
+                if (schedule == LoopSchedule::Dynamic && chunk == 0) {
+                    continue;  // the defaults
+                }
+                StageSettings candidate;
+                candidate.fill(LoopSettings{schedule, chunk, 0});
+                applySettings(candidate);
+                keepFaster(timeStages(imgs, run_options, tune.repeats), candidate, best_ms, best);
+            }
+        }
+
+        // 4. team size of the winners
+        std::vector<int> threads = tune.threads;
+        if (threads.empty()) {
+            for (int t = 1; t < omp_get_max_threads(); t *= 2) {
+                threads.push_back(t);
+            }
+        }
+        for (int t : threads) {
+            StageSettings candidate = best;
+            for (LoopSettings& settings : candidate) {
+                settings.threads = t;
+            }
+            applySettings(candidate);
+            keepFaster(timeStages(imgs, run_options, tune.repeats), candidate, best_ms, best);
+        }
+
+        // 5. stages the pipeline never ran keep their defaults
+        for (int s = 0; s < kLoopStages; ++s) {
+            if (default_ms[s] <= 0.0) {
+                best[s] = LoopSettings();
+                continue;
+            }
+            result.push_back(StageTuning{static_cast<LoopStage>(s), best[s], default_ms[s], best_ms[s]});
+        }
+        applySettings(best);
+    } catch (...) {
+        tuning.reset();
+        finish();
+        throw;
+    }
+    finish();
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "loopTuning.h"
+#include "stitchImg.h"
+
+// Runtime search of the per-stage loop settings (see loopTuning.h) on this machine and these images.
+// Each candidate is applied to every stage at once and the pipeline is run on the images. Every stage is timed
+// on its own, so one pass over the candidates tunes all stages together. Phase 1 searches schedule x chunk with
+// the whole team, phase 2 the team size of each winner. A candidate must beat the current best of a stage
+// by a few percent, otherwise the stage keeps the default of its loops.
+struct AutotuneOptions {
+    int repeats = 3;                                       // runs per candidate, the fastest counts
+    std::vector<int> chunks = {0, 1, 2, 4, 8, 16, 32, 64};  // 0 = default chunk of every loop
+    std::vector<int> threads;                              // team sizes, empty = 1, 2, 4, ... below the team size
+};
+
+struct StageTuning {
+    LoopStage stage;
+    LoopSettings settings;
+    double default_ms;  // fastest run with the default settings
+    double tuned_ms;    // fastest run with the chosen settings
+};
+
+// Tunes LoopTuning::instance() in place for stitchImg(imgs, options) and returns the stages the pipeline ran.
+// Stages it did not run keep their defaults. Detection is served from the feature cache (a temporary one if none
+// is set), so the runs only differ in the tuned loops. The profiler records nothing during the tuning runs.
+std::vector<StageTuning> autotuneLoops(const std::vector<cv::Mat>& imgs, const StitchOptions& options,
+                                       const AutotuneOptions& tune = AutotuneOptions());
+
+#endif // AUTOTUNE_H
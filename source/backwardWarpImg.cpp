@@ -1,18 +1,18 @@
 #include "backwardWarpImg.h"
 #include "common.h"
+#include "taskGraph.h"
 #include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
 
-std::pair<cv::Mat, cv::Mat> backwardWarpImg(const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape) {
-    // Input arguments: {src_img, destToSrc_H, canvas_shape}.
-    // src_img is the source image,3-channel float32 (CV_32FC3) matrix, range [0.0f, 1.0f] with size (width, height, 3)
-    // destToSrc_H: inverse of H_3x3 
-    // canvas_shape is the shape of canvas with (width, height)
-    
-    // Output: {dest_mask, dest_img}. 
-    // dest_mask is a uint8 (CV_8U) binary matrix, the values are 0 or 1
-    // dest_img is a 3-channel float32 (CV_32FC3) matrix, range 0.0 - 1.0, are the warpped source image
+namespace {
 
+// Canvas rows per task of the warp
+constexpr int kWarpRowGrain = 16;
 
+void validateWarpInputs(const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape) {
     // Validate Inputs
     // 1. Check if src_img is empty
     if (src_img.empty()) {
@@ -20,14 +20,14 @@ std::pair<cv::Mat, cv::Mat> backwardWarpImg(const cv::Mat& src_img, const Eigen:
     }
 
     // 2. Check src_img type
-    if (src_img.type() != CV_32FC3) {
-        throw std::invalid_argument("Error: src_img must be of type CV_32FC3 (3-channel, float32).");
+    if (src_img.type() != CV_32FC3 && src_img.type() != CV_8UC3) {
+        throw std::invalid_argument("Error: src_img must be of type CV_32FC3 (3-channel, float32) or CV_8UC3 (3-channel, uint8).");
     }
 
     // 3. Check src_img value range (optional, for debugging)
     double minVal, maxVal;
     cv::minMaxLoc(src_img, &minVal, &maxVal);
-    if (minVal < 0.0 || maxVal > 1.0) {
+    if (src_img.type() == CV_32FC3 && (minVal < 0.0 || maxVal > 1.0)) {
         throw std::invalid_argument("Error: src_img values must be in range [0.0, 1.0].");
     }
 
@@ -40,46 +40,154 @@ std::pair<cv::Mat, cv::Mat> backwardWarpImg(const cv::Mat& src_img, const Eigen:
     if (destToSrc_H.rows() != 3 || destToSrc_H.cols() != 3) {
         throw std::invalid_argument("Error: destToSrc_H must be a 3x3 matrix.");
     }
+}
 
+} // namespace
+
+std::vector<WarpSpan> warpFootprintSpans(const cv::Size& src_size, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, cv::Rect& roi) {
+    const cv::Rect canvas_rect(0, 0, canvas_shape.width, canvas_shape.height);
+
+    // 1. Project the border of the area that rounds into the source image: [-0.5, width - 0.5) x [-0.5, height - 0.5)
+    Eigen::Matrix3d srcToDest_H = destToSrc_H.inverse();
+    const double src_corners[4][2] = {
+        {-0.5, -0.5}, {src_size.width - 0.5, -0.5}, {src_size.width - 0.5, src_size.height - 0.5}, {-0.5, src_size.height - 0.5}};
+    double dest_corners[4][2];
+    bool same_side = true;
+    double first_w = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        Eigen::Vector3d pt = srcToDest_H * Eigen::Vector3d(src_corners[i][0], src_corners[i][1], 1.0);
+        if (i == 0) {
+            first_w = pt(2);
+        }
+        // The quad is only convex (and bounded) if no corner crosses the line at infinity
+        if (std::abs(pt(2)) < 1e-12 || (pt(2) > 0) != (first_w > 0)) {
+            same_side = false;
+        }
+        dest_corners[i][0] = pt(0) / pt(2);
+        dest_corners[i][1] = pt(1) / pt(2);
+    }
 
+    if (!same_side) {
+        // Degenerate projection: fall back to scanning the whole canvas
+        roi = canvas_rect;
+        return std::vector<WarpSpan>(roi.height, WarpSpan{0, canvas_shape.width});
+    }
 
-    // initialize dest_img and mask
-    cv::Mat dest_img = cv::Mat::zeros(canvas_shape, CV_32FC3);  // dest_img, float32, 3 channels, range 0.0 - 1.0
-    cv::Mat dest_mask = cv::Mat::zeros(canvas_shape, CV_8U);    // mask, uint8, values: 0 or 1
-
-    int height_src = src_img.rows;
-    int width_src = src_img.cols;
-
-    const float* src_ptr = src_img.ptr<float>();
-    float* dest_ptr = dest_img.ptr<float>();
-    uchar* mask_ptr = dest_mask.ptr<uchar>();
-
-    // OpenMP
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < canvas_shape.height; ++y) {
-        for (int x = 0; x < canvas_shape.width; ++x) {
-            // Use the homography matrix to calculate corresponding points in the source image
-            Eigen::Vector3d src_pt(x, y, 1.0);
-            Eigen::Vector3d src_coords = destToSrc_H * src_pt;
-
-            // Normalization using the bias_z of (src_x, src_y, bias_z) to obtain normalized (src_x, src_y) coordinates
-            double src_x = src_coords(0) / src_coords(2);
-            double src_y = src_coords(1) / src_coords(2);
-
-            // check if the calculated src_x and src_y are within the source image
-            int src_x_int = static_cast<int>(std::round(src_x));
-            int src_y_int = static_cast<int>(std::round(src_y));
-
-            if (src_x_int >= 0 && src_x_int < width_src && src_y_int >= 0 && src_y_int < height_src) {
-                int src_idx = (src_y_int * width_src + src_x_int) * 3; // row order index: (row_index * image_width + column_index)*3, multiple 3 is because each pixel has 3 channels
-                int dest_idx = (y * canvas_shape.width + x) * 3;
-
-                dest_ptr[dest_idx] = src_ptr[src_idx];
-                dest_ptr[dest_idx + 1] = src_ptr[src_idx + 1];
-                dest_ptr[dest_idx + 2] = src_ptr[src_idx + 2];
-                mask_ptr[y * canvas_shape.width + x] = 1;
+    // 2. Bounding box of the quad, padded by one pixel and clipped to the canvas
+    double min_x = dest_corners[0][0], max_x = dest_corners[0][0];
+    double min_y = dest_corners[0][1], max_y = dest_corners[0][1];
+    for (int i = 1; i < 4; ++i) {
+        min_x = std::min(min_x, dest_corners[i][0]);
+        max_x = std::max(max_x, dest_corners[i][0]);
+        min_y = std::min(min_y, dest_corners[i][1]);
+        max_y = std::max(max_y, dest_corners[i][1]);
+    }
+    // clamp before the int conversion, a nearly singular H can project far outside the int range
+    auto clampCoord = [](double v, int limit) { return static_cast<int>(std::max(-1.0, std::min(v, static_cast<double>(limit) + 1.0))); };
+    int x0 = clampCoord(std::floor(min_x) - 1, canvas_shape.width);
+    int y0 = clampCoord(std::floor(min_y) - 1, canvas_shape.height);
+    int x1 = clampCoord(std::ceil(max_x) + 2, canvas_shape.width);
+    int y1 = clampCoord(std::ceil(max_y) + 2, canvas_shape.height);
+    roi = cv::Rect(x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)) & canvas_rect;
+
+    // 3. For each row, intersect the row with the quad edges to get the covered x range
+    std::vector<WarpSpan> spans(roi.height, WarpSpan{roi.x, roi.x});
+    for (int r = 0; r < roi.height; ++r) {
+        double y = roi.y + r;
+        double span_min = std::numeric_limits<double>::max();
+        double span_max = std::numeric_limits<double>::lowest();
+        for (int i = 0; i < 4; ++i) {
+            const double* p = dest_corners[i];
+            const double* q = dest_corners[(i + 1) % 4];
+            double lo = std::min(p[1], q[1]) - 1.0;
+            double hi = std::max(p[1], q[1]) + 1.0;
+            if (y < lo || y > hi) {
+                continue;
             }
+            if (std::abs(q[1] - p[1]) < 1e-9) {
+                span_min = std::min(span_min, std::min(p[0], q[0]));
+                span_max = std::max(span_max, std::max(p[0], q[0]));
+                continue;
+            }
+            // intersection with the edge, clamped to the edge end points (the one pixel slack above)
+            double t = std::max(0.0, std::min(1.0, (y - p[1]) / (q[1] - p[1])));
+            double x = p[0] + t * (q[0] - p[0]);
+            span_min = std::min(span_min, x);
+            span_max = std::max(span_max, x);
+        }
+        if (span_min <= span_max) {
+            spans[r].x_begin = std::max(roi.x, clampCoord(std::floor(span_min) - 1, canvas_shape.width));
+            spans[r].x_end = std::min(roi.x + roi.width, clampCoord(std::ceil(span_max) + 2, canvas_shape.width));
+            spans[r].x_end = std::max(spans[r].x_begin, spans[r].x_end);
+        }
+    }
+
+    return spans;
+}
+
+WarpROI backwardWarpImgROI(const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, WarpInterp mode) {
+    // Input arguments: same as backwardWarpImg.
+    // Output: the footprint ROI of the warped source image in canvas coordinates, with mask and image of roi.size().
+    // Only the pixels inside the footprint spans are transformed, so the cost scales with the source image size
+    // instead of the canvas size.
+    validateWarpInputs(src_img, destToSrc_H, canvas_shape);
+
+    WarpROI result;
+    std::vector<WarpSpan> spans = warpFootprintSpans(src_img.size(), destToSrc_H, canvas_shape, result.roi);
+
+    // initialize dest_img and mask, ROI sized
+    result.img = cv::Mat::zeros(result.roi.size(), src_img.type());  // float32 (range 0.0 - 1.0) or uint8, 3 channels
+    result.mask = cv::Mat::zeros(result.roi.size(), CV_8U);    // uint8, values: 0 or 1
+    if (result.roi.empty()) {
+        return result;
+    }
+
+    const cv::Rect roi = result.roi;
+    const bool byte_pixels = src_img.type() == CV_8UC3;
+    const WarpSource src = {byte_pixels ? nullptr : src_img.ptr<float>(), src_img.step / sizeof(float), src_img.cols, src_img.rows};
+    const WarpSource8 src8 = {src_img.ptr<uchar>(), src_img.step, src_img.cols, src_img.rows};
+    const double H[9] = {destToSrc_H(0, 0), destToSrc_H(0, 1), destToSrc_H(0, 2),
+                         destToSrc_H(1, 0), destToSrc_H(1, 1), destToSrc_H(1, 2),
+                         destToSrc_H(2, 0), destToSrc_H(2, 1), destToSrc_H(2, 2)};
+
+    // OpenMP tasks of rows, one footprint span per row (SIMD kernel inside the row)
+    parallelFor(LoopStage::WarpRows, roi.height, kWarpRowGrain, [&](int r) {
+        const WarpSpan& span = spans[r];
+        if (span.x_begin >= span.x_end) {
+            return;
         }
+        uchar* mask = result.mask.ptr<uchar>(r) + (span.x_begin - roi.x);
+        if (byte_pixels) {
+            warpRow(src8, H, roi.y + r, span.x_begin, span.x_end, result.img.ptr<uchar>(r) + (span.x_begin - roi.x) * 3, mask, mode);
+        } else {
+            warpRow(src, H, roi.y + r, span.x_begin, span.x_end, result.img.ptr<float>(r) + (span.x_begin - roi.x) * 3, mask, mode);
+        }
+    });
+
+    return result;
+}
+
+std::pair<cv::Mat, cv::Mat> backwardWarpImg(const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, WarpInterp mode) {
+    // Input arguments: {src_img, destToSrc_H, canvas_shape, mode}.
+    // src_img is the source image,3-channel float32 (CV_32FC3) matrix, range [0.0f, 1.0f] with size (width, height, 3),
+    //   or 3-channel uint8 (CV_8UC3): the warp then stays 8-bit (interpolated in float, rounded)
+    // destToSrc_H: inverse of H_3x3 
+    // canvas_shape is the shape of canvas with (width, height)
+    // mode is the sampling of the source image: nearest (default), bilinear or bicubic
+    
+    // Output: {dest_mask, dest_img}. 
+    // dest_mask is a uint8 (CV_8U) binary matrix, the values are 0 or 1
+    // dest_img is a 3-channel float32 (CV_32FC3) matrix, range 0.0 - 1.0, are the warpped source image (CV_8UC3 for an 8-bit source)
+
+    // Warp the footprint only, then place it on the full canvas
+    WarpROI warped = backwardWarpImgROI(src_img, destToSrc_H, canvas_shape, mode);
+
+    // initialize dest_img and mask
+    cv::Mat dest_img = cv::Mat::zeros(canvas_shape, src_img.type());  // dest_img, 3 channels, type of src_img
+    cv::Mat dest_mask = cv::Mat::zeros(canvas_shape, CV_8U);    // mask, uint8, values: 0 or 1
+    if (!warped.roi.empty()) {
+        warped.img.copyTo(dest_img(warped.roi));
+        warped.mask.copyTo(dest_mask(warped.roi));
     }
 
     return {dest_mask, dest_img};
@@ -3,8 +3,31 @@
 
 #include <opencv2/opencv.hpp>
 #include <utility>
+#include <vector>
 #include <Eigen/Dense> 
+#include "warpKernel.h"
 
-std::pair<cv::Mat, cv::Mat> backwardWarpImg(const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape);
+std::pair<cv::Mat, cv::Mat> backwardWarpImg(const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape,
+                                            WarpInterp mode = WarpInterp::Nearest);
+
+// Warp result restricted to the destination footprint of the source image
+struct WarpROI {
+    cv::Rect roi;   // bounding box of the footprint in canvas coordinates (empty if the image misses the canvas)
+    cv::Mat mask;   // CV_8U, roi.size(), values 0 or 1
+    cv::Mat img;    // roi.size(), type of the source: CV_32FC3 (range 0.0 - 1.0) or CV_8UC3
+};
+
+// Horizontal pixel span [x_begin, x_end) of the warped footprint on one canvas row
+struct WarpSpan {
+    int x_begin;
+    int x_end;
+};
+
+// Per-row spans of the footprint of a (width x height) source image inside roi, rows roi.y .. roi.y + roi.height - 1.
+// The spans are conservative: every pixel whose nearest source pixel is inside the image lies in its row span.
+std::vector<WarpSpan> warpFootprintSpans(const cv::Size& src_size, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, cv::Rect& roi);
+
+WarpROI backwardWarpImgROI(const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape,
+                           WarpInterp mode = WarpInterp::Nearest);
 
 #endif // BACKWARD_WARP_IMG_H
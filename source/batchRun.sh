@@ -1,14 +1,28 @@
 #!/bin/bash
 
 # batch run program from thread 1 to max_thread_num
+# if report_dir is given, every run also writes its per-stage report to report_dir/threads_<i>.{json,csv}
+# any further arguments are passed to stitch_image (e.g. --feature-cache dir)
 
 if [ $# -lt 1 ]; then
-    echo "Usage: $0 <max_thread_num>"
+    echo "Usage: $0 <max_thread_num> [report_dir] [stitch_image options...]"
     exit 1
 fi
 
-for ((i=1; i <= $1; i++))
+max_thread_num="$1"
+report_dir="$2"
+shift $(( $# >= 2 ? 2 : 1 ))
+
+if [ -n "$report_dir" ]; then
+    mkdir -p "$report_dir"
+fi
+
+for ((i=1; i <= max_thread_num; i++))
 do
     # echo "begin run ${i} threads"
-    ./stitch_image $i
-done
\ No newline at end of file
+    if [ -n "$report_dir" ]; then
+        ./stitch_image $i --report "$report_dir/threads_${i}" "$@"
+    else
+        ./stitch_image $i "$@"
+    fi
+done
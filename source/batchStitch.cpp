@@ -0,0 +1,129 @@
+#include "batchStitch.h"
+#include "profiler.h"
+#include "stitcher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+namespace {
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+} // namespace
+
+std::vector<BatchJob> readBatchManifest(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::invalid_argument("Error: could not open manifest " + path + ".");
+    }
+    std::vector<BatchJob> jobs;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.name) || job.name[0] == '#') {
+            continue;
+        }
+        std::string img;
+        while (fields >> img) {
+            job.paths.push_back(img);
+        }
+        if (job.paths.empty()) {
+            throw std::invalid_argument("Error: manifest job " + job.name + " has no images.");
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+BatchStats runBatch(const std::vector<BatchJob>& jobs, const StitchOptions& options, const BatchOptions& batch) {
+    BatchStats stats;
+    stats.jobs = static_cast<int>(jobs.size());
+    if (jobs.empty()) {
+        return stats;
+    }
+    // 1. split the cores: concurrent jobs x OpenMP threads per job
+    const int threads = std::max(1, batch.threads);
+    const int parallel_jobs = std::max(1, std::min(batch.parallel_jobs > 0 ? batch.parallel_jobs : threads, stats.jobs));
+    const int threads_per_job = std::max(1, threads / parallel_jobs);
+    stats.parallel_jobs = parallel_jobs;
+    stats.threads_per_job = threads_per_job;
+    if (!batch.output_dir.empty()) {
+        std::filesystem::create_directories(batch.output_dir);
+    }
+
+    // 2. workers pull the next job index, every worker thread owns its OpenMP team
+    std::vector<double> latency(jobs.size(), 0.0);
+    std::vector<char> failed(jobs.size(), 0);
+    std::atomic<size_t> next_job{0};
+    auto start_time = high_resolution_clock::now();
+    std::vector<std::thread> workers;
+    for (int w = 0; w < parallel_jobs; ++w) {
+        workers.emplace_back([&] {
+            // one long-lived stitcher per worker: its OpenMP team and SIFT detectors are reused by every job
+            Stitcher stitcher(options, threads_per_job);
+            for (size_t j = next_job++; j < jobs.size(); j = next_job++) {
+                auto job_start = high_resolution_clock::now();
+                try {
+                    std::vector<cv::Mat> imgs;
+                    for (const std::string& path : jobs[j].paths) {
+                        imgs.push_back(cv::imread(path));
+                        if (imgs.back().empty()) {
+                            throw std::runtime_error("could not load image " + path);
+                        }
+                    }
+                    cv::Mat result = stitcher.stitch(imgs).panorama;
+                    if (!batch.output_dir.empty()) {
+                        const std::string path = (std::filesystem::path(batch.output_dir) / (jobs[j].name + "_stitched.png")).string();
+                        if (!cv::imwrite(path, result)) {
+                            throw std::runtime_error("could not write " + path);
+                        }
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Job " << jobs[j].name << " failed: " << e.what() << std::endl;
+                    failed[j] = 1;
+                }
+                latency[j] = std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - job_start).count();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    stats.total_ms = std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start_time).count();
+
+    // 3. aggregate throughput and latency of the successful jobs
+    std::vector<double> done;
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        if (failed[j]) {
+            ++stats.failed;
+        } else {
+            done.push_back(latency[j]);
+            Profiler::instance().addTime("batchJob", latency[j]);
+        }
+    }
+    std::sort(done.begin(), done.end());
+    stats.throughput = stats.total_ms > 0 ? done.size() * 1000.0 / stats.total_ms : 0.0;
+    stats.p50_ms = percentile(done, 50.0);
+    stats.p99_ms = percentile(done, 99.0);
+    Profiler::instance().addCounter("batch_jobs", stats.jobs);
+    Profiler::instance().addCounter("batch_failed", stats.failed);
+    return stats;
+}
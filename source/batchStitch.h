@@ -0,0 +1,40 @@
+#ifndef BATCH_STITCH_H
+#define BATCH_STITCH_H
+
+#include <string>
+#include <vector>
+#include "stitchImg.h"
+
+// Batch mode: many independent panoramas through one worker pool.
+// The cores are split between concurrent jobs and the OpenMP team of every job, so small panoramas that do
+// not scale inside one stitch still fill the machine. Throughput and per-job latency percentiles are reported.
+
+// One panorama: input images in stitching order
+struct BatchJob {
+    std::string name;
+    std::vector<std::string> paths;
+};
+
+struct BatchOptions {
+    int threads = 1;          // total threads
+    int parallel_jobs = 0;    // concurrent jobs, 0 = one per thread (fewer if there are fewer jobs)
+    std::string output_dir;   // <output_dir>/<name>_stitched.png, empty = results are not written
+};
+
+struct BatchStats {
+    int jobs = 0;
+    int failed = 0;
+    int parallel_jobs = 0;
+    int threads_per_job = 0;
+    double total_ms = 0.0;
+    double throughput = 0.0;  // panoramas per second
+    double p50_ms = 0.0;      // job latency percentiles (load, stitch and write)
+    double p99_ms = 0.0;
+};
+
+// Manifest: one job per line, "name img1 img2 ...", blank lines and lines starting with '#' are ignored
+std::vector<BatchJob> readBatchManifest(const std::string& path);
+
+BatchStats runBatch(const std::vector<BatchJob>& jobs, const StitchOptions& options, const BatchOptions& batch);
+
+#endif // BATCH_STITCH_H
@@ -1,6 +1,8 @@
 #!/bin/bash
 
 # for each schedule type, run from chunk 1,2,4...,16, and save the results
+# the schedule and chunk apply to every parallel loop (--loop-schedule); ./stitch_image n --autotune tunes them per stage
+# SIFT features are cached in ../results/feature_cache, so only the first run detects them
 
 if [ $# -lt 2 ]; then
     echo "Usage: $0 <schedule_type>(static|dynamic|guided) <max_thread_num>"
@@ -16,9 +18,7 @@ sh build.sh
 
 for ((i = 1; i <= 16; i *= 2))
 do
-export OMP_SCHEDULE="${1},${i}"
-
 echo "begin to write ${1}_${i}_threads_${2}_results.txt"
-bash batchRun.sh ${2} | tee ../results/${1}_${i}_threads_${2}_results.txt
+bash batchRun.sh ${2} ../results/profile/${1}_${i} --feature-cache ../results/feature_cache --loop-schedule ${1},${i} | tee ../results/${1}_${i}_threads_${2}_results.txt
 
 done
\ No newline at end of file
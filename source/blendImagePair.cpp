@@ -1,10 +1,98 @@
 #include "blendImagePair.h"
+#include "featherWeight.h"
 #include "common.h"
+#include "multibandBlend.h"
+#include "taskGraph.h"
 #include <opencv2/opencv.hpp>
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <omp.h>
 
-cv::Mat blendImagePair(const cv::Mat& img1, const cv::Mat& mask1, const cv::Mat& img2, const cv::Mat& mask2, const std::string& mode) {
+namespace {
+
+// Rows per OpenMP task of the blending and distance update loops
+constexpr int kBlendRowGrain = 16;
+
+cv::Rect padRect(const cv::Rect& r, int margin, const cv::Size& size) {
+    return cv::Rect(r.x - margin, r.y - margin, r.width + 2 * margin, r.height + 2 * margin) & cv::Rect(0, 0, size.width, size.height);
+}
+
+// Distance transform of the non-zero pixels of mask, restricted to window
+cv::Mat windowDistance(const cv::Mat& mask, const cv::Rect& window) {
+    cv::Mat binary = mask(window) > 0;
+    cv::Mat dist;
+    cv::distanceTransform(binary, dist, cv::DIST_L2, 3);
+    return dist;
+}
+
+} // namespace
+
+void BlendDistanceCache::compute(const cv::Mat& mask) {
+    dist_ = cv::min(windowDistance(mask, cv::Rect(0, 0, mask.cols, mask.rows)), kFeatherRadius);
+}
+
+void BlendDistanceCache::update(const cv::Mat& mask1, const cv::Mat& mask2, const cv::Rect& changed) {
+    if (dist_.size() != mask1.size() || changed.empty()) {
+        return;
+    }
+    // 1. distance transform of the new coverage on the changed region padded by two exact margins
+    const cv::Rect window = padRect(changed, 2 * kFeatherMargin, dist_.size());
+    cv::Mat coverage = (mask1(window) > 0) | (mask2(window) > 0);
+    cv::Mat local;
+    cv::distanceTransform(coverage, local, cv::DIST_L2, 3);
+
+    // 2. a pixel at least kFeatherRadius from the window edges inside the canvas has no closer uncovered pixel
+    //    outside the window: its capped window value is exact. The pixels closer to the edges are farther than
+    //    kFeatherRadius from the changed region, so their capped value did not change: keep it.
+    const bool left = window.x > 0, top = window.y > 0;
+    const bool right = window.x + window.width < dist_.cols, bottom = window.y + window.height < dist_.rows;
+    parallelFor(LoopStage::BlendDistance, window.height, kBlendRowGrain, [&](int y) {
+        const float* w = local.ptr<float>(y);
+        float* d = dist_.ptr<float>(window.y + y) + window.x;
+        int edge_y = std::numeric_limits<int>::max();
+        if (top) edge_y = std::min(edge_y, y + 1);
+        if (bottom) edge_y = std::min(edge_y, window.height - y);
+        for (int x = 0; x < window.width; ++x) {
+            int edge = edge_y;
+            if (left) edge = std::min(edge, x + 1);
+            if (right) edge = std::min(edge, window.width - x);
+            if (edge == std::numeric_limits<int>::max() || kChamferStep * edge >= kFeatherRadius) {
+                d[x] = std::min(w[x], kFeatherRadius);
+            }
+        }
+    });
+}
+
+void BlendDistanceCache::grow(int left, int top, cv::Size canvas_size, MatPool* pool) {
+    if (dist_.empty() || (left == 0 && top == 0 && canvas_size == dist_.size())) {
+        return;
+    }
+    // the new area is uncovered: pixels of the old canvas get at most their distance to the exposed sides
+    const int rows = dist_.rows, cols = dist_.cols;
+    const bool exposed_left = left > 0, exposed_top = top > 0;
+    const bool exposed_right = left + cols < canvas_size.width, exposed_bottom = top + rows < canvas_size.height;
+    // with a pool the old values are already at their new place and are capped there
+    cv::Mat grown = pool ? pool->grow("blend_distance", dist_, canvas_size, left, top, LoopStage::BlendDistance)
+                         : cv::Mat::zeros(canvas_size, CV_32F);
+    parallelFor(LoopStage::BlendDistance, rows, kBlendRowGrain, [&](int y) {
+        const float* src = pool ? grown.ptr<float>(top + y) + left : dist_.ptr<float>(y);
+        float* dst = grown.ptr<float>(top + y) + left;
+        int edge_y = std::numeric_limits<int>::max();
+        if (exposed_top) edge_y = std::min(edge_y, y + 1);
+        if (exposed_bottom) edge_y = std::min(edge_y, rows - y);
+        for (int x = 0; x < cols; ++x) {
+            int edge = edge_y;
+            if (exposed_left) edge = std::min(edge, x + 1);
+            if (exposed_right) edge = std::min(edge, cols - x);
+            dst[x] = edge == std::numeric_limits<int>::max() ? src[x] : std::min(src[x], kChamferStep * edge);
+        }
+    });
+    dist_ = grown;
+}
+
+cv::Mat blendImagePair(const cv::Mat& img1, const cv::Mat& mask1, const cv::Mat& img2, const cv::Mat& mask2, const std::string& mode,
+                       BlendDistanceCache* cache, MatPool* pool) {
     // Input: "img1" and "img2" (normalized CV_32FC3, 3 channel, range 0.0-1.0); 
     // Input: "mask1" and "mask2" (binary mask, CV_8U, one channel, range [0,1] and [0,255] are both ok, since it will be automatically normalized below)
     // Output: "out_img" (CV_32FC3, 3 channels, range 0.0-1.0)
@@ -32,65 +120,96 @@ cv::Mat blendImagePair(const cv::Mat& img1, const cv::Mat& mask1, const cv::Mat&
     }
 
     // 4. Validate mode
-    if (mode != "overlay" && mode != "blend") {
-        throw std::invalid_argument("Error: mode must be either 'overlay' or 'blend'.");
+    if (mode != "overlay" && mode != "blend" && mode != "multiband") {
+        throw std::invalid_argument("Error: mode must be either 'overlay', 'blend' or 'multiband'.");
+    }
+    if (mode == "multiband") {
+        // Laplacian pyramid blending, restricted to the overlap of the masks
+        return multibandBlendPair(img1, mask1, img2, mask2);
     }
-
-    
-    // Input masks normalization (normalized binary values: 0 or 255 CV_8U)
-    cv::Mat mask1_normalized = (mask1 > 0) * 255;  // Ensure binary mask
-    cv::Mat mask2_normalized = (mask2 > 0) * 255;
 
     cv::Mat out_img;
 
     if (mode == "overlay") {
         // Overlay img2 onto img1 using mask2
+        // Input mask normalization (normalized binary values: 0 or 255 CV_8U)
+        cv::Mat mask2_normalized = (mask2 > 0) * 255;  // Ensure binary mask
         out_img = img1.clone();
         cv::Mat binary_mask2;
         mask2_normalized.convertTo(binary_mask2, CV_8U, 1.0 / 255);  // Convert to binary [0, 1]
         img2.copyTo(out_img, binary_mask2);
     } else if (mode == "blend") {
-        // Smooth blending using distance transform
-        cv::Mat dist_transform1, dist_transform2;
-
-        // Distance Transform (these functions are already optimized in OpenCV)
-        cv::distanceTransform(mask1_normalized, dist_transform1, cv::DIST_L2, 3);
-        cv::distanceTransform(mask2_normalized, dist_transform2, cv::DIST_L2, 3);
-
-        // Normalize distances
-        double max1, max2;
-        cv::minMaxLoc(dist_transform1, nullptr, &max1);
-        cv::minMaxLoc(dist_transform2, nullptr, &max2);
-        dist_transform1 /= max1 > 0 ? max1 : 1;
-        dist_transform2 /= max2 > 0 ? max2 : 1;
-
-        // Merge into 3 channels
-        cv::Mat dist_transform1_3c, dist_transform2_3c;
-        cv::Mat dist_channels1[3] = { dist_transform1, dist_transform1, dist_transform1 };
-        cv::Mat dist_channels2[3] = { dist_transform2, dist_transform2, dist_transform2 };
-        cv::merge(dist_channels1, 3, dist_transform1_3c);
-        cv::merge(dist_channels2, 3, dist_transform2_3c);
-
-        // Calculate blend weights and avoid division by zero
-        cv::Mat blend_weights = dist_transform1_3c + dist_transform2_3c;
-        blend_weights.setTo(1.0, blend_weights == 0);
-
-        // Pre-allocate output image
-        out_img = cv::Mat::zeros(img1.size(), img1.type());
-
-        // Parallelize the blending operation using OpenMP
-        #pragma omp parallel for 
-        for (int y = 0; y < img1.rows; ++y) {
-            const float* img1_ptr = img1.ptr<float>(y);
-            const float* img2_ptr = img2.ptr<float>(y);
-            const float* weight1_ptr = dist_transform1_3c.ptr<float>(y);
-            const float* weight2_ptr = dist_transform2_3c.ptr<float>(y);
-            const float* blend_weight_ptr = blend_weights.ptr<float>(y);
-            float* out_ptr = out_img.ptr<float>(y);
-
-            for (int x = 0; x < img1.cols * 3; ++x) {
-                out_ptr[x] = (img1_ptr[x] * weight1_ptr[x] + img2_ptr[x] * weight2_ptr[x]) / blend_weight_ptr[x];
+        // Smooth blending using distance transform, only evaluated where both masks are set
+        const cv::Size size = img1.size();
+
+        // 1. outside the overlap the output is the image that covers the pixel (0 where none does)
+        out_img = pool ? pool->acquire("blend_out", size, img1.type(), true, LoopStage::BlendRows) : cv::Mat::zeros(size, img1.type());
+        img2.copyTo(out_img, mask2);
+        img1.copyTo(out_img, mask1);
+
+        // 2. the overlap lies inside the bounding box of mask2
+        const cv::Rect box2 = cv::boundingRect(mask2);
+        cv::Rect overlap;
+        if (!box2.empty()) {
+            overlap = cv::boundingRect((mask1(box2) > 0) & (mask2(box2) > 0));
+            overlap.x += box2.x;
+            overlap.y += box2.y;
+        }
+        if (overlap.empty()) {
+            if (cache) {
+                cache->update(mask1, mask2, box2);
             }
+            return out_img;
+        }
+
+        // 3. distance fields, exact up to kFeatherRadius on the overlap: mask2 on its bounding box padded by
+        //    one pixel, mask1 from the cache or on the overlap padded by the exact margin
+        const cv::Rect window2 = padRect(box2, 1, size);
+        cv::Mat dist2 = windowDistance(mask2, window2);
+
+        cv::Rect window1;
+        cv::Mat dist1;
+        if (cache) {
+            if (cache->distance().size() != size) {
+                cache->compute(mask1);
+            }
+            window1 = cv::Rect(0, 0, size.width, size.height);
+            dist1 = cache->distance();
+        } else {
+            window1 = padRect(overlap, kFeatherMargin, size);
+            dist1 = windowDistance(mask1, window1);
+        }
+
+        // 4. blend the overlap, single-channel weights applied to the 3 channels
+        parallelFor(LoopStage::BlendRows, overlap.height, kBlendRowGrain, [&](int r) {
+            const int y = overlap.y + r;
+            const float* img1_ptr = img1.ptr<float>(y) + overlap.x * 3;
+            const float* img2_ptr = img2.ptr<float>(y) + overlap.x * 3;
+            const uchar* mask1_ptr = mask1.ptr<uchar>(y) + overlap.x;
+            const uchar* mask2_ptr = mask2.ptr<uchar>(y) + overlap.x;
+            const float* weight1_ptr = dist1.ptr<float>(y - window1.y) + (overlap.x - window1.x);
+            const float* weight2_ptr = dist2.ptr<float>(y - window2.y) + (overlap.x - window2.x);
+            float* out_ptr = out_img.ptr<float>(y) + overlap.x * 3;
+
+            for (int x = 0; x < overlap.width; ++x) {
+                if (!mask1_ptr[x] || !mask2_ptr[x]) {
+                    continue;
+                }
+                const float w1 = featherWeight(weight1_ptr[x]);
+                const float w2 = featherWeight(weight2_ptr[x]);
+                float sum = w1 + w2;
+                if (sum == 0.0f) {
+                    sum = 1.0f;  // avoid division by zero
+                }
+                for (int c = 0; c < 3; ++c) {
+                    out_ptr[3 * x + c] = (img1_ptr[3 * x + c] * w1 + img2_ptr[3 * x + c] * w2) / sum;
+                }
+            }
+        });
+
+        // 5. the canvas of the next iteration is covered by mask1 | mask2
+        if (cache) {
+            cache->update(mask1, mask2, box2);
         }
     }
 
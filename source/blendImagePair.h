@@ -3,7 +3,38 @@
 
 #include <opencv2/opencv.hpp>
 #include <string>
+#include "matPool.h"
 
-cv::Mat blendImagePair(const cv::Mat& img1, const cv::Mat& mask1, const cv::Mat& img2, const cv::Mat& mask2, const std::string& mode);
+// Distance field of the accumulated canvas (mask1 of the "blend" mode), kept across stitchImg iterations.
+// The field is capped at the feathering radius of the blend weights. A blend only changes the canvas coverage
+// inside the bounding box of mask2 and a capped distance only depends on the pixels within the radius, so the
+// field is recomputed exactly on that box (padded) instead of on the whole canvas, and shifted when the canvas grows.
+class BlendDistanceCache {
+public:
+    bool empty() const { return dist_.empty(); }
+    void reset() { dist_.release(); }
+
+    // Full distance transform of mask (non-zero = covered), capped at the feathering radius
+    void compute(const cv::Mat& mask);
+    // Coverage of the canvas is now mask1 | mask2 and only changed inside the rectangle changed
+    void update(const cv::Mat& mask1, const cv::Mat& mask2, const cv::Rect& changed);
+    // The canvas was enlarged to canvas_size with the old canvas at (left, top), the new area is empty.
+    // With a pool the field lives in its "blend_distance" slot and is shifted in place.
+    void grow(int left, int top, cv::Size canvas_size, MatPool* pool = nullptr);
+
+    const cv::Mat& distance() const { return dist_; }  // CV_32F, canvas size
+
+private:
+    cv::Mat dist_;
+};
+
+// mode "overlay", "blend" or "multiband".
+// "blend" weights each image by its distance to the edge of its mask, capped at a feathering radius (featherWeight.h).
+// cache ("blend" only): distance field of mask1, reused instead of a distance transform of mask1 and updated
+// to the coverage of the result (mask1 | mask2). Without a cache the mask1 field is computed on the overlap
+// padded by the radius; both give the same weights.
+// pool ("blend" only): the output is its "blend_out" matrix, valid until the next call with the same pool.
+cv::Mat blendImagePair(const cv::Mat& img1, const cv::Mat& mask1, const cv::Mat& img2, const cv::Mat& mask2, const std::string& mode,
+                       BlendDistanceCache* cache = nullptr, MatPool* pool = nullptr);
 
 #endif // BLEND_IMAGE_PAIR_H
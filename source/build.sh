@@ -7,8 +7,25 @@ DEBUG=0
 # Set compiler
 CXX=g++
 
+# Stitching library (Stitcher API, every stage), linked into stitch_image
+LIB_SOURCES="stitcher.cpp stitchImg.cpp ransac.cpp helper.cpp backwardWarpImg.cpp blendImagePair.cpp homography.cpp profiler.cpp warpKernel.cpp warpBlend.cpp stitchGlobal.cpp featureCache.cpp descriptorMatcher.cpp refineHomography.cpp multibandBlend.cpp streamStitch.cpp warpMap.cpp batchStitch.cpp tiledCanvas.cpp coarseToFine.cpp canvasRegions.cpp loopTuning.cpp autotune.cpp matPool.cpp"
+LIB_OUTPUT="libstitch.a"
+LIB_OBJECTS=$(echo $LIB_SOURCES | sed 's/\.cpp/.o/g')
+
 # Set source files
-SOURCES="stitchImg.cpp ransac.cpp helper.cpp backwardWarpImg.cpp blendImagePair.cpp homography.cpp"
+SOURCES="stitchMain.cpp $LIB_OUTPUT"
+
+# Descriptor matching benchmark
+BENCH_SOURCES="matchBenchmark.cpp descriptorMatcher.cpp featureCache.cpp profiler.cpp loopTuning.cpp"
+BENCH_OUTPUT="match_benchmark"
+
+# Kernel microbenchmarks (synthetic inputs, JSON summary, baseline comparison)
+KERNEL_BENCH_SOURCES="kernelBenchmark.cpp homography.cpp ransac.cpp backwardWarpImg.cpp warpKernel.cpp blendImagePair.cpp multibandBlend.cpp helper.cpp featureCache.cpp descriptorMatcher.cpp profiler.cpp loopTuning.cpp matPool.cpp"
+KERNEL_BENCH_OUTPUT="kernel_benchmark"
+
+# Feature backend benchmark (SIFT, ORB, AKAZE registration of the rig pairs)
+FEATURE_BENCH_SOURCES="featureBenchmark.cpp $LIB_OUTPUT"
+FEATURE_BENCH_OUTPUT="feature_benchmark"
 
 # Set output binary name
 OUTPUT="stitch_image"
@@ -16,10 +33,18 @@ OUTPUT="stitch_image"
 # Compile with C++17, linking OpenCV
 if [ "$DEBUG" -eq 0 ]; then
     echo "Compilation with O2 optimization."
-    $CXX -std=c++17 -O2 $SOURCES -o $OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp
+    $CXX -std=c++17 -O2 -c $LIB_SOURCES `pkg-config --cflags opencv4` -fopenmp && ar rcs $LIB_OUTPUT $LIB_OBJECTS && \
+    $CXX -std=c++17 -O2 $SOURCES -o $OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp -pthread && \
+    $CXX -std=c++17 -O2 $BENCH_SOURCES -o $BENCH_OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp && \
+    $CXX -std=c++17 -O2 $KERNEL_BENCH_SOURCES -o $KERNEL_BENCH_OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp && \
+    $CXX -std=c++17 -O2 $FEATURE_BENCH_SOURCES -o $FEATURE_BENCH_OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp -pthread
 else
     echo "Compilation with debug info."
-    $CXX -std=c++17 -g $SOURCES -o $OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp
+    $CXX -std=c++17 -g -c $LIB_SOURCES `pkg-config --cflags opencv4` -fopenmp && ar rcs $LIB_OUTPUT $LIB_OBJECTS && \
+    $CXX -std=c++17 -g $SOURCES -o $OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp -pthread && \
+    $CXX -std=c++17 -g $BENCH_SOURCES -o $BENCH_OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp && \
+    $CXX -std=c++17 -g $KERNEL_BENCH_SOURCES -o $KERNEL_BENCH_OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp && \
+    $CXX -std=c++17 -g $FEATURE_BENCH_SOURCES -o $FEATURE_BENCH_OUTPUT `pkg-config --cflags --libs opencv4` -fopenmp -pthread
 fi
 
 # Check compilation result
@@ -0,0 +1,148 @@
+#include "canvasRegions.h"
+#include "homography.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+std::vector<Eigen::Vector2d> keypointPositions(const std::vector<cv::KeyPoint>& keypoints) {
+    std::vector<Eigen::Vector2d> pts;
+    pts.reserve(keypoints.size());
+    for (const cv::KeyPoint& kp : keypoints) {
+        pts.emplace_back(kp.pt.x, kp.pt.y);
+    }
+    return pts;
+}
+
+// Keypoints (and their descriptor rows) for which keep[i] is set
+void keepKeypoints(std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors, const std::vector<bool>& keep) {
+    const size_t count = std::count(keep.begin(), keep.end(), true);
+    if (count == keypoints.size()) {
+        return;
+    }
+    std::vector<cv::KeyPoint> kept_keypoints;
+    cv::Mat kept_descriptors(static_cast<int>(count), descriptors.cols, descriptors.type());
+    kept_keypoints.reserve(count);
+    for (size_t i = 0; i < keypoints.size(); ++i) {
+        if (keep[i]) {
+            std::memcpy(kept_descriptors.ptr(static_cast<int>(kept_keypoints.size())), descriptors.ptr(static_cast<int>(i)),
+                        descriptors.cols * descriptors.elemSize());
+            kept_keypoints.push_back(keypoints[i]);
+        }
+    }
+    keypoints.swap(kept_keypoints);
+    descriptors = kept_descriptors;
+}
+
+} // namespace
+
+void CanvasRegions::add(int image, const ImageFeatures& features, const Eigen::Matrix3d& img_to_canvas, cv::Size img_size,
+                        cv::Size canvas_size) {
+    // 1. footprint of the image on the canvas
+    std::vector<Eigen::Vector2d> corners = {
+        {0, 0}, {img_size.width - 1, 0}, {img_size.width - 1, img_size.height - 1}, {0, img_size.height - 1}};
+    double min_x = canvas_size.width, min_y = canvas_size.height, max_x = 0, max_y = 0;
+    for (const Eigen::Vector2d& pt : applyHomography(img_to_canvas, corners)) {
+        min_x = std::min(min_x, pt.x());
+        min_y = std::min(min_y, pt.y());
+        max_x = std::max(max_x, pt.x());
+        max_y = std::max(max_y, pt.y());
+    }
+    Region region;
+    region.image = image;
+    region.img_to_canvas = img_to_canvas;
+    region.img_size = img_size;
+    const int x0 = static_cast<int>(std::floor(min_x)), y0 = static_cast<int>(std::floor(min_y));
+    region.footprint = cv::Rect(x0, y0, static_cast<int>(std::ceil(max_x)) + 1 - x0, static_cast<int>(std::ceil(max_y)) + 1 - y0) &
+                       cv::Rect(0, 0, canvas_size.width, canvas_size.height);
+
+    // 2. the new image covers older keypoints inside it
+    const Eigen::Matrix3d canvas_to_img = img_to_canvas.inverse();
+    for (Region& older : regions_) {
+        if ((older.footprint & region.footprint).empty()) {
+            continue;
+        }
+        const std::vector<Eigen::Vector2d> in_img = applyHomography(canvas_to_img, keypointPositions(older.keypoints));
+        std::vector<bool> keep(in_img.size());
+        for (size_t i = 0; i < in_img.size(); ++i) {
+            keep[i] = in_img[i].x() < 0 || in_img[i].y() < 0 || in_img[i].x() > img_size.width - 1 || in_img[i].y() > img_size.height - 1;
+        }
+        keepKeypoints(older.keypoints, older.descriptors, keep);
+    }
+
+    // 3. keypoints of the new image in canvas coordinates
+    const std::vector<Eigen::Vector2d> on_canvas = applyHomography(img_to_canvas, keypointPositions(features.keypoints));
+    region.keypoints = features.keypoints;
+    for (size_t i = 0; i < on_canvas.size(); ++i) {
+        region.keypoints[i].pt = cv::Point2f(static_cast<float>(on_canvas[i].x()), static_cast<float>(on_canvas[i].y()));
+    }
+    // own copy: cached descriptors are views into a memory-mapped file
+    region.descriptors = features.descriptors.clone();
+    regions_.push_back(region);
+}
+
+void CanvasRegions::shift(int dx, int dy) {
+    Eigen::Matrix3d translation = Eigen::Matrix3d::Identity();
+    translation(0, 2) = dx;
+    translation(1, 2) = dy;
+    for (Region& region : regions_) {
+        region.img_to_canvas = translation * region.img_to_canvas;
+        region.footprint.x += dx;
+        region.footprint.y += dy;
+        for (cv::KeyPoint& kp : region.keypoints) {
+            kp.pt.x += dx;
+            kp.pt.y += dy;
+        }
+    }
+}
+
+cv::Rect CanvasRegions::recentFootprint(int count) const {
+    const size_t first = count > 0 && static_cast<size_t>(count) < regions_.size() ? regions_.size() - count : 0;
+    cv::Rect area;
+    for (size_t r = first; r < regions_.size(); ++r) {
+        area = area.empty() ? regions_[r].footprint : (area | regions_[r].footprint);
+    }
+    return area;
+}
+
+ImageFeatures CanvasRegions::features(const cv::Rect& area) const {
+    ImageFeatures features;
+    int cols = 0, type = CV_32F;
+    size_t count = 0;
+    for (const Region& region : regions_) {
+        if (!(region.footprint & area).empty()) {
+            for (const cv::KeyPoint& kp : region.keypoints) {
+                count += area.contains(cv::Point(static_cast<int>(kp.pt.x), static_cast<int>(kp.pt.y)));
+            }
+            if (!region.descriptors.empty()) {
+                cols = region.descriptors.cols;
+                type = region.descriptors.type();
+            }
+        }
+    }
+    features.keypoints.reserve(count);
+    features.descriptors = cv::Mat(static_cast<int>(count), cols, type);
+    for (const Region& region : regions_) {
+        if ((region.footprint & area).empty()) {
+            continue;
+        }
+        for (size_t i = 0; i < region.keypoints.size(); ++i) {
+            const cv::KeyPoint& kp = region.keypoints[i];
+            if (area.contains(cv::Point(static_cast<int>(kp.pt.x), static_cast<int>(kp.pt.y)))) {
+                std::memcpy(features.descriptors.ptr(static_cast<int>(features.keypoints.size())), region.descriptors.ptr(static_cast<int>(i)),
+                            region.descriptors.cols * region.descriptors.elemSize());
+                features.keypoints.push_back(kp);
+            }
+        }
+    }
+    return features;
+}
+
+size_t CanvasRegions::keypoints() const {
+    size_t count = 0;
+    for (const Region& region : regions_) {
+        count += region.keypoints.size();
+    }
+    return count;
+}
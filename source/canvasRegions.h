@@ -0,0 +1,43 @@
+#ifndef CANVAS_REGIONS_H
+#define CANVAS_REGIONS_H
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Dense>
+#include <vector>
+#include "featureCache.h"
+
+// Keypoints of the accumulated canvas of the iterative stitcher, kept per placed image (region).
+// Every image is detected once; when it is placed, its keypoints are mapped into canvas coordinates and
+// stored with its footprint, so the canvas itself is never detected again. The black padding of the canvas
+// produces no keypoints, and a new image is only matched against the keypoints of the predicted overlap.
+// Canvas points covered by a newer image keep the keypoints of that image only, so no scene point is listed twice.
+class CanvasRegions {
+public:
+    struct Region {
+        int image;                            // input image index
+        Eigen::Matrix3d img_to_canvas;
+        cv::Size img_size;
+        cv::Rect footprint;                   // bounding box of the image on the canvas
+        std::vector<cv::KeyPoint> keypoints;  // canvas coordinates
+        cv::Mat descriptors;                  // one row per keypoint
+    };
+
+    // Place image `image` with its features (image coordinates) on the canvas of the given size
+    void add(int image, const ImageFeatures& features, const Eigen::Matrix3d& img_to_canvas, cv::Size img_size,
+             cv::Size canvas_size);
+    // The canvas grew: its old content now starts at (dx, dy)
+    void shift(int dx, int dy);
+
+    // Union of the footprints of the last `count` regions (all regions if count <= 0)
+    cv::Rect recentFootprint(int count) const;
+    // Keypoints of all regions inside area
+    ImageFeatures features(const cv::Rect& area) const;
+
+    const std::vector<Region>& regions() const { return regions_; }
+    size_t keypoints() const;
+
+private:
+    std::vector<Region> regions_;
+};
+
+#endif // CANVAS_REGIONS_H
@@ -0,0 +1,112 @@
+#include "coarseToFine.h"
+#include "stitchImg.h"
+#include "helper.h"
+#include "homography.h"
+#include "refineHomography.h"
+#include "profiler.h"
+#include "taskGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Overlap matches that must agree with the coarse homography before it is corrected
+constexpr int kMinOverlapInliers = 8;
+
+// Bounding box of an image of src_size projected by H, padded by margin and clipped to dest_size
+cv::Rect projectedOverlap(const Eigen::Matrix3d& H, const cv::Size& src_size, const cv::Size& dest_size, int margin) {
+    std::vector<Eigen::Vector2d> corners = {
+        {0, 0}, {src_size.width - 1, 0}, {src_size.width - 1, src_size.height - 1}, {0, src_size.height - 1}};
+    double min_x = dest_size.width, min_y = dest_size.height, max_x = -1.0, max_y = -1.0;
+    for (const Eigen::Vector2d& pt : applyHomography(H, corners)) {
+        min_x = std::min(min_x, pt.x());
+        min_y = std::min(min_y, pt.y());
+        max_x = std::max(max_x, pt.x());
+        max_y = std::max(max_y, pt.y());
+    }
+    const double x0 = std::max(0.0, std::floor(min_x) - margin), y0 = std::max(0.0, std::floor(min_y) - margin);
+    const double x1 = std::min<double>(dest_size.width, std::ceil(max_x) + margin + 1);
+    const double y1 = std::min<double>(dest_size.height, std::ceil(max_y) + margin + 1);
+    if (x1 <= x0 || y1 <= y0) {
+        return cv::Rect();
+    }
+    return cv::Rect(static_cast<int>(x0), static_cast<int>(y0), static_cast<int>(x1 - x0), static_cast<int>(y1 - y0));
+}
+
+} // namespace
+
+cv::Mat pyramidLevel(const cv::Mat& img, int level) {
+    if (level < 0) {
+        throw std::invalid_argument("Error: the pyramid level must not be negative.");
+    }
+    cv::Mat reduced = img;
+    for (int l = 0; l < level; ++l) {
+        cv::Mat down;
+        cv::pyrDown(reduced, down);
+        reduced = down;
+    }
+    return reduced;
+}
+
+ImageFeatures detectRegistrationFeatures(const cv::Mat& img, const StitchOptions& options) {
+    const int level = options.coarse.level;
+    if (level == 0) {
+        return detectFeatures(img, options.features);
+    }
+    PROFILE_SCOPE("coarseToFine.detect");
+    ImageFeatures features = detectFeatures(pyramidLevel(img, level), options.features);
+    // pixel i of a pyrDown level is centred on pixel 2i of the level below
+    const float scale = static_cast<float>(1 << level);
+    for (cv::KeyPoint& kp : features.keypoints) {
+        kp.pt.x *= scale;
+        kp.pt.y *= scale;
+        kp.size *= scale;
+    }
+    return features;
+}
+
+Eigen::Matrix3d refineOnOverlap(const cv::Mat& img_s, const cv::Mat& img_d, const Eigen::Matrix3d& H,
+                                const StitchOptions& options) {
+    if (options.coarse.level == 0 || !options.coarse.refine) {
+        return H;
+    }
+    PROFILE_SCOPE("coarseToFine.refine");
+
+    // 1. overlap predicted by the coarse homography, in both images
+    const cv::Rect roi_s = projectedOverlap(H.inverse(), img_d.size(), img_s.size(), options.coarse.overlap_margin);
+    const cv::Rect roi_d = projectedOverlap(H, img_s.size(), img_d.size(), options.coarse.overlap_margin);
+    if (roi_s.empty() || roi_d.empty()) {
+        return H;
+    }
+
+    // 2. a few full-resolution keypoints of each overlap, in image coordinates
+    FeatureParams params = options.features;
+    params.sift.nfeatures = options.coarse.refine_features;
+    params.orb_features = options.coarse.refine_features;
+    ImageFeatures features[2];
+    runTasks(2, [&](int i) {
+        const cv::Rect& roi = i == 0 ? roi_s : roi_d;
+        features[i] = detectFeatures((i == 0 ? img_s : img_d)(roi), params);
+        for (cv::KeyPoint& kp : features[i].keypoints) {
+            kp.pt.x += roi.x;
+            kp.pt.y += roi.y;
+        }
+    });
+    auto [xs, xd] = matchFeatures(features[0], features[1], options.matcher);
+
+    // 3. keep the matches the coarse homography agrees with, refine on them
+    std::vector<bool> inliers(xs.size(), false);
+    int count = 0;
+    const std::vector<Eigen::Vector2d> projected = applyHomography(H, xs);
+    for (size_t i = 0; i < xs.size(); ++i) {
+        inliers[i] = (projected[i] - xd[i]).norm() < options.ransac_eps;
+        count += inliers[i];
+    }
+    Profiler::instance().addCounter("overlap_inliers", count);
+    if (count < kMinOverlapInliers) {
+        return H;
+    }
+    return refineHomography(xs, xd, H, options.ransac_eps, inliers);
+}
@@ -0,0 +1,36 @@
+#ifndef COARSE_TO_FINE_H
+#define COARSE_TO_FINE_H
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Dense>
+#include "featureCache.h"
+
+// Coarse-to-fine registration.
+// Keypoints are detected and matched on a downsampled pyramid level (detection and matching cost drop by
+// about 4^level) and their coordinates are scaled back to full resolution, so RANSAC directly yields the
+// full-resolution homography. It is then optionally corrected with a small number of full-resolution
+// keypoints, detected only inside the overlap that the coarse homography predicts.
+struct CoarseToFineOptions {
+    int level = 0;                 // pyramid level of the registration keypoints (1 / 2^level), 0 = full resolution
+    bool refine = true;            // correct the coarse homography with full-resolution keypoints of the overlap
+    int refine_features = 500;     // full-resolution keypoints per image for the correction (SIFT and ORB)
+    int overlap_margin = 16;       // pixels added around the predicted overlap
+};
+
+struct StitchOptions;
+
+// img reduced level times by cv::pyrDown
+cv::Mat pyramidLevel(const cv::Mat& img, int level);
+
+// Features of img for registration (backend of options.features): detected on pyramid level options.coarse.level,
+// keypoint positions and sizes in full-resolution pixels
+ImageFeatures detectRegistrationFeatures(const cv::Mat& img, const StitchOptions& options);
+
+// Full-resolution correction of H (img_s to img_d) estimated on a pyramid level.
+// Matches full-resolution keypoints of the predicted overlap of both images, re-scores them against H
+// and refines H on the inliers (see refineHomography). Returns H unchanged at level 0, with refine off,
+// or if the overlap yields too few inliers.
+Eigen::Matrix3d refineOnOverlap(const cv::Mat& img_s, const cv::Mat& img_d, const Eigen::Matrix3d& H,
+                                const StitchOptions& options);
+
+#endif // COARSE_TO_FINE_H
@@ -1,5 +1 @@
-// #define FOR_SCHEDULE_TYPE static
-
-// #define CHUNKS_PER_THREAD 8
-
-// #define OMP_SCHEDULE(type, chunk) schedule(type, chunk)
\ No newline at end of file
+// Schedule, chunk size and thread count of the parallel loops are set per stage, see loopTuning.h
@@ -0,0 +1,844 @@
+#include "descriptorMatcher.h"
+#include "profiler.h"
+#include "taskGraph.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <immintrin.h>
+#include <omp.h>
+
+namespace {
+
+// Query rows per OpenMP task and train rows per tile of the brute-force kernel (256 x 128 floats = 128 KB, fits L2)
+constexpr int kQueryBlock = 32;
+constexpr int kTrainBlock = 256;
+// Binary descriptors are 32 (ORB) or 61 (AKAZE) bytes: 2048 train rows per tile stay within 128 KB as well
+constexpr int kHammingTrainBlock = 2048;
+
+// kd-forest: points per leaf, number of highest-variance dimensions the split is drawn from, samples for the variance
+constexpr int kLeafSize = 8;
+constexpr int kRandomDims = 5;
+constexpr int kVarianceSamples = 128;
+// k-means tree: nodes with more points assign them to the centers in parallel, points per task
+constexpr int kParallelAssignPoints = 4096;
+constexpr int kAssignGrain = 256;
+
+constexpr unsigned kIndexSeed = 759;
+
+// *** Squared L2 distance kernels ***
+
+float l2Scalar(const float* a, const float* b, int n) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+float l2AVX2(const float* a, const float* b, int n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s) + l2Scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+float l2AVX512(const float* a, const float* b, int n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)) + l2Scalar(a + i, b + i, n - i);
+}
+
+// Distances of four query rows to one train row: the train row is loaded once for all four
+void l2x4Scalar(const float* const q[4], const float* t, int n, float out[4]) {
+    for (int k = 0; k < 4; ++k) {
+        out[k] = l2Scalar(q[k], t, n);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void l2x4AVX2(const float* const q[4], const float* t, int n, float out[4]) {
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 tv = _mm256_loadu_ps(t + i);
+        for (int k = 0; k < 4; ++k) {
+            __m256 d = _mm256_sub_ps(_mm256_loadu_ps(q[k] + i), tv);
+            acc[k] = _mm256_fmadd_ps(d, d, acc[k]);
+        }
+    }
+    for (int k = 0; k < 4; ++k) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc[k]), _mm256_extractf128_ps(acc[k], 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        out[k] = _mm_cvtss_f32(s) + l2Scalar(q[k] + i, t + i, n - i);
+    }
+}
+
+__attribute__((target("avx512f")))
+void l2x4AVX512(const float* const q[4], const float* t, int n, float out[4]) {
+    __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 tv = _mm512_loadu_ps(t + i);
+        for (int k = 0; k < 4; ++k) {
+            __m512 d = _mm512_sub_ps(_mm512_loadu_ps(q[k] + i), tv);
+            acc[k] = _mm512_fmadd_ps(d, d, acc[k]);
+        }
+    }
+    for (int k = 0; k < 4; ++k) {
+        out[k] = _mm512_reduce_add_ps(acc[k]) + l2Scalar(q[k] + i, t + i, n - i);
+    }
+}
+
+using DistanceFn = float (*)(const float*, const float*, int);
+using Distance4Fn = void (*)(const float* const[4], const float*, int, float[4]);
+
+bool avx512Supported() {
+    return __builtin_cpu_supports("avx512f");
+}
+
+bool avx2Supported() {
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+DistanceFn distanceKernel() {
+    static const DistanceFn fn = avx512Supported() ? &l2AVX512 : avx2Supported() ? &l2AVX2 : &l2Scalar;
+    return fn;
+}
+
+Distance4Fn distance4Kernel() {
+    static const Distance4Fn fn = avx512Supported() ? &l2x4AVX512 : avx2Supported() ? &l2x4AVX2 : &l2x4Scalar;
+    return fn;
+}
+
+// *** Hamming distance kernels (binary descriptors, n bytes) ***
+
+int hammingScalar(const uchar* a, const uchar* b, int n) {
+    int bits = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+        bits += __builtin_popcountll(x ^ y);
+    }
+    for (; i < n; ++i) {
+        bits += __builtin_popcount(static_cast<unsigned>(a[i] ^ b[i]));
+    }
+    return bits;
+}
+
+// Bits set in each byte of v: two 4-bit table lookups (pshufb), summed per 64-bit lane by psadbw
+__attribute__((target("avx2")))
+inline __m256i popcountAVX2(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low_mask));
+    const __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+inline int reduceAVX2(__m256i acc) {
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return static_cast<int>(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+__attribute__((target("avx2")))
+int hammingAVX2(const uchar* a, const uchar* b, int n) {
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                           _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        acc = _mm256_add_epi64(acc, popcountAVX2(x));
+    }
+    return reduceAVX2(acc) + hammingScalar(a + i, b + i, n - i);
+}
+
+// AVX-512: native 64-bit popcount, the row tail is a masked load so a 32-byte ORB row is one iteration
+__attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+int hammingAVX512(const uchar* a, const uchar* b, int n) {
+    __m512i acc = _mm512_setzero_si512();
+    for (int i = 0; i < n; i += 64) {
+        const __mmask64 mask = n - i >= 64 ? ~__mmask64(0) : (__mmask64(1) << (n - i)) - 1;
+        const __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, a + i), _mm512_maskz_loadu_epi8(mask, b + i));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+    }
+    return static_cast<int>(_mm512_reduce_add_epi64(acc));
+}
+
+// Distances of four query rows to one train row, the train row is loaded once for all four
+void hammingx4Scalar(const uchar* const q[4], const uchar* t, int n, int out[4]) {
+    for (int k = 0; k < 4; ++k) {
+        out[k] = hammingScalar(q[k], t, n);
+    }
+}
+
+__attribute__((target("avx2")))
+void hammingx4AVX2(const uchar* const q[4], const uchar* t, int n, int out[4]) {
+    __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i tv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t + i));
+        for (int k = 0; k < 4; ++k) {
+            const __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(q[k] + i)), tv);
+            acc[k] = _mm256_add_epi64(acc[k], popcountAVX2(x));
+        }
+    }
+    for (int k = 0; k < 4; ++k) {
+        out[k] = reduceAVX2(acc[k]) + hammingScalar(q[k] + i, t + i, n - i);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+void hammingx4AVX512(const uchar* const q[4], const uchar* t, int n, int out[4]) {
+    __m512i acc[4] = {_mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512()};
+    for (int i = 0; i < n; i += 64) {
+        const __mmask64 mask = n - i >= 64 ? ~__mmask64(0) : (__mmask64(1) << (n - i)) - 1;
+        const __m512i tv = _mm512_maskz_loadu_epi8(mask, t + i);
+        for (int k = 0; k < 4; ++k) {
+            const __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, q[k] + i), tv);
+            acc[k] = _mm512_add_epi64(acc[k], _mm512_popcnt_epi64(x));
+        }
+    }
+    for (int k = 0; k < 4; ++k) {
+        out[k] = static_cast<int>(_mm512_reduce_add_epi64(acc[k]));
+    }
+}
+
+using HammingFn = int (*)(const uchar*, const uchar*, int);
+using Hamming4Fn = void (*)(const uchar* const[4], const uchar*, int, int[4]);
+
+bool avx512PopcntSupported() {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+           __builtin_cpu_supports("avx512vpopcntdq");
+}
+
+HammingFn hammingKernel() {
+    static const HammingFn fn = avx512PopcntSupported() ? &hammingAVX512 : __builtin_cpu_supports("avx2") ? &hammingAVX2 : &hammingScalar;
+    return fn;
+}
+
+Hamming4Fn hamming4Kernel() {
+    static const Hamming4Fn fn = avx512PopcntSupported() ? &hammingx4AVX512 : __builtin_cpu_supports("avx2") ? &hammingx4AVX2 : &hammingx4Scalar;
+    return fn;
+}
+
+// *** Two nearest neighbours ***
+
+struct Knn2 {
+    int best = -1;
+    int second = -1;
+    float best_dist = FLT_MAX;
+    float second_dist = FLT_MAX;
+
+    void push(int idx, float dist) {
+        if (dist < best_dist) {
+            second = best;
+            second_dist = best_dist;
+            best = idx;
+            best_dist = dist;
+        } else if (dist < second_dist) {
+            second = idx;
+            second_dist = dist;
+        }
+    }
+};
+
+// Exact 2-NN of every query row: query blocks in parallel, each block sweeps the train rows tile by tile,
+// four queries at a time against every train row of the tile
+void bruteForceKnn2(const cv::Mat& query, const cv::Mat& train, std::vector<Knn2>& out) {
+    const DistanceFn dist = distanceKernel();
+    const Distance4Fn dist4 = distance4Kernel();
+    const int dims = query.cols;
+    const int blocks = (query.rows + kQueryBlock - 1) / kQueryBlock;
+    out.assign(query.rows, Knn2());
+
+    parallelFor(LoopStage::MatchQueries, blocks, 1, [&](int b) {
+        const int q_end = std::min(query.rows, (b + 1) * kQueryBlock);
+        for (int t0 = 0; t0 < train.rows; t0 += kTrainBlock) {
+            const int t_end = std::min(train.rows, t0 + kTrainBlock);
+            int q = b * kQueryBlock;
+            for (; q + 4 <= q_end; q += 4) {
+                const float* qp[4] = {query.ptr<float>(q), query.ptr<float>(q + 1), query.ptr<float>(q + 2), query.ptr<float>(q + 3)};
+                float d[4];
+                for (int t = t0; t < t_end; ++t) {
+                    dist4(qp, train.ptr<float>(t), dims, d);
+                    for (int k = 0; k < 4; ++k) {
+                        out[q + k].push(t, d[k]);
+                    }
+                }
+            }
+            for (; q < q_end; ++q) {
+                const float* qp = query.ptr<float>(q);
+                Knn2& knn = out[q];
+                for (int t = t0; t < t_end; ++t) {
+                    knn.push(t, dist(qp, train.ptr<float>(t), dims));
+                }
+            }
+        }
+    });
+}
+
+// bruteForceKnn2 for binary descriptors: Hamming distances (exact integers, stored as float)
+void hammingKnn2(const cv::Mat& query, const cv::Mat& train, std::vector<Knn2>& out) {
+    const HammingFn dist = hammingKernel();
+    const Hamming4Fn dist4 = hamming4Kernel();
+    const int bytes = query.cols;
+    const int blocks = (query.rows + kQueryBlock - 1) / kQueryBlock;
+    out.assign(query.rows, Knn2());
+
+    parallelFor(LoopStage::MatchQueries, blocks, 1, [&](int b) {
+        const int q_end = std::min(query.rows, (b + 1) * kQueryBlock);
+        for (int t0 = 0; t0 < train.rows; t0 += kHammingTrainBlock) {
+            const int t_end = std::min(train.rows, t0 + kHammingTrainBlock);
+            int q = b * kQueryBlock;
+            for (; q + 4 <= q_end; q += 4) {
+                const uchar* qp[4] = {query.ptr(q), query.ptr(q + 1), query.ptr(q + 2), query.ptr(q + 3)};
+                int d[4];
+                for (int t = t0; t < t_end; ++t) {
+                    dist4(qp, train.ptr(t), bytes, d);
+                    for (int k = 0; k < 4; ++k) {
+                        out[q + k].push(t, static_cast<float>(d[k]));
+                    }
+                }
+            }
+            for (; q < q_end; ++q) {
+                const uchar* qp = query.ptr(q);
+                Knn2& knn = out[q];
+                for (int t = t0; t < t_end; ++t) {
+                    knn.push(t, static_cast<float>(dist(qp, train.ptr(t), bytes)));
+                }
+            }
+        }
+    });
+}
+
+// Per-thread "already compared" marks, so a train row reached through several trees is compared once
+class VisitedSet {
+public:
+    void reset(int size) {
+        if (static_cast<int>(stamps_.size()) < size) {
+            stamps_.resize(size, 0);
+        }
+        if (++epoch_ == 0) {
+            std::fill(stamps_.begin(), stamps_.end(), 0);
+            epoch_ = 1;
+        }
+    }
+    // true the first time idx is seen since reset
+    bool insert(int idx) {
+        if (stamps_[idx] == epoch_) {
+            return false;
+        }
+        stamps_[idx] = epoch_;
+        return true;
+    }
+
+private:
+    std::vector<uint32_t> stamps_;
+    uint32_t epoch_ = 0;
+};
+
+VisitedSet& threadVisited() {
+    thread_local VisitedSet visited;
+    return visited;
+}
+
+// Per-thread child distances of the k-means tree descent, at least size entries
+float* threadChildDistances(int size) {
+    thread_local std::vector<float> distances;
+    if (static_cast<int>(distances.size()) < size) {
+        distances.resize(size);
+    }
+    return distances.data();
+}
+
+// Pending branch of the best-bin-first search, smallest bound first
+struct Branch {
+    float bound;
+    int tree;
+    int node;
+    bool operator>(const Branch& other) const { return bound > other.bound; }
+};
+using BranchQueue = std::priority_queue<Branch, std::vector<Branch>, std::greater<Branch>>;
+
+class BruteForceIndex : public NNIndex {
+public:
+    explicit BruteForceIndex(const cv::Mat& train) : train_(train) {}
+
+    void knn2(const float* q, int& best, float& best_dist, int& second, float& second_dist) const override {
+        const DistanceFn dist = distanceKernel();
+        Knn2 knn;
+        for (int t = 0; t < train_.rows; ++t) {
+            knn.push(t, dist(q, train_.ptr<float>(t), train_.cols));
+        }
+        best = knn.best;
+        best_dist = knn.best_dist;
+        second = knn.second;
+        second_dist = knn.second_dist;
+    }
+
+private:
+    cv::Mat train_;
+};
+
+// *** Randomized kd-forest ***
+
+class KDForestIndex : public NNIndex {
+public:
+    KDForestIndex(const cv::Mat& train, int trees, int checks) : train_(train), checks_(std::max(1, checks)) {
+        const int n_trees = std::max(1, trees);
+        trees_.resize(n_trees);
+        indices_.resize(n_trees);
+        parallelFor(n_trees, 1, [&](int t) {
+            std::mt19937 rng(kIndexSeed + t);
+            indices_[t].resize(train_.rows);
+            std::iota(indices_[t].begin(), indices_[t].end(), 0);
+            build(t, 0, train_.rows, rng);
+        });
+    }
+
+    void knn2(const float* q, int& best, float& best_dist, int& second, float& second_dist) const override {
+        const DistanceFn dist = distanceKernel();
+        VisitedSet& visited = threadVisited();
+        visited.reset(train_.rows);
+        Knn2 knn;
+        BranchQueue queue;
+        int checked = 0;
+
+        for (int t = 0; t < static_cast<int>(trees_.size()); ++t) {
+            descend(q, t, 0, knn, queue, visited, checked, dist);
+        }
+        while (!queue.empty() && checked < checks_) {
+            Branch branch = queue.top();
+            queue.pop();
+            if (branch.bound >= knn.second_dist) {
+                break;  // no remaining cell can hold a closer point
+            }
+            descend(q, branch.tree, branch.node, knn, queue, visited, checked, dist);
+        }
+        best = knn.best;
+        best_dist = knn.best_dist;
+        second = knn.second;
+        second_dist = knn.second_dist;
+    }
+
+private:
+    struct Node {
+        int dim;      // split dimension, -1 for a leaf
+        float split;
+        int left, right;
+        int begin, end;  // leaf points: indices_[tree][begin, end)
+    };
+
+    int build(int tree, int begin, int end, std::mt19937& rng) {
+        std::vector<Node>& nodes = trees_[tree];
+        std::vector<int>& idx = indices_[tree];
+        const int id = static_cast<int>(nodes.size());
+        nodes.push_back({-1, 0.0f, -1, -1, begin, end});
+        if (end - begin <= kLeafSize) {
+            return id;
+        }
+
+        // 1. mean and variance of every dimension over a sample of the points
+        const int dims = train_.cols;
+        const int samples = std::min(end - begin, kVarianceSamples);
+        const int step = (end - begin) / samples;
+        std::vector<double> mean(dims, 0.0), var(dims, 0.0);
+        for (int s = 0; s < samples; ++s) {
+            const float* p = train_.ptr<float>(idx[begin + s * step]);
+            for (int d = 0; d < dims; ++d) {
+                mean[d] += p[d];
+            }
+        }
+        for (int d = 0; d < dims; ++d) {
+            mean[d] /= samples;
+        }
+        for (int s = 0; s < samples; ++s) {
+            const float* p = train_.ptr<float>(idx[begin + s * step]);
+            for (int d = 0; d < dims; ++d) {
+                var[d] += (p[d] - mean[d]) * (p[d] - mean[d]);
+            }
+        }
+
+        // 2. split on a random one of the highest-variance dimensions, at its mean
+        std::vector<int> order(dims);
+        std::iota(order.begin(), order.end(), 0);
+        const int top = std::min(kRandomDims, dims);
+        std::partial_sort(order.begin(), order.begin() + top, order.end(), [&](int a, int b) { return var[a] > var[b]; });
+        const int dim = order[std::uniform_int_distribution<int>(0, top - 1)(rng)];
+        float split = static_cast<float>(mean[dim]);
+        auto below = [&](int i) { return train_.ptr<float>(i)[dim] < split; };
+        int mid = static_cast<int>(std::partition(idx.begin() + begin, idx.begin() + end, below) - idx.begin());
+        if (mid == begin || mid == end) {
+            // degenerate mean split: fall back to the median
+            mid = begin + (end - begin) / 2;
+            std::nth_element(idx.begin() + begin, idx.begin() + mid, idx.begin() + end,
+                             [&](int a, int b) { return train_.ptr<float>(a)[dim] < train_.ptr<float>(b)[dim]; });
+            split = train_.ptr<float>(idx[mid])[dim];
+        }
+
+        const int left = build(tree, begin, mid, rng);
+        const int right = build(tree, mid, end, rng);
+        nodes[id] = {dim, split, left, right, begin, end};
+        return id;
+    }
+
+    // Walk from node to a leaf, queueing the far side of every split, then compare the leaf points
+    void descend(const float* q, int tree, int node, Knn2& knn, BranchQueue& queue, VisitedSet& visited,
+                 int& checked, DistanceFn dist) const {
+        const std::vector<Node>& nodes = trees_[tree];
+        while (nodes[node].dim >= 0) {
+            const Node& n = nodes[node];
+            const float diff = q[n.dim] - n.split;
+            const int near = diff < 0 ? n.left : n.right;
+            const int far = diff < 0 ? n.right : n.left;
+            queue.push({diff * diff, tree, far});
+            node = near;
+        }
+        const Node& leaf = nodes[node];
+        const std::vector<int>& idx = indices_[tree];
+        for (int i = leaf.begin; i < leaf.end; ++i) {
+            if (visited.insert(idx[i])) {
+                knn.push(idx[i], dist(q, train_.ptr<float>(idx[i]), train_.cols));
+                ++checked;
+            }
+        }
+    }
+
+    cv::Mat train_;
+    int checks_;
+    std::vector<std::vector<Node>> trees_;
+    std::vector<std::vector<int>> indices_;
+};
+
+// *** Hierarchical k-means tree ***
+
+class KMeansTreeIndex : public NNIndex {
+public:
+    KMeansTreeIndex(const cv::Mat& train, int branching, int iterations, int checks)
+        : train_(train), branching_(std::max(2, branching)), iterations_(std::max(1, iterations)), checks_(std::max(1, checks)) {
+        indices_.resize(train_.rows);
+        std::iota(indices_.begin(), indices_.end(), 0);
+        std::mt19937 rng(kIndexSeed);
+        nodes_.push_back({-1, 0, 0, train_.rows});
+        centers_.resize(train_.cols);
+        split(0, rng);
+    }
+
+    void knn2(const float* q, int& best, float& best_dist, int& second, float& second_dist) const override {
+        const DistanceFn dist = distanceKernel();
+        float* child_dist = threadChildDistances(branching_);
+        Knn2 knn;
+        BranchQueue queue;
+        int checked = 0;
+
+        descend(q, 0, knn, queue, checked, dist, child_dist);
+        while (!queue.empty() && checked < checks_) {
+            Branch branch = queue.top();
+            queue.pop();
+            descend(q, branch.node, knn, queue, checked, dist, child_dist);
+        }
+        best = knn.best;
+        best_dist = knn.best_dist;
+        second = knn.second;
+        second_dist = knn.second_dist;
+    }
+
+private:
+    struct Node {
+        int first_child;  // children are consecutive nodes, first_child = -1 for a leaf
+        int child_count;
+        int begin, end;   // points: indices_[begin, end)
+    };
+
+    // Cluster the points of a leaf node into child nodes, recursively
+    void split(int id, std::mt19937& rng) {
+        const int begin = nodes_[id].begin;
+        const int n = nodes_[id].end - begin;
+        if (n <= branching_) {
+            return;
+        }
+
+        // 1. k-means on the points of the node, seeded with distinct random points
+        const int dims = train_.cols;
+        const int k = branching_;
+        const DistanceFn dist = distanceKernel();
+        std::vector<float> centers(k * dims);
+        std::vector<int> seeds(n);
+        std::iota(seeds.begin(), seeds.end(), begin);
+        for (int c = 0; c < k; ++c) {
+            std::swap(seeds[c], seeds[std::uniform_int_distribution<int>(c, n - 1)(rng)]);
+            const float* p = train_.ptr<float>(indices_[seeds[c]]);
+            std::copy(p, p + dims, centers.begin() + c * dims);
+        }
+        std::vector<int> label(n, 0);
+        std::vector<int> count(k);
+        for (int it = 0; it < iterations_; ++it) {
+            std::atomic<bool> changed{false};
+            auto assign = [&](int i) {
+                const float* p = train_.ptr<float>(indices_[begin + i]);
+                int best = 0;
+                float best_dist = FLT_MAX;
+                for (int c = 0; c < k; ++c) {
+                    float d = dist(p, &centers[c * dims], dims);
+                    if (d < best_dist) {
+                        best_dist = d;
+                        best = c;
+                    }
+                }
+                if (label[i] != best || it == 0) {
+                    changed.store(true, std::memory_order_relaxed);
+                }
+                label[i] = best;
+            };
+            if (n > kParallelAssignPoints) {
+                parallelFor(n, kAssignGrain, assign);
+            } else {
+                for (int i = 0; i < n; ++i) {
+                    assign(i);
+                }
+            }
+            if (!changed.load(std::memory_order_relaxed)) {
+                break;
+            }
+            std::vector<double> sum(k * dims, 0.0);
+            std::fill(count.begin(), count.end(), 0);
+            for (int i = 0; i < n; ++i) {
+                const float* p = train_.ptr<float>(indices_[begin + i]);
+                double* s = &sum[label[i] * dims];
+                for (int d = 0; d < dims; ++d) {
+                    s[d] += p[d];
+                }
+                ++count[label[i]];
+            }
+            for (int c = 0; c < k; ++c) {
+                if (count[c] == 0) {
+                    continue;  // empty cluster keeps its center
+                }
+                for (int d = 0; d < dims; ++d) {
+                    centers[c * dims + d] = static_cast<float>(sum[c * dims + d] / count[c]);
+                }
+            }
+        }
+        std::fill(count.begin(), count.end(), 0);
+        for (int i = 0; i < n; ++i) {
+            ++count[label[i]];
+        }
+        if (*std::max_element(count.begin(), count.end()) == n) {
+            return;  // identical points, keep them in a leaf
+        }
+
+        // 2. reorder the points cluster by cluster, then build the non-empty clusters as consecutive children
+        std::vector<int> offset(k + 1, 0);
+        for (int c = 0; c < k; ++c) {
+            offset[c + 1] = offset[c] + count[c];
+        }
+        std::vector<int> reordered(n);
+        std::vector<int> fill(offset.begin(), offset.end() - 1);
+        for (int i = 0; i < n; ++i) {
+            reordered[fill[label[i]]++] = indices_[begin + i];
+        }
+        std::copy(reordered.begin(), reordered.end(), indices_.begin() + begin);
+
+        std::vector<int> clusters;
+        for (int c = 0; c < k; ++c) {
+            if (count[c] > 0) {
+                clusters.push_back(c);
+            }
+        }
+        const int first_child = static_cast<int>(nodes_.size());
+        for (int c : clusters) {
+            nodes_.push_back({-1, 0, begin + offset[c], begin + offset[c + 1]});
+        }
+        centers_.resize(nodes_.size() * dims);
+        for (size_t j = 0; j < clusters.size(); ++j) {
+            std::copy(centers.begin() + clusters[j] * dims, centers.begin() + (clusters[j] + 1) * dims,
+                      centers_.begin() + (first_child + j) * dims);
+        }
+        nodes_[id].first_child = first_child;
+        nodes_[id].child_count = static_cast<int>(clusters.size());
+        for (size_t j = 0; j < clusters.size(); ++j) {
+            split(first_child + static_cast<int>(j), rng);
+        }
+    }
+
+    // d: scratch of branching_ child distances
+    void descend(const float* q, int node, Knn2& knn, BranchQueue& queue, int& checked, DistanceFn dist, float* d) const {
+        const int dims = train_.cols;
+        while (nodes_[node].first_child >= 0) {
+            const Node& n = nodes_[node];
+            int nearest = -1;
+            float nearest_dist = FLT_MAX;
+            for (int c = 0; c < n.child_count; ++c) {
+                d[c] = dist(q, &centers_[(n.first_child + c) * dims], dims);
+                if (d[c] < nearest_dist) {
+                    nearest_dist = d[c];
+                    nearest = c;
+                }
+            }
+            for (int c = 0; c < n.child_count; ++c) {
+                if (c != nearest) {
+                    queue.push({d[c], 0, n.first_child + c});
+                }
+            }
+            node = n.first_child + nearest;
+        }
+        const Node& leaf = nodes_[node];
+        for (int i = leaf.begin; i < leaf.end; ++i) {
+            knn.push(indices_[i], dist(q, train_.ptr<float>(indices_[i]), dims));
+            ++checked;
+        }
+    }
+
+    cv::Mat train_;
+    int branching_;
+    int iterations_;
+    int checks_;
+    std::vector<Node> nodes_;
+    std::vector<float> centers_;  // one center per node, row-major
+    std::vector<int> indices_;
+};
+
+// 2-NN of every query row in train, with the search structure of options.
+// Binary descriptors always use the exact Hamming search, the approximate indexes are built on float vectors.
+void knn2All(const cv::Mat& query, const cv::Mat& train, const MatcherOptions& options, std::vector<Knn2>& out) {
+    if (query.type() == CV_8U) {
+        hammingKnn2(query, train, out);
+        return;
+    }
+    if (options.type == MatcherType::BruteForce) {
+        bruteForceKnn2(query, train, out);
+        return;
+    }
+    std::unique_ptr<NNIndex> index = buildNNIndex(train, options);
+    out.assign(query.rows, Knn2());
+    parallelFor(LoopStage::MatchQueries, query.rows, kQueryBlock, [&](int q) {
+        Knn2& knn = out[q];
+        index->knn2(query.ptr<float>(q), knn.best, knn.best_dist, knn.second, knn.second_dist);
+    });
+}
+
+} // namespace
+
+std::unique_ptr<NNIndex> buildNNIndex(const cv::Mat& train, const MatcherOptions& options) {
+    if (train.empty() || train.type() != CV_32F) {
+        throw std::invalid_argument("Error: train descriptors must be a non-empty CV_32F matrix.");
+    }
+    switch (options.type) {
+        case MatcherType::KDForest:
+            return std::make_unique<KDForestIndex>(train, options.trees, options.checks);
+        case MatcherType::KMeansTree:
+            return std::make_unique<KMeansTreeIndex>(train, options.branching, options.kmeans_iterations, options.checks);
+        default:
+            return std::make_unique<BruteForceIndex>(train);
+    }
+}
+
+std::vector<cv::DMatch> matchDescriptors(const cv::Mat& query, const cv::Mat& train, const MatcherOptions& options) {
+    if (query.empty() || train.empty()) {
+        return {};
+    }
+    const bool binary = query.type() == CV_8U;
+    if ((query.type() != CV_32F && !binary) || train.type() != query.type() || query.cols != train.cols) {
+        throw std::invalid_argument("Error: descriptors must be CV_32F or CV_8U matrices of the same type and number of columns.");
+    }
+
+    // 1. nearest two train descriptors of every query
+    std::vector<Knn2> forward;
+    {
+        PROFILE_SCOPE("match.forward");
+        knn2All(query, train, options, forward);
+    }
+
+    // 2. ratio test on the distances (the L2 knn distances are squared, the Hamming ones are not)
+    const bool use_ratio = options.ratio < 1.0f;
+    const float ratio2 = binary ? options.ratio : options.ratio * options.ratio;
+    std::vector<int> candidates;
+    for (int q = 0; q < query.rows; ++q) {
+        const Knn2& knn = forward[q];
+        if (knn.best < 0) {
+            continue;
+        }
+        if (use_ratio && knn.second >= 0 && !(knn.best_dist < ratio2 * knn.second_dist)) {
+            continue;
+        }
+        candidates.push_back(q);
+    }
+
+    // 3. cross-check: only the train rows that are matched need a reverse search
+    std::vector<int> reverse_best(train.rows, -1);
+    if (options.cross_check && !candidates.empty()) {
+        PROFILE_SCOPE("match.crossCheck");
+        std::vector<int> rows;
+        std::vector<char> used(train.rows, 0);
+        for (int q : candidates) {
+            if (!used[forward[q].best]) {
+                used[forward[q].best] = 1;
+                rows.push_back(forward[q].best);
+            }
+        }
+        cv::Mat subset(static_cast<int>(rows.size()), train.cols, train.type());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            std::memcpy(subset.ptr(static_cast<int>(i)), train.ptr(rows[i]), train.cols * train.elemSize());
+        }
+        std::vector<Knn2> backward;
+        knn2All(subset, query, options, backward);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            reverse_best[rows[i]] = backward[i].best;
+        }
+    }
+
+    std::vector<cv::DMatch> matches;
+    matches.reserve(candidates.size());
+    for (int q : candidates) {
+        const Knn2& knn = forward[q];
+        if (options.cross_check && reverse_best[knn.best] != q) {
+            continue;
+        }
+        matches.emplace_back(q, knn.best, binary ? knn.best_dist : std::sqrt(knn.best_dist));
+    }
+    return matches;
+}
+
+const char* matcherTypeName(MatcherType type) {
+    switch (type) {
+        case MatcherType::KDForest: return "kdforest";
+        case MatcherType::KMeansTree: return "kmeans";
+        default: return "bruteforce";
+    }
+}
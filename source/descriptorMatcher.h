@@ -0,0 +1,47 @@
+#ifndef DESCRIPTOR_MATCHER_H
+#define DESCRIPTOR_MATCHER_H
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <vector>
+
+// Nearest-neighbour search structure used to match float descriptors
+enum class MatcherType {
+    BruteForce,  // exact: SIMD L2 distances, OpenMP over query blocks, train rows tiled for cache reuse
+    KDForest,    // approximate: randomized kd-trees searched together with one priority queue
+    KMeansTree   // approximate: hierarchical k-means tree, best-bin-first search
+};
+
+struct MatcherOptions {
+    MatcherType type = MatcherType::BruteForce;
+    // Lowe's ratio test: keep a match only if best < ratio * second best (distances). >= 1 disables it.
+    float ratio = 1.0f;
+    // keep a match only if the query is also the nearest neighbour of its train descriptor
+    bool cross_check = true;
+    // speed/recall knob of the approximate indexes: number of descriptors compared per query
+    int checks = 128;
+    int trees = 4;        // kd-forest
+    int branching = 16;   // k-means tree
+    int kmeans_iterations = 7;
+};
+
+// Index over the train descriptors (CV_32F, one row per descriptor, rows must stay alive).
+class NNIndex {
+public:
+    virtual ~NNIndex() = default;
+    // Two nearest train rows of q (squared L2 distances), second = -1 if train has a single row
+    virtual void knn2(const float* q, int& best, float& best_dist, int& second, float& second_dist) const = 0;
+};
+
+std::unique_ptr<NNIndex> buildNNIndex(const cv::Mat& train, const MatcherOptions& options);
+
+// Match every query row to train, applying the ratio test and cross-check of options.
+// CV_32F descriptors: DMatch::distance is the L2 distance, like cv::BFMatcher(NORM_L2).
+// CV_8U (binary) descriptors: exact Hamming search whatever options.type, DMatch::distance is the number of
+// differing bits, like cv::BFMatcher(NORM_HAMMING).
+std::vector<cv::DMatch> matchDescriptors(const cv::Mat& query, const cv::Mat& train,
+                                         const MatcherOptions& options = MatcherOptions());
+
+const char* matcherTypeName(MatcherType type);
+
+#endif // DESCRIPTOR_MATCHER_H
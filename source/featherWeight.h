@@ -0,0 +1,26 @@
+#ifndef FEATHER_WEIGHT_H
+#define FEATHER_WEIGHT_H
+
+#include <algorithm>
+
+// Weights of the distance ("blend") blending, shared by blendImagePair, warpBlendInto and blendWarpedInto.
+// A pixel is weighted by its distance to the edge of its mask, capped at the feathering radius:
+// min(distance, kFeatherRadius) / kFeatherRadius. The weight does not depend on how far a distance field
+// extends, so every pipeline blends the same pair with the same weights.
+
+// Distance (in cv::distanceTransform units) at which a weight reaches 1
+constexpr float kFeatherRadius = 128.0f;
+constexpr float kInvRadius = 1.0f / kFeatherRadius;
+
+// Horizontal/vertical step of the 3x3 DIST_L2 mask of cv::distanceTransform
+constexpr float kChamferStep = 0.955f;
+
+// Border around a region for exact capped distances inside it: every uncovered pixel closer than
+// kFeatherRadius to the region lies in the padded window
+constexpr int kFeatherMargin = static_cast<int>(kFeatherRadius / kChamferStep) + 2;
+
+inline float featherWeight(float distance) {
+    return std::min(distance, kFeatherRadius) * kInvRadius;
+}
+
+#endif // FEATHER_WEIGHT_H
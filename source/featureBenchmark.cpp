@@ -0,0 +1,228 @@
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <omp.h>
+#include "featureCache.h"
+#include "helper.h"
+#include "homography.h"
+#include "ransac.h"
+#include "refineHomography.h"
+#include "stitchImg.h"
+#include "streamStitch.h"
+#include "taskGraph.h"
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+// Registration benchmark of the feature backends (SIFT, ORB, AKAZE) on the <name>_l.PNG / <name>_r.PNG pairs of a directory.
+// Every pair is registered the way the stitcher does it (detect, match, RANSAC, refinement) without the feature cache.
+// Prints one CSV row per backend and pair, then one "mean" row per backend:
+//   features,pair,keypoints_l,keypoints_r,matches,inliers,detect_ms,match_ms,ransac_ms,total_ms,reproj_rms,corner_err,photo_rms
+// reproj_rms: RMS reprojection error of the RANSAC inliers (pixels)
+// corner_err: mean distance of the projected image corners to those of the SIFT homography (pixels)
+// photo_rms: RMS gray-level difference of the overlap after alignment, the alignment error that needs no reference
+
+namespace {
+
+struct PairResult {
+    size_t keypoints_l = 0;
+    size_t keypoints_r = 0;
+    size_t matches = 0;
+    size_t inliers = 0;
+    double detect_ms = 0.0;
+    double match_ms = 0.0;
+    double ransac_ms = 0.0;
+    double reproj_rms = 0.0;
+    double corner_err = 0.0;
+    double photo_rms = 0.0;
+    Eigen::Matrix3d H = Eigen::Matrix3d::Identity();
+    bool registered = false;
+};
+
+template <typename F>
+double timeMs(F&& f) {
+    auto start_time = high_resolution_clock::now();
+    f();
+    auto end_time = high_resolution_clock::now();
+    return std::chrono::duration_cast<duration<double, std::milli>>(end_time - start_time).count();
+}
+
+// Mean distance between the corners of an image of the given size projected by H and by H_ref
+double cornerError(const Eigen::Matrix3d& H, const Eigen::Matrix3d& H_ref, const cv::Size& size) {
+    std::vector<Eigen::Vector2d> corners = {
+        {0, 0}, {size.width - 1, 0}, {size.width - 1, size.height - 1}, {0, size.height - 1}};
+    const std::vector<Eigen::Vector2d> a = applyHomography(H, corners);
+    const std::vector<Eigen::Vector2d> b = applyHomography(H_ref, corners);
+    double sum = 0.0;
+    for (size_t i = 0; i < corners.size(); ++i) {
+        sum += (a[i] - b[i]).norm();
+    }
+    return sum / corners.size();
+}
+
+// RMS gray-level difference between dest and src mapped by H (src to dest), over the dest pixels src covers
+double photometricError(const cv::Mat& src, const cv::Mat& dest, const Eigen::Matrix3d& H) {
+    cv::Mat gray_s, gray_d;
+    cv::cvtColor(src, gray_s, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(dest, gray_d, cv::COLOR_BGR2GRAY);
+    const Eigen::Matrix3d H_inv = H.inverse();
+    double sum = 0.0;
+    size_t count = 0;
+    #pragma omp parallel for reduction(+:sum, count)
+    for (int y = 0; y < gray_d.rows; ++y) {
+        for (int x = 0; x < gray_d.cols; ++x) {
+            const Eigen::Vector3d p = H_inv * Eigen::Vector3d(x, y, 1.0);
+            const int sx = static_cast<int>(std::lround(p.x() / p.z()));
+            const int sy = static_cast<int>(std::lround(p.y() / p.z()));
+            if (sx < 0 || sy < 0 || sx >= gray_s.cols || sy >= gray_s.rows) {
+                continue;
+            }
+            const double d = static_cast<double>(gray_s.at<uchar>(sy, sx)) - gray_d.at<uchar>(y, x);
+            sum += d * d;
+            ++count;
+        }
+    }
+    return count > 0 ? std::sqrt(sum / count) : 0.0;
+}
+
+// Register img_r onto img_l with the backend of options.features, like registerPair of the global composition
+PairResult registerPair(const cv::Mat& img_l, const cv::Mat& img_r, const StitchOptions& options) {
+    PairResult result;
+    ImageFeatures features[2];
+    result.detect_ms = timeMs([&] {
+        runTasks(2, [&](int i) {
+            features[i] = detectFeatures(i == 0 ? img_r : img_l, options.features);
+        });
+    });
+    result.keypoints_r = features[0].keypoints.size();
+    result.keypoints_l = features[1].keypoints.size();
+
+    std::vector<Eigen::Vector2d> xs, xd;
+    result.match_ms = timeMs([&] { std::tie(xs, xd) = matchFeatures(features[0], features[1], options.matcher); });
+    result.matches = xs.size();
+    if (xs.size() < 4) {
+        return result;
+    }
+
+    std::vector<bool> inliers;
+    result.ransac_ms = timeMs([&] {
+        std::tie(inliers, result.H) = runRANSAC(xs, xd, options.ransac_n, options.ransac_eps, options.ransac_confidence, options.ransac_seed);
+        if (options.refine) {
+            result.H = refineHomography(xs, xd, result.H, options.ransac_eps, inliers);
+        }
+    });
+    result.registered = true;
+
+    // inliers of the final homography
+    const std::vector<Eigen::Vector2d> projected = applyHomography(result.H, xs);
+    double sum = 0.0;
+    for (size_t i = 0; i < xs.size(); ++i) {
+        const double err = (projected[i] - xd[i]).norm();
+        if (err < options.ransac_eps) {
+            sum += err * err;
+            ++result.inliers;
+        }
+    }
+    result.reproj_rms = result.inliers > 0 ? std::sqrt(sum / result.inliers) : 0.0;
+    result.photo_rms = photometricError(img_r, img_l, result.H);
+    return result;
+}
+
+void printRow(const std::string& features, const std::string& pair, const PairResult& r) {
+    std::cout << features << "," << pair << "," << r.keypoints_l << "," << r.keypoints_r << "," << r.matches << "," << r.inliers
+              << "," << r.detect_ms << "," << r.match_ms << "," << r.ransac_ms << "," << (r.detect_ms + r.match_ms + r.ransac_ms)
+              << "," << r.reproj_rms << "," << r.corner_err << "," << r.photo_rms << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        std::cout << "please run commond: ./feature_benchmark thread_num [input_dir] [max_pairs]" << std::endl;
+        return -1;
+    }
+    omp_set_num_threads(atoi(argv[1]));
+    const std::string input_dir = argc >= 3 ? argv[2] : "../photos/data/input";
+    const int max_pairs = argc == 4 ? atoi(argv[3]) : 0;
+
+    std::vector<RigFrame> pairs = listRigFrames(input_dir, {"_l.PNG", "_r.PNG"});
+    if (max_pairs > 0 && pairs.size() > static_cast<size_t>(max_pairs)) {
+        pairs.resize(max_pairs);
+    }
+    if (pairs.empty()) {
+        std::cerr << "No <name>_l.PNG / <name>_r.PNG pairs in " << input_dir << "." << std::endl;
+        return -1;
+    }
+    std::vector<std::pair<cv::Mat, cv::Mat>> imgs;
+    for (const RigFrame& pair : pairs) {
+        imgs.emplace_back(cv::imread(pair.paths[0]), cv::imread(pair.paths[1]));
+        if (imgs.back().first.empty() || imgs.back().second.empty()) {
+            std::cerr << "Could not load " << pair.name << "." << std::endl;
+            return -1;
+        }
+    }
+    std::cerr << "pairs: " << pairs.size() << std::endl;
+
+    std::cout << "features,pair,keypoints_l,keypoints_r,matches,inliers,detect_ms,match_ms,ransac_ms,total_ms,reproj_rms,corner_err,photo_rms" << std::endl;
+
+    // SIFT first: its homographies are the reference of the corner error
+    std::vector<Eigen::Matrix3d> reference(pairs.size(), Eigen::Matrix3d::Identity());
+    std::vector<bool> has_reference(pairs.size(), false);
+    for (FeatureType type : {FeatureType::SIFT, FeatureType::ORB, FeatureType::AKAZE}) {
+        StitchOptions options;
+        options.features.type = type;
+        options.ransac_seed = 759;
+
+        // untimed warm-up: the thread-local detectors are created once per thread
+        registerPair(imgs[0].first, imgs[0].second, options);
+
+        PairResult mean;
+        size_t registered = 0;
+        for (size_t p = 0; p < pairs.size(); ++p) {
+            PairResult r = registerPair(imgs[p].first, imgs[p].second, options);
+            if (r.registered && type == FeatureType::SIFT) {
+                reference[p] = r.H;
+                has_reference[p] = true;
+            }
+            if (r.registered && has_reference[p]) {
+                r.corner_err = cornerError(r.H, reference[p], imgs[p].second.size());
+            }
+            printRow(featureTypeName(type), pairs[p].name, r);
+
+            mean.keypoints_l += r.keypoints_l;
+            mean.keypoints_r += r.keypoints_r;
+            mean.matches += r.matches;
+            mean.inliers += r.inliers;
+            mean.detect_ms += r.detect_ms;
+            mean.match_ms += r.match_ms;
+            mean.ransac_ms += r.ransac_ms;
+            if (r.registered) {
+                mean.reproj_rms += r.reproj_rms;
+                mean.corner_err += r.corner_err;
+                mean.photo_rms += r.photo_rms;
+                ++registered;
+            }
+        }
+        const size_t n = pairs.size();
+        mean.keypoints_l /= n;
+        mean.keypoints_r /= n;
+        mean.matches /= n;
+        mean.inliers /= n;
+        mean.detect_ms /= n;
+        mean.match_ms /= n;
+        mean.ransac_ms /= n;
+        if (registered > 0) {
+            mean.reproj_rms /= registered;
+            mean.corner_err /= registered;
+            mean.photo_rms /= registered;
+        }
+        printRow(featureTypeName(type), "mean", mean);
+        if (registered < n) {
+            std::cerr << featureTypeName(type) << ": " << n - registered << " pairs not registered" << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,347 @@
+#include "featureCache.h"
+#include "profiler.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <sstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Entries hold SIFT, ORB or AKAZE features (the backend is part of the key), the magic names none of them
+constexpr char kMagic[8] = {'F', 'E', 'A', 'T', 'F', 'C', '0', '1'};
+constexpr uint32_t kVersion = 3;
+constexpr size_t kDescriptorAlign = 64;
+
+struct FeatureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;              // number of keypoints
+    uint32_t descriptor_cols;    // elements per descriptor
+    uint32_t descriptor_type;    // CV_32F or CV_8U
+    uint64_t key;                // cache key, guards against renamed files
+    uint64_t descriptor_offset;  // byte offset of the descriptors
+};
+
+struct FeatureFileKeyPoint {
+    float x, y, size, angle, response;
+    int32_t octave, class_id;
+};
+
+// SIFT detector of the calling thread, created once per thread and parameter set.
+// Creating a detector allocates its scale-space buffers, which a long-lived caller (Stitcher, batch worker,
+// OpenMP team thread) should not pay on every image.
+cv::Ptr<cv::SIFT> threadSIFT(const SIFTParams& params) {
+    thread_local SIFTParams cached_params;
+    thread_local cv::Ptr<cv::SIFT> sift;
+    if (!sift || cached_params.nfeatures != params.nfeatures || cached_params.n_octave_layers != params.n_octave_layers ||
+        cached_params.contrast_threshold != params.contrast_threshold || cached_params.edge_threshold != params.edge_threshold ||
+        cached_params.sigma != params.sigma) {
+        sift = cv::SIFT::create(params.nfeatures, params.n_octave_layers, params.contrast_threshold,
+                                params.edge_threshold, params.sigma);
+        cached_params = params;
+        Profiler::instance().addCounter("sift_detectors_created", 1);
+    }
+    return sift;
+}
+
+// ORB and AKAZE detectors of the calling thread, same reuse as threadSIFT
+cv::Ptr<cv::ORB> threadORB(int nfeatures) {
+    thread_local int cached_nfeatures = 0;
+    thread_local cv::Ptr<cv::ORB> orb;
+    if (!orb || cached_nfeatures != nfeatures) {
+        orb = cv::ORB::create(nfeatures);
+        cached_nfeatures = nfeatures;
+        Profiler::instance().addCounter("orb_detectors_created", 1);
+    }
+    return orb;
+}
+
+cv::Ptr<cv::AKAZE> threadAKAZE(float threshold) {
+    thread_local float cached_threshold = 0.0f;
+    thread_local cv::Ptr<cv::AKAZE> akaze;
+    if (!akaze || cached_threshold != threshold) {
+        akaze = cv::AKAZE::create(cv::AKAZE::DESCRIPTOR_MLDB, 0, 3, threshold);
+        cached_threshold = threshold;
+        Profiler::instance().addCounter("akaze_detectors_created", 1);
+    }
+    return akaze;
+}
+
+// 64-bit mixing step (splitmix64 finalizer)
+inline uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+inline uint64_t mixDouble(uint64_t h, double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return mix(h, bits);
+}
+
+// Hash of the pixel bytes, 8 bytes at a time
+uint64_t hashRows(const cv::Mat& img) {
+    const size_t row_bytes = img.cols * img.elemSize();
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int r = 0; r < img.rows; ++r) {
+        const uchar* p = img.ptr<uchar>(r);
+        size_t i = 0;
+        for (; i + 8 <= row_bytes; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, p + i, sizeof(w));
+            h = (h ^ w) * 0x100000001b3ULL;
+            h ^= h >> 32;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, p + i, row_bytes - i);
+        h = mix(h, tail);
+    }
+    return h;
+}
+
+// Read-only mapping of a whole file, unmapped when the last reference goes away
+std::shared_ptr<void> mapFile(const std::string& path, size_t& size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FeatureFileHeader))) {
+        ::close(fd);
+        return nullptr;
+    }
+    size = static_cast<size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::shared_ptr<void>(data, [size](void* p) { ::munmap(p, size); });
+}
+
+} // namespace
+
+FeatureCache& FeatureCache::instance() {
+    static FeatureCache cache;
+    return cache;
+}
+
+void FeatureCache::setDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_ = directory;
+    if (!directory_.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(directory_, ec);
+    }
+}
+
+std::string FeatureCache::directory() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return directory_;
+}
+
+bool FeatureCache::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !directory_.empty();
+}
+
+uint64_t FeatureCache::key(const cv::Mat& img, const FeatureParams& params) {
+    uint64_t h = mix(0, kVersion);
+    h = mix(h, static_cast<uint64_t>(img.rows));
+    h = mix(h, static_cast<uint64_t>(img.cols));
+    h = mix(h, static_cast<uint64_t>(img.type()));
+    h = mix(h, static_cast<uint64_t>(params.type));
+    switch (params.type) {
+        case FeatureType::ORB:
+            h = mix(h, static_cast<uint64_t>(params.orb_features));
+            break;
+        case FeatureType::AKAZE:
+            h = mixDouble(h, params.akaze_threshold);
+            break;
+        default:
+            h = mix(h, static_cast<uint64_t>(params.sift.nfeatures));
+            h = mix(h, static_cast<uint64_t>(params.sift.n_octave_layers));
+            h = mixDouble(h, params.sift.contrast_threshold);
+            h = mixDouble(h, params.sift.edge_threshold);
+            h = mixDouble(h, params.sift.sigma);
+            break;
+    }
+    return mix(h, hashRows(img));
+}
+
+std::string FeatureCache::entryPath(uint64_t key) const {
+    std::ostringstream name;
+    name << directory() << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".feat";
+    return name.str();
+}
+
+bool FeatureCache::load(uint64_t key, ImageFeatures& features) const {
+    if (!enabled()) {
+        return false;
+    }
+    size_t size = 0;
+    std::shared_ptr<void> storage = mapFile(entryPath(key), size);
+    if (!storage) {
+        return false;
+    }
+    const uchar* base = static_cast<const uchar*>(storage.get());
+    FeatureFileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    const bool binary = header.descriptor_type == CV_8U;
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.key != key ||
+        (!binary && header.descriptor_type != CV_32F)) {
+        return false;
+    }
+    // the block sizes come from the file: compare them against what is left of it, so no sum can wrap
+    const size_t elem_size = binary ? 1 : sizeof(float);
+    if (header.count > (size - sizeof(header)) / sizeof(FeatureFileKeyPoint) ||
+        header.descriptor_offset < sizeof(header) + size_t(header.count) * sizeof(FeatureFileKeyPoint) ||
+        header.descriptor_offset > size) {
+        return false;
+    }
+    const size_t descriptor_space = size - header.descriptor_offset;
+    if (header.count > 0 && header.descriptor_cols > descriptor_space / elem_size / header.count) {
+        return false;
+    }
+
+    // keypoints are small and copied, the descriptors stay in the mapping
+    const FeatureFileKeyPoint* kps = reinterpret_cast<const FeatureFileKeyPoint*>(base + sizeof(header));
+    features.keypoints.resize(header.count);
+    for (uint32_t i = 0; i < header.count; ++i) {
+        const FeatureFileKeyPoint& kp = kps[i];
+        features.keypoints[i] = cv::KeyPoint(kp.x, kp.y, kp.size, kp.angle, kp.response, kp.octave, kp.class_id);
+    }
+    if (header.count > 0) {
+        features.descriptors = cv::Mat(header.count, header.descriptor_cols, binary ? CV_8U : CV_32F,
+                                       const_cast<uchar*>(base + header.descriptor_offset));
+    } else {
+        features.descriptors = cv::Mat();
+    }
+    features.storage = storage;
+    return true;
+}
+
+bool FeatureCache::store(uint64_t key, const ImageFeatures& features) const {
+    if (!enabled()) {
+        return false;
+    }
+    if (!features.keypoints.empty() &&
+        ((features.descriptors.type() != CV_32F && features.descriptors.type() != CV_8U) ||
+         features.descriptors.rows != static_cast<int>(features.keypoints.size()))) {
+        throw std::invalid_argument("Error: descriptors must be CV_32F or CV_8U with one row per keypoint.");
+    }
+
+    FeatureFileHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.count = static_cast<uint32_t>(features.keypoints.size());
+    header.descriptor_cols = header.count > 0 ? static_cast<uint32_t>(features.descriptors.cols) : 0;
+    header.descriptor_type = header.count > 0 ? static_cast<uint32_t>(features.descriptors.type()) : CV_32F;
+    header.key = key;
+    const size_t kp_end = sizeof(header) + size_t(header.count) * sizeof(FeatureFileKeyPoint);
+    header.descriptor_offset = (kp_end + kDescriptorAlign - 1) / kDescriptorAlign * kDescriptorAlign;
+
+    std::vector<FeatureFileKeyPoint> kps(header.count);
+    for (uint32_t i = 0; i < header.count; ++i) {
+        const cv::KeyPoint& kp = features.keypoints[i];
+        kps[i] = {kp.pt.x, kp.pt.y, kp.size, kp.angle, kp.response, kp.octave, kp.class_id};
+    }
+
+    // write to a unique temporary file, then publish it atomically
+    const std::string path = entryPath(key);
+    std::ostringstream tmp_path;
+    static std::atomic<uint64_t> tmp_counter{0};
+    tmp_path << path << ".tmp." << ::getpid() << "." << tmp_counter++;
+    {
+        std::ofstream out(tmp_path.str(), std::ios::binary);
+        if (!out) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(kps.data()), kps.size() * sizeof(FeatureFileKeyPoint));
+        const std::vector<char> padding(header.descriptor_offset - kp_end, 0);
+        out.write(padding.data(), padding.size());
+        for (uint32_t i = 0; i < header.count; ++i) {
+            out.write(features.descriptors.ptr<char>(i), header.descriptor_cols * features.descriptors.elemSize());
+        }
+        if (!out) {
+            std::remove(tmp_path.str().c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.str().c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+ImageFeatures detectFeatures(const cv::Mat& img, const FeatureParams& params) {
+    if (img.empty()) {
+        throw std::invalid_argument("Error: img is empty.");
+    }
+    FeatureCache& cache = FeatureCache::instance();
+    const bool use_cache = cache.enabled();
+    uint64_t key = 0;
+    ImageFeatures features;
+    if (use_cache) {
+        PROFILE_SCOPE("featureCache.load");
+        key = FeatureCache::key(img, params);
+        if (cache.load(key, features)) {
+            Profiler::instance().addCounter("feature_cache_hits", 1);
+            return features;
+        }
+        Profiler::instance().addCounter("feature_cache_misses", 1);
+    }
+
+    cv::Mat gray;
+    if (img.channels() == 3) {
+        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = img;
+    }
+    switch (params.type) {
+        case FeatureType::ORB:
+            threadORB(params.orb_features)->detectAndCompute(gray, cv::noArray(), features.keypoints, features.descriptors);
+            break;
+        case FeatureType::AKAZE:
+            threadAKAZE(params.akaze_threshold)->detectAndCompute(gray, cv::noArray(), features.keypoints, features.descriptors);
+            break;
+        default:
+            threadSIFT(params.sift)->detectAndCompute(gray, cv::noArray(), features.keypoints, features.descriptors);
+            break;
+    }
+
+    if (use_cache) {
+        PROFILE_SCOPE("featureCache.store");
+        cache.store(key, features);
+    }
+    return features;
+}
+
+ImageFeatures detectSIFTFeatures(const cv::Mat& img, const SIFTParams& params) {
+    FeatureParams feature_params;
+    feature_params.sift = params;
+    return detectFeatures(img, feature_params);
+}
+
+const char* featureTypeName(FeatureType type) {
+    switch (type) {
+        case FeatureType::ORB: return "orb";
+        case FeatureType::AKAZE: return "akaze";
+        default: return "sift";
+    }
+}
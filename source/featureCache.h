@@ -0,0 +1,89 @@
+#ifndef FEATURE_CACHE_H
+#define FEATURE_CACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// SIFT detector parameters (defaults of cv::SIFT::create), part of the cache key
+struct SIFTParams {
+    int nfeatures = 0;
+    int n_octave_layers = 3;
+    double contrast_threshold = 0.04;
+    double edge_threshold = 10.0;
+    double sigma = 1.6;
+};
+
+// Detector/descriptor backend of the registration features.
+// SIFT: 128 floats per keypoint, L2 matching. ORB and AKAZE: binary descriptors (32 and 61 bytes),
+// Hamming matching with popcounts, several times cheaper to detect and to match.
+enum class FeatureType {
+    SIFT,
+    ORB,
+    AKAZE
+};
+
+// Parameters of the selected backend, part of the cache key
+struct FeatureParams {
+    FeatureType type = FeatureType::SIFT;
+    SIFTParams sift;
+    int orb_features = 5000;          // ORB: strongest keypoints kept per image
+    float akaze_threshold = 0.001f;   // AKAZE: detector response threshold
+};
+
+// Keypoints and descriptors of one image.
+// When loaded from the cache, descriptors is a read-only view into the memory-mapped file and
+// storage keeps the mapping alive; copy the Mat before modifying it.
+struct ImageFeatures {
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;  // CV_32F (SIFT) or CV_8U (binary), one row per keypoint
+    std::shared_ptr<void> storage;
+};
+
+// Persistent on-disk store of image features, keyed by a content hash of the image and the detector parameters.
+// One file per entry: <directory>/<key>.feat, written to a temporary file and renamed so concurrent
+// runs never read a partial entry. The cache is disabled (every lookup misses) until a directory is set.
+//
+// File layout (little-endian, native structs):
+//   FeatureFileHeader
+//   keypoints: count x FeatureFileKeyPoint
+//   padding up to descriptor_offset (64-byte aligned)
+//   descriptors: count x cols elements of descriptor_type (CV_32F or CV_8U), row-major
+class FeatureCache {
+public:
+    static FeatureCache& instance();
+
+    // Empty directory disables the cache. The directory is created if needed.
+    void setDirectory(const std::string& directory);
+    std::string directory() const;
+    bool enabled() const;
+
+    // Cache key of a BGR or gray image with the given parameters
+    static uint64_t key(const cv::Mat& img, const FeatureParams& params);
+
+    // Load the features of key, returns false on a miss (or an unreadable / stale entry)
+    bool load(uint64_t key, ImageFeatures& features) const;
+    // Store the features of key, returns false if the entry could not be written
+    bool store(uint64_t key, const ImageFeatures& features) const;
+
+private:
+    FeatureCache() = default;
+
+    std::string entryPath(uint64_t key) const;
+
+    mutable std::mutex mutex_;
+    std::string directory_;
+};
+
+// Features of img (BGR or gray) with the backend of params, served from the feature cache when possible
+ImageFeatures detectFeatures(const cv::Mat& img, const FeatureParams& params = FeatureParams());
+
+// SIFT features of img (BGR or gray), served from the feature cache when possible
+ImageFeatures detectSIFTFeatures(const cv::Mat& img, const SIFTParams& params = SIFTParams());
+
+const char* featureTypeName(FeatureType type);
+
+#endif // FEATURE_CACHE_H
@@ -1,50 +1,53 @@
 #include "helper.h"
 #include "common.h"
+#include "profiler.h"
+#include "featureCache.h"
+#include "taskGraph.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d.hpp>
 #include <omp.h>
 
 std::pair<std::vector<Eigen::Vector2d>, std::vector<Eigen::Vector2d>> genSIFTMatches(
     const cv::Mat& img_s,
-    const cv::Mat& img_d) {
+    const cv::Mat& img_d,
+    const MatcherOptions& matcher_options,
+    const FeatureParams& feature_params) {
 
-    // Convert images to grayscale
-    cv::Mat gray_s, gray_d;
-    #pragma omp parallel sections
+    // Detect and compute features (SIFT, ORB or AKAZE) (grayscale conversion included), served from the feature cache when enabled.
+    // Two tasks: inside a pipeline stage they join the running team instead of opening a nested one.
+    ImageFeatures features[2];
     {
-        #pragma omp section
-        cv::cvtColor(img_s, gray_s, cv::COLOR_BGR2GRAY);
-
-        #pragma omp section
-        cv::cvtColor(img_d, gray_d, cv::COLOR_BGR2GRAY);
+        PROFILE_SCOPE("sift.detectAndCompute");
+        runTasks(2, [&](int i) {
+            features[i] = detectFeatures(i == 0 ? img_s : img_d, feature_params);
+        });
     }
-
-    // Detect and compute SIFT features
-    auto sift = cv::SIFT::create();
-    std::vector<cv::KeyPoint> keypoints_s, keypoints_d;
-    cv::Mat descriptors_s, descriptors_d;
-
-    #pragma omp parallel sections
+    return matchFeatures(features[0], features[1], matcher_options);
+}
+
+std::pair<std::vector<Eigen::Vector2d>, std::vector<Eigen::Vector2d>> matchFeatures(
+    const ImageFeatures& features_s,
+    const ImageFeatures& features_d,
+    const MatcherOptions& matcher_options) {
+
+    const std::vector<cv::KeyPoint>& keypoints_s = features_s.keypoints;
+    const std::vector<cv::KeyPoint>& keypoints_d = features_d.keypoints;
+    const cv::Mat& descriptors_s = features_s.descriptors;
+    const cv::Mat& descriptors_d = features_d.descriptors;
+    Profiler::instance().addCounter("keypoints_src", keypoints_s.size());
+    Profiler::instance().addCounter("keypoints_dest", keypoints_d.size());
+
+    // Match descriptors (brute force with cross-check by default, like cv::BFMatcher(NORM_L2 or NORM_HAMMING, true))
+    std::vector<cv::DMatch> matches;
     {
-        #pragma omp section
-        sift->detectAndCompute(gray_s, cv::noArray(), keypoints_s, descriptors_s);
-
-        #pragma omp section
-        sift->detectAndCompute(gray_d, cv::noArray(), keypoints_d, descriptors_d);
+        PROFILE_SCOPE("sift.match");
+        matches = matchDescriptors(descriptors_s, descriptors_d, matcher_options);
     }
+    Profiler::instance().addCounter("matches", matches.size());
 
-
-    // Match descriptors using BFMatcher with cross-check
-    cv::BFMatcher matcher(cv::NORM_L2, true);
-    std::vector<cv::DMatch> matches;
-    matcher.match(descriptors_s, descriptors_d, matches);
-
-    // Extract the locations of matched keypoints
-    // Extract the locations of matched keypoints
+    // Extract the locations of matched keypoints (a few thousand copies, not worth a team)
     std::vector<Eigen::Vector2d> xs(matches.size());
     std::vector<Eigen::Vector2d> xd(matches.size());
-
-    #pragma omp parallel for 
     for (size_t i = 0; i < matches.size(); ++i) {
         const cv::KeyPoint& kp_s = keypoints_s[matches[i].queryIdx];
         const cv::KeyPoint& kp_d = keypoints_d[matches[i].trainIdx];
@@ -53,4 +56,4 @@ std::pair<std::vector<Eigen::Vector2d>, std::vector<Eigen::Vector2d>> genSIFTMat
     }
 
     return {xs, xd};
-}
\ No newline at end of file
+}
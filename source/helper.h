@@ -4,9 +4,21 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include <Eigen/Dense>
+#include "descriptorMatcher.h"
+#include "featureCache.h"
 
+// Matched keypoint locations of two images, detected with the backend of feature_params (SIFT by default)
 std::pair<std::vector<Eigen::Vector2d>, std::vector<Eigen::Vector2d>> genSIFTMatches(
     const cv::Mat& img_s,
-    const cv::Mat& img_d);
+    const cv::Mat& img_d,
+    const MatcherOptions& matcher_options = MatcherOptions(),
+    const FeatureParams& feature_params = FeatureParams());
+
+// Matched keypoint locations of two already detected images (genSIFTMatches without the detection),
+// used by the task pipeline that detects every image once
+std::pair<std::vector<Eigen::Vector2d>, std::vector<Eigen::Vector2d>> matchFeatures(
+    const ImageFeatures& features_s,
+    const ImageFeatures& features_d,
+    const MatcherOptions& matcher_options = MatcherOptions());
 
 #endif
\ No newline at end of file
@@ -1,44 +1,197 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <omp.h>
 #include "homography.h"
 #include "common.h"
+#include "taskGraph.h"
 
-// Function to compute homography matrix
+namespace {
+
+// applyHomography runs in parallel only for point sets this large (canvas corners are projected serially)
+constexpr int kParallelPoints = 2048;
+
+// Points per task of the parallel projection
+constexpr int kPointGrain = 512;
+
+// 3x3 helpers on row-major arrays, the minimal solver runs once per RANSAC hypothesis
+
+// Adjugate: m^-1 up to the factor 1 / det(m), enough for homographies (defined up to scale)
+inline void adjugate3(const double m[9], double a[9]) {
+    a[0] = m[4] * m[8] - m[5] * m[7];
+    a[1] = m[2] * m[7] - m[1] * m[8];
+    a[2] = m[1] * m[5] - m[2] * m[4];
+    a[3] = m[5] * m[6] - m[3] * m[8];
+    a[4] = m[0] * m[8] - m[2] * m[6];
+    a[5] = m[2] * m[3] - m[0] * m[5];
+    a[6] = m[3] * m[7] - m[4] * m[6];
+    a[7] = m[1] * m[6] - m[0] * m[7];
+    a[8] = m[0] * m[4] - m[1] * m[3];
+}
+
+inline void multiply3(const double a[9], const double b[9], double c[9]) {
+    for (int r = 0; r < 3; ++r) {
+        for (int k = 0; k < 3; ++k) {
+            c[r * 3 + k] = a[r * 3] * b[k] + a[r * 3 + 1] * b[3 + k] + a[r * 3 + 2] * b[6 + k];
+        }
+    }
+}
+
+// Hartley normalization of four points: centroid to the origin, RMS distance sqrt(2). Returns (x, y) pairs.
+inline void normalizePoints(const Eigen::Vector2d pts[4], double& cx, double& cy, double& scale, double out[8]) {
+    const double* p[4] = {pts[0].data(), pts[1].data(), pts[2].data(), pts[3].data()};
+    cx = 0.25 * (p[0][0] + p[1][0] + p[2][0] + p[3][0]);
+    cy = 0.25 * (p[0][1] + p[1][1] + p[2][1] + p[3][1]);
+    double mean_sq = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        mean_sq += (p[i][0] - cx) * (p[i][0] - cx) + (p[i][1] - cy) * (p[i][1] - cy);
+    }
+    mean_sq *= 0.25;
+    scale = mean_sq > 0.0 ? std::sqrt(2.0 / mean_sq) : 1.0;
+    for (int i = 0; i < 4; ++i) {
+        out[2 * i] = (p[i][0] - cx) * scale;
+        out[2 * i + 1] = (p[i][1] - cy) * scale;
+    }
+}
+
+// Projective map (up to scale) sending e1, e2, e3 and (1, 1, 1) to the four points,
+// false if the first three are collinear
+inline bool basisToPoints(const double pts[8], double M[9]) {
+    // P = [p0 p1 p2] as columns, lambda ~ P^-1 * p3
+    const double P[9] = {pts[0], pts[2], pts[4],
+                         pts[1], pts[3], pts[5],
+                         1.0,    1.0,    1.0};
+    double adj[9];
+    adjugate3(P, adj);
+    const double det = P[0] * adj[0] + P[1] * adj[3] + P[2] * adj[6];
+    if (std::abs(det) < 1e-10) {
+        return false;
+    }
+    double lambda[3];
+    for (int r = 0; r < 3; ++r) {
+        lambda[r] = (adj[r * 3] * pts[6] + adj[r * 3 + 1] * pts[7] + adj[r * 3 + 2]) / det;
+    }
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            M[r * 3 + c] = P[r * 3 + c] * lambda[c];
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// Minimal 4-point homography: H = B_dest * B_src^-1, with B the map from the projective basis to the points.
+// Closed form on 3x3 arrays (no dynamic matrices, no eigen decomposition), on Hartley-normalized coordinates.
+bool computeHomography4(const Eigen::Vector2d src_pts[4], const Eigen::Vector2d dest_pts[4], Eigen::Matrix3d& H) {
+    double cxs, cys, ss, cxd, cyd, sd;
+    double ps[8], pd[8];
+    normalizePoints(src_pts, cxs, cys, ss, ps);
+    normalizePoints(dest_pts, cxd, cyd, sd, pd);
+
+    double Bs[9], Bd[9];
+    if (!basisToPoints(ps, Bs) || !basisToPoints(pd, Bd)) {
+        return false;
+    }
+    // any three collinear points make one of the basis maps singular
+    double Bs_adj[9], Hn[9];
+    adjugate3(Bs, Bs_adj);
+    multiply3(Bd, Bs_adj, Hn);
+
+    // denormalize: H = Td^-1 * Hn * Ts
+    const double Ts[9] = {ss, 0.0, -ss * cxs, 0.0, ss, -ss * cys, 0.0, 0.0, 1.0};
+    const double Td_inv[9] = {1.0 / sd, 0.0, cxd, 0.0, 1.0 / sd, cyd, 0.0, 0.0, 1.0};
+    double tmp[9], h[9];
+    multiply3(Hn, Ts, tmp);
+    multiply3(Td_inv, tmp, h);
+
+    // unit norm, like computeHomography
+    double norm = 0.0;
+    for (double v : h) {
+        norm += v * v;
+    }
+    norm = std::sqrt(norm);
+    if (!(norm > 0.0) || !std::isfinite(norm)) {
+        return false;
+    }
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            H.coeffRef(r, c) = h[r * 3 + c] / norm;
+        }
+    }
+    return true;
+}
+
+// Hartley normalization: similarity moving the centroid to the origin and the mean distance to sqrt(2)
+Eigen::Matrix3d normalizationTransform(const std::vector<Eigen::Vector2d>& pts) {
+    const int n = pts.size();
+    Eigen::Vector2d centroid = Eigen::Vector2d::Zero();
+    for (const Eigen::Vector2d& p : pts) {
+        centroid += p;
+    }
+    centroid /= std::max(n, 1);
+    double mean_dist = 0.0;
+    for (const Eigen::Vector2d& p : pts) {
+        mean_dist += (p - centroid).norm();
+    }
+    mean_dist /= std::max(n, 1);
+    const double s = mean_dist > 0.0 ? std::sqrt(2.0) / mean_dist : 1.0;
+    Eigen::Matrix3d T;
+    T << s, 0, -s * centroid.x(),
+         0, s, -s * centroid.y(),
+         0, 0, 1;
+    return T;
+}
+
+// Function to compute homography matrix (normalized DLT, least squares over all the correspondences)
 Eigen::Matrix3d computeHomography(const std::vector<Eigen::Vector2d>& src_pts, const std::vector<Eigen::Vector2d>& dest_pts) {
     int n = src_pts.size();
-    Eigen::MatrixXd A(2 * n, 9);
+    const Eigen::Matrix3d Ts = normalizationTransform(src_pts);
+    const Eigen::Matrix3d Td = normalizationTransform(dest_pts);
 
-    #pragma omp parallel for 
+    // Accumulate A^T * A row pair by row pair, fixed 9x9 (no 2n x 9 matrix)
+    Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero();
     for (int i = 0; i < n; ++i) {
-        double x1 = src_pts[i][0], y1 = src_pts[i][1];
-        double x2 = dest_pts[i][0], y2 = dest_pts[i][1];
-        
-        A.row(2 * i) << x1, y1, 1, 0, 0, 0, -x2 * x1, -x2 * y1, -x2;
-        A.row(2 * i + 1) << 0, 0, 0, x1, y1, 1, -y2 * x1, -y2 * y1, -y2;
+        Eigen::Vector2d s = (Ts * src_pts[i].homogeneous()).head<2>();
+        Eigen::Vector2d d = (Td * dest_pts[i].homogeneous()).head<2>();
+        double x1 = s[0], y1 = s[1];
+        double x2 = d[0], y2 = d[1];
+
+        Eigen::Matrix<double, 9, 1> a1, a2;
+        a1 << x1, y1, 1, 0, 0, 0, -x2 * x1, -x2 * y1, -x2;
+        a2 << 0, 0, 0, x1, y1, 1, -y2 * x1, -y2 * y1, -y2;
+        AtA.selfadjointView<Eigen::Upper>().rankUpdate(a1);
+        AtA.selfadjointView<Eigen::Upper>().rankUpdate(a2);
     }
 
     // Compute eigenvalues and eigenvectors of A^T * A
-    Eigen::MatrixXd AtA = A.transpose() * A;
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(AtA);
-    Eigen::VectorXd eigenvalues = eigensolver.eigenvalues();
-    Eigen::MatrixXd eigenvectors = eigensolver.eigenvectors();
+    Eigen::Matrix<double, 9, 9> AtA_full = AtA.selfadjointView<Eigen::Upper>();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> eigensolver(AtA_full);
 
     // Eigenvector with smallest eigenvalue
-    Eigen::VectorXd h = eigenvectors.col(0);
-    Eigen::Matrix3d H = Eigen::Map<Eigen::Matrix3d>(h.data());
+    Eigen::Matrix<double, 9, 1> h = eigensolver.eigenvectors().col(0);
+    Eigen::Matrix3d Hn = Eigen::Map<Eigen::Matrix3d>(h.data()).transpose();
 
-    return H.transpose();
+    // denormalize, unit norm
+    Eigen::Matrix3d H = Td.inverse() * Hn * Ts;
+    return H / H.norm();
 }
 
 // Function to apply homography matrix to source points
 std::vector<Eigen::Vector2d> applyHomography(const Eigen::Matrix3d& H, const std::vector<Eigen::Vector2d>& src_pts) {
     int n = src_pts.size();
     std::vector<Eigen::Vector2d> dest_pts(n);
-    #pragma omp parallel for 
-    for (int i = 0; i < n; ++i) {
+    auto project = [&](int i) {
         Eigen::Vector3d pt(src_pts[i][0], src_pts[i][1], 1.0);
         Eigen::Vector3d transformed_pt = H * pt;
         dest_pts[i] = Eigen::Vector2d(transformed_pt[0] / transformed_pt[2], transformed_pt[1] / transformed_pt[2]);
+    };
+    if (n >= kParallelPoints) {
+        parallelFor(n, kPointGrain, project);
+    } else {
+        for (int i = 0; i < n; ++i) {
+            project(i);
+        }
     }
 
     return dest_pts;
@@ -5,7 +5,13 @@
 #include <Eigen/Dense>
 #include <vector>
 
+// Hartley normalization of a point set (centroid to the origin, mean distance sqrt(2))
+Eigen::Matrix3d normalizationTransform(const std::vector<Eigen::Vector2d>& pts);
+// Least-squares homography over all the correspondences (normalized DLT)
 Eigen::Matrix3d computeHomography(const std::vector<Eigen::Vector2d>& src_pts, const std::vector<Eigen::Vector2d>& dest_pts);
+// Minimal solver for exactly four correspondences (RANSAC hypotheses), closed form on fixed-size matrices.
+// Returns false for a degenerate sample (three collinear points in either image).
+bool computeHomography4(const Eigen::Vector2d src_pts[4], const Eigen::Vector2d dest_pts[4], Eigen::Matrix3d& H);
 std::vector<Eigen::Vector2d> applyHomography(const Eigen::Matrix3d& H, const std::vector<Eigen::Vector2d>& src_pts);
 cv::Mat showCorrespondence(const cv::Mat& img1, const cv::Mat& img2, const std::vector<Eigen::Vector2d>& pts1, const std::vector<Eigen::Vector2d>& pts2);
 
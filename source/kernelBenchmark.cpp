@@ -0,0 +1,362 @@
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+#include <omp.h>
+#include "homography.h"
+#include "ransac.h"
+#include "backwardWarpImg.h"
+#include "blendImagePair.h"
+#include "helper.h"
+#include "featureCache.h"
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+// Kernel microbenchmarks on synthetic inputs: no disk I/O, every input is generated from a fixed seed and
+// RANSAC runs with a fixed seed. On one thread two runs measure the same work; with more, the RANSAC workers
+// share the hypothesis budget and the adaptive stop depends on their timing, so its work varies between runs.
+// Every kernel runs over a grid of image sizes / point counts / keypoint counts and thread counts; each
+// configuration is warmed up once and timed `repeats` times (short kernels are looped to at least
+// kMinSampleMs per sample). The summary is written as JSON, one benchmark object per line:
+//   {"name": ..., "params": ..., "repeats": ..., "min_ms": ..., "median_ms": ..., "mean_ms": ..., "stddev_ms": ..., "p90_ms": ...}
+// With --baseline, the medians are compared against a JSON file written by an earlier run and every
+// configuration slower than the baseline by more than the tolerance is flagged (exit code 1).
+
+namespace {
+
+constexpr unsigned kInputSeed = 759;
+constexpr double kMinSampleMs = 1.0;
+constexpr int kMaxInnerLoops = 100000;
+constexpr double kOutlierRatio = 0.3;
+
+struct BenchConfig {
+    std::vector<int> threads = {1, omp_get_max_threads()};
+    std::vector<cv::Size> sizes = {{640, 480}, {1280, 720}};
+    std::vector<int> points = {500, 2000, 8000};
+    std::vector<int> keypoints = {500, 2000};
+    int repeats = 15;
+    std::string filter;
+    std::string output;
+    std::string baseline;
+    double tolerance = 0.10;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string params;
+    int repeats = 0;
+    double min_ms = 0.0;
+    double median_ms = 0.0;
+    double mean_ms = 0.0;
+    double stddev_ms = 0.0;
+    double p90_ms = 0.0;
+};
+
+// Per-call time of f, summarized over repeats samples
+BenchResult measure(const std::string& name, const std::string& params, int repeats, const std::function<void()>& f) {
+    // 1. warm-up, and the number of calls per sample for kernels shorter than kMinSampleMs
+    auto start_time = high_resolution_clock::now();
+    f();
+    double once = std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start_time).count();
+    const int inner = once >= kMinSampleMs ? 1 : std::min(kMaxInnerLoops, static_cast<int>(std::ceil(kMinSampleMs / std::max(once, 1e-6))));
+
+    // 2. samples
+    std::vector<double> samples(repeats);
+    for (double& sample : samples) {
+        start_time = high_resolution_clock::now();
+        for (int k = 0; k < inner; ++k) {
+            f();
+        }
+        sample = std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start_time).count() / inner;
+    }
+
+    // 3. summary
+    std::sort(samples.begin(), samples.end());
+    BenchResult r;
+    r.name = name;
+    r.params = params;
+    r.repeats = repeats;
+    r.min_ms = samples.front();
+    r.median_ms = repeats % 2 ? samples[repeats / 2] : 0.5 * (samples[repeats / 2 - 1] + samples[repeats / 2]);
+    double sum = 0.0, sum2 = 0.0;
+    for (double s : samples) {
+        sum += s;
+        sum2 += s * s;
+    }
+    r.mean_ms = sum / repeats;
+    r.stddev_ms = repeats > 1 ? std::sqrt(std::max(0.0, (sum2 - sum * sum / repeats) / (repeats - 1))) : 0.0;
+    r.p90_ms = samples[std::min(repeats - 1, static_cast<int>(std::ceil(0.9 * repeats)) - 1)];
+    return r;
+}
+
+// Ground-truth homography of the synthetic correspondences: small rotation, zoom and perspective
+Eigen::Matrix3d syntheticHomography(const cv::Size& size) {
+    Eigen::Matrix3d H;
+    H << 0.98, -0.05, 0.15 * size.width,
+         0.04, 1.01, 0.02 * size.height,
+         2e-5, -1e-5, 1.0;
+    return H;
+}
+
+// n correspondences inside size; with outliers, kOutlierRatio of the destinations are random
+void syntheticMatches(int n, const cv::Size& size, bool outliers, std::vector<Eigen::Vector2d>& src, std::vector<Eigen::Vector2d>& dest) {
+    std::mt19937 gen(kInputSeed + n);
+    std::uniform_real_distribution<double> ux(0.0, size.width - 1.0), uy(0.0, size.height - 1.0), u01(0.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.5);
+    const Eigen::Matrix3d H = syntheticHomography(size);
+    src.resize(n);
+    for (Eigen::Vector2d& p : src) {
+        p = Eigen::Vector2d(ux(gen), uy(gen));
+    }
+    dest = applyHomography(H, src);
+    for (Eigen::Vector2d& p : dest) {
+        if (outliers && u01(gen) < kOutlierRatio) {
+            p = Eigen::Vector2d(ux(gen), uy(gen));
+        } else {
+            p += Eigen::Vector2d(noise(gen), noise(gen));
+        }
+    }
+}
+
+// Textured BGR image (blurred noise at two scales), the same for every run
+cv::Mat syntheticImage(const cv::Size& size, unsigned seed) {
+    cv::RNG rng(seed);
+    cv::Mat coarse(size.height / 8 + 1, size.width / 8 + 1, CV_8UC3), fine(size, CV_8UC3), img;
+    rng.fill(coarse, cv::RNG::UNIFORM, 0, 256);
+    rng.fill(fine, cv::RNG::UNIFORM, 0, 256);
+    cv::resize(coarse, img, size, 0, 0, cv::INTER_CUBIC);
+    cv::GaussianBlur(fine, fine, cv::Size(5, 5), 1.5);
+    cv::addWeighted(img, 0.7, fine, 0.3, 0.0, img);
+    return img;
+}
+
+std::string sizeParam(const cv::Size& size) {
+    return std::to_string(size.width) + "x" + std::to_string(size.height);
+}
+
+std::vector<std::string> splitList(const std::string& s) {
+    std::vector<std::string> items;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::vector<int> parseInts(const std::string& s) {
+    std::vector<int> values;
+    for (const std::string& item : splitList(s)) {
+        values.push_back(atoi(item.c_str()));
+    }
+    return values;
+}
+
+std::vector<cv::Size> parseSizes(const std::string& s) {
+    std::vector<cv::Size> sizes;
+    for (const std::string& item : splitList(s)) {
+        const size_t x = item.find('x');
+        if (x == std::string::npos) {
+            throw std::invalid_argument("Error: image size " + item + " is not WIDTHxHEIGHT.");
+        }
+        sizes.emplace_back(atoi(item.substr(0, x).c_str()), atoi(item.substr(x + 1).c_str()));
+    }
+    return sizes;
+}
+
+void writeResult(std::ostream& out, const BenchResult& r) {
+    out << "{\"name\": \"" << r.name << "\", \"params\": \"" << r.params << "\", \"repeats\": " << r.repeats
+        << ", \"min_ms\": " << r.min_ms << ", \"median_ms\": " << r.median_ms << ", \"mean_ms\": " << r.mean_ms
+        << ", \"stddev_ms\": " << r.stddev_ms << ", \"p90_ms\": " << r.p90_ms << "}";
+}
+
+bool writeJSON(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "{\n  \"max_threads\": " << omp_get_max_threads() << ",\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        out << (i ? ",\n    " : "\n    ");
+        writeResult(out, results[i]);
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// String value of "key": "..." in line
+std::string stringField(const std::string& line, const std::string& key) {
+    const std::string tag = "\"" + key + "\": \"";
+    const size_t begin = line.find(tag);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    const size_t end = line.find('"', begin + tag.size());
+    return end == std::string::npos ? "" : line.substr(begin + tag.size(), end - begin - tag.size());
+}
+
+// Median per "name|params" of a file written by writeJSON
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::invalid_argument("Error: could not open baseline " + path + ".");
+    }
+    std::map<std::string, double> medians;
+    std::string line;
+    const std::string tag = "\"median_ms\": ";
+    while (std::getline(in, line)) {
+        const size_t pos = line.find(tag);
+        const std::string name = stringField(line, "name");
+        if (pos == std::string::npos || name.empty()) {
+            continue;
+        }
+        medians[name + "|" + stringField(line, "params")] = atof(line.c_str() + pos + tag.size());
+    }
+    return medians;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    const std::string usage = "please run commond: ./kernel_benchmark [--threads 1,4] [--sizes 640x480,1280x720] [--points 500,2000,8000] "
+                              "[--keypoints 500,2000] [--repeats n] [--filter name] [--output path.json] [--baseline path.json] [--tolerance 0.1]";
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            config.threads = parseInts(argv[++i]);
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            config.sizes = parseSizes(argv[++i]);
+        } else if (arg == "--points" && i + 1 < argc) {
+            config.points = parseInts(argv[++i]);
+        } else if (arg == "--keypoints" && i + 1 < argc) {
+            config.keypoints = parseInts(argv[++i]);
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            config.repeats = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--filter" && i + 1 < argc) {
+            config.filter = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            config.output = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            config.baseline = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            config.tolerance = atof(argv[++i]);
+        } else {
+            std::cout << usage << std::endl;
+            return -1;
+        }
+    }
+    config.threads.erase(std::unique(config.threads.begin(), config.threads.end()), config.threads.end());
+
+    std::vector<BenchResult> results;
+    auto run = [&](const std::string& name, const std::string& params, const std::function<void()>& f) {
+        if (!config.filter.empty() && name.find(config.filter) == std::string::npos) {
+            return;
+        }
+        results.push_back(measure(name, params, config.repeats, f));
+        std::cerr << name << " " << params << ": " << results.back().median_ms << " ms" << std::endl;
+    };
+    const bool wants_sift = config.filter.empty() || std::string("genSIFTMatches").find(config.filter) != std::string::npos;
+
+    for (int threads : config.threads) {
+        omp_set_num_threads(threads);
+        const std::string t = ",threads=" + std::to_string(threads);
+
+        // 1. homography kernels over the number of correspondences
+        for (int n : config.points) {
+            const std::string p = "points=" + std::to_string(n) + t;
+            std::vector<Eigen::Vector2d> src, dest, out_src, out_dest;
+            syntheticMatches(n, config.sizes.front(), false, src, dest);
+            syntheticMatches(n, config.sizes.front(), true, out_src, out_dest);
+            Eigen::Matrix3d H;
+            std::vector<Eigen::Vector2d> projected;
+            run("computeHomography", p, [&] { H = computeHomography(src, dest); });
+            run("applyHomography", p, [&] { projected = applyHomography(H, src); });
+            run("runRANSAC", p, [&] { runRANSAC(out_src, out_dest, 2000, 3.0, 0.99, kInputSeed); });
+        }
+
+        // 2. image kernels over the image size
+        for (const cv::Size& size : config.sizes) {
+            const std::string p = "size=" + sizeParam(size);
+            cv::Mat src;
+            syntheticImage(size, kInputSeed).convertTo(src, CV_32FC3, 1.0 / 255.0);
+            const cv::Size canvas(size.width * 6 / 5, size.height * 6 / 5);
+            const Eigen::Matrix3d destToSrc = syntheticHomography(size).inverse();
+            for (WarpInterp mode : {WarpInterp::Nearest, WarpInterp::Bilinear, WarpInterp::Bicubic}) {
+                const char* interp = mode == WarpInterp::Nearest ? "nearest" : mode == WarpInterp::Bilinear ? "bilinear" : "bicubic";
+                run("backwardWarpImg", p + ",interp=" + interp + t, [&] { backwardWarpImg(src, destToSrc, canvas, mode); });
+            }
+
+            // two images on a shared canvas, each covering 60% of the width (20% overlap)
+            cv::Mat img1 = cv::Mat::zeros(size, CV_32FC3), img2 = cv::Mat::zeros(size, CV_32FC3);
+            cv::Mat mask1 = cv::Mat::zeros(size, CV_8U), mask2 = cv::Mat::zeros(size, CV_8U);
+            const cv::Rect left(0, 0, size.width * 3 / 5, size.height), right(size.width * 2 / 5, 0, size.width - size.width * 2 / 5, size.height);
+            src(left).copyTo(img1(left));
+            src(right).copyTo(img2(right));
+            mask1(left).setTo(1);
+            mask2(right).setTo(1);
+            for (const char* mode : {"overlay", "blend", "multiband"}) {
+                run(std::string("blendImagePair.") + mode, p + t, [&] { blendImagePair(img1, mask1, img2, mask2, mode); });
+            }
+
+            // 3. detection and matching of two overlapping views (no feature cache), over the number of keypoints
+            if (!wants_sift) {
+                continue;
+            }
+            const cv::Mat scene = syntheticImage(cv::Size(size.width * 3 / 2, size.height), kInputSeed + 1);
+            const cv::Mat view_s = scene(cv::Rect(size.width / 2, 0, size.width, size.height)).clone();
+            const cv::Mat view_d = scene(cv::Rect(0, 0, size.width, size.height)).clone();
+            for (int k : config.keypoints) {
+                FeatureParams params;
+                params.sift.nfeatures = k;
+                run("genSIFTMatches", p + ",keypoints=" + std::to_string(k) + t, [&] {
+                    genSIFTMatches(view_s, view_d, MatcherOptions(), params);
+                });
+            }
+        }
+    }
+
+    if (!config.output.empty() && !writeJSON(config.output, results)) {
+        std::cerr << "Could not write " << config.output << std::endl;
+        return -1;
+    }
+    if (config.output.empty()) {
+        for (const BenchResult& r : results) {
+            writeResult(std::cout, r);
+            std::cout << std::endl;
+        }
+    }
+    if (config.baseline.empty()) {
+        return 0;
+    }
+
+    // 4. regressions against the baseline medians
+    const std::map<std::string, double> baseline = readBaseline(config.baseline);
+    int regressions = 0;
+    std::cout << "name,params,median_ms,baseline_ms,change,status" << std::endl;
+    for (const BenchResult& r : results) {
+        auto it = baseline.find(r.name + "|" + r.params);
+        if (it == baseline.end() || it->second <= 0.0) {
+            std::cout << r.name << ",\"" << r.params << "\"," << r.median_ms << ",,,new" << std::endl;
+            continue;
+        }
+        const double change = r.median_ms / it->second - 1.0;
+        const bool regressed = change > config.tolerance;
+        regressions += regressed;
+        std::cout << r.name << ",\"" << r.params << "\"," << r.median_ms << "," << it->second << "," << change << ","
+                  << (regressed ? "REGRESSION" : change < -config.tolerance ? "faster" : "ok") << std::endl;
+    }
+    std::cerr << regressions << " regression(s) beyond " << config.tolerance * 100.0 << "%" << std::endl;
+    return regressions > 0 ? 1 : 0;
+}
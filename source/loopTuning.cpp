@@ -0,0 +1,120 @@
+#include "loopTuning.h"
+#include <fstream>
+#include <sstream>
+#include <omp.h>
+
+LoopTuning& LoopTuning::instance() {
+    static LoopTuning tuning;
+    return tuning;
+}
+
+void LoopTuning::set(LoopStage stage, const LoopSettings& settings) {
+    settings_[static_cast<int>(stage)] = settings;
+}
+
+void LoopTuning::reset() {
+    settings_.fill(LoopSettings());
+}
+
+bool LoopTuning::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::array<LoopSettings, kLoopStages> loaded;
+    bool same_machine = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name;
+        fields >> name;
+        if (name == "procs") {
+            int procs = 0;
+            fields >> procs;
+            same_machine = procs == omp_get_num_procs();
+            continue;
+        }
+        std::string schedule;
+        LoopSettings settings;
+        fields >> schedule >> settings.chunk >> settings.threads;
+        int stage = 0;
+        while (stage < kLoopStages && name != loopStageName(static_cast<LoopStage>(stage))) {
+            ++stage;
+        }
+        if (!fields || stage == kLoopStages || !parseLoopSchedule(schedule, settings.schedule) ||
+            settings.chunk < 0 || settings.threads < 0) {
+            return false;
+        }
+        loaded[stage] = settings;
+    }
+    if (!same_machine) {
+        return false;
+    }
+    settings_ = loaded;
+    return true;
+}
+
+bool LoopTuning::save(const std::string& path, const std::string& comment) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    if (!comment.empty()) {
+        out << "# " << comment << "\n";
+    }
+    out << "procs " << omp_get_num_procs() << "\n";
+    for (int stage = 0; stage < kLoopStages; ++stage) {
+        const LoopSettings& settings = settings_[stage];
+        out << loopStageName(static_cast<LoopStage>(stage)) << " " << loopScheduleName(settings.schedule) << " "
+            << settings.chunk << " " << settings.threads << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+std::array<double, kLoopStages> LoopTuning::takeTimes() {
+    std::array<double, kLoopStages> times;
+    for (int stage = 0; stage < kLoopStages; ++stage) {
+        times[stage] = stage_ns_[stage].exchange(0, std::memory_order_relaxed) * 1e-6;
+    }
+    return times;
+}
+
+const char* loopStageName(LoopStage stage) {
+    switch (stage) {
+        case LoopStage::WarpRows: return "warp_rows";
+        case LoopStage::WarpBlendTiles: return "warp_blend_tiles";
+        case LoopStage::WarpBlendRows: return "warp_blend_rows";
+        case LoopStage::BlendRows: return "blend_rows";
+        case LoopStage::BlendDistance: return "blend_distance";
+        case LoopStage::MultibandTiles: return "multiband_tiles";
+        case LoopStage::MatchQueries: return "match_queries";
+        case LoopStage::Ransac: return "ransac";
+        case LoopStage::WarpMapBuild: return "warp_map_build";
+        case LoopStage::WarpMapGather: return "warp_map_gather";
+        default: return "unknown";
+    }
+}
+
+const char* loopScheduleName(LoopSchedule schedule) {
+    switch (schedule) {
+        case LoopSchedule::Static: return "static";
+        case LoopSchedule::Guided: return "guided";
+        default: return "dynamic";
+    }
+}
+
+bool parseLoopSchedule(const std::string& name, LoopSchedule& schedule) {
+    if (name == "static") {
+        schedule = LoopSchedule::Static;
+    } else if (name == "dynamic") {
+        schedule = LoopSchedule::Dynamic;
+    } else if (name == "guided") {
+        schedule = LoopSchedule::Guided;
+    } else {
+        return false;
+    }
+    return true;
+}
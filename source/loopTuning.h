@@ -0,0 +1,78 @@
+#ifndef LOOP_TUNING_H
+#define LOOP_TUNING_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Per-stage settings of the parallel loops.
+// Every parallel loop of the pipeline belongs to a stage and runs with the schedule, chunk size and thread count
+// of that stage (see parallelFor in taskGraph.h). The stages balance their load differently (equal warp rows,
+// overlap-only blend rows, early-exit RANSAC hypotheses), so no single OMP_SCHEDULE suits all of them.
+// The settings are process-wide: change them only while no loop is running.
+
+enum class LoopStage {
+    WarpRows,        // backwardWarpImg: footprint rows
+    WarpBlendTiles,  // fused warp and blend: row tiles
+    WarpBlendRows,   // fused warp and blend: masks and blending of warped rows
+    BlendRows,       // blendImagePair: overlap rows
+    BlendDistance,   // blendImagePair: incremental distance transform
+    MultibandTiles,  // multiband blending: row tiles of every pyramid level
+    MatchQueries,    // descriptor matching: query blocks
+    Ransac,          // RANSAC hypotheses (always claimed dynamically, schedule is ignored)
+    WarpMapBuild,    // WarpMap construction: canvas rows
+    WarpMapGather,   // WarpMap gather: row runs
+    Count
+};
+
+constexpr int kLoopStages = static_cast<int>(LoopStage::Count);
+
+enum class LoopSchedule {
+    Static,
+    Dynamic,
+    Guided
+};
+
+struct LoopSettings {
+    LoopSchedule schedule = LoopSchedule::Dynamic;
+    int chunk = 0;    // iterations per scheduling unit (RANSAC: hypotheses per claim), 0 = default of the loop
+    int threads = 0;  // upper bound of the team size, 0 = all threads of the team
+};
+
+class LoopTuning {
+public:
+    static LoopTuning& instance();
+
+    const LoopSettings& settings(LoopStage stage) const { return settings_[static_cast<int>(stage)]; }
+    void set(LoopStage stage, const LoopSettings& settings);
+    // every stage back to the defaults of its loops
+    void reset();
+
+    // Profile file, one line per stage: "<stage> <schedule> <chunk> <threads>", plus a "procs <n>" line.
+    // load() returns false (and keeps the current settings) if the file is missing, malformed,
+    // or was tuned on a machine with a different number of processors.
+    bool load(const std::string& path);
+    bool save(const std::string& path, const std::string& comment = std::string()) const;
+
+    // Wall time of every stage, accumulated while measuring is on (used by the autotuner)
+    void setMeasuring(bool measuring) { measuring_.store(measuring, std::memory_order_relaxed); }
+    bool measuring() const { return measuring_.load(std::memory_order_relaxed); }
+    void record(LoopStage stage, int64_t ns) { stage_ns_[static_cast<int>(stage)].fetch_add(ns, std::memory_order_relaxed); }
+    // accumulated milliseconds per stage since the last call, resets the counters
+    std::array<double, kLoopStages> takeTimes();
+
+private:
+    LoopTuning() = default;
+
+    std::array<LoopSettings, kLoopStages> settings_;
+    std::atomic<bool> measuring_{false};
+    std::array<std::atomic<int64_t>, kLoopStages> stage_ns_{};
+};
+
+const char* loopStageName(LoopStage stage);
+const char* loopScheduleName(LoopSchedule schedule);
+// false if name is not a schedule name
+bool parseLoopSchedule(const std::string& name, LoopSchedule& schedule);
+
+#endif // LOOP_TUNING_H
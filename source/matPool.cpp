@@ -0,0 +1,224 @@
+#include "matPool.h"
+#include "profiler.h"
+#include "taskGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+
+namespace {
+
+// Transparent huge page size: mappings are aligned to and sized in multiples of it
+constexpr size_t kHugePage = size_t(2) << 20;
+
+// Rows are padded to whole cache lines
+constexpr size_t kRowAlign = 64;
+
+// Rows per task of the zeroing and copy loops (first touch)
+constexpr int kTouchRowGrain = 16;
+
+// Bytes per task of the in-place shift; shorter shifts are one memmove
+constexpr size_t kMoveBlock = size_t(1) << 20;
+
+size_t roundUp(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+// Move bytes [0, length) of base to [delta, delta + length). The tail moves first, in waves of delta bytes:
+// a wave only overwrites bytes an earlier wave already moved, so the blocks of a wave are copied in parallel.
+void shiftBytes(uchar* base, size_t length, size_t delta, LoopStage stage) {
+    if (delta == 0 || length == 0) {
+        return;
+    }
+    if (delta < kMoveBlock) {
+        std::memmove(base + delta, base, length);
+        return;
+    }
+    size_t end = length;
+    while (end > 0) {
+        const size_t begin = end > delta ? end - delta : 0;
+        const int blocks = static_cast<int>((end - begin + kMoveBlock - 1) / kMoveBlock);
+        parallelFor(stage, blocks, 1, [&](int b) {
+            const size_t first = begin + b * kMoveBlock;
+            const size_t last = std::min(end, first + kMoveBlock);
+            std::memcpy(base + first + delta, base + first, last - first);
+        });
+        end = begin;
+    }
+}
+
+} // namespace
+
+MatPool::MatPool(double headroom) : headroom_(headroom) {
+    if (headroom < 1.0) {
+        throw std::invalid_argument("Error: pool headroom must be at least 1.");
+    }
+}
+
+MatPool::~MatPool() {
+    for (auto& slot : slots_) {
+        release(slot.second);
+    }
+}
+
+bool MatPool::fits(const Buffer& buffer, cv::Size size, size_t elem_size) {
+    return buffer.data && size.width * elem_size <= buffer.step && size.height <= buffer.capacity_rows;
+}
+
+MatPool::Buffer MatPool::allocate(cv::Size size, size_t elem_size) {
+    Buffer buffer;
+    buffer.step = roundUp(static_cast<size_t>(std::ceil(size.width * headroom_)) * elem_size, kRowAlign);
+    buffer.capacity_rows = static_cast<int>(std::ceil(size.height * headroom_));
+    buffer.bytes = roundUp(buffer.step * buffer.capacity_rows, kHugePage);
+
+    // 1. map one huge page more than needed and trim both ends to a huge page boundary
+    void* raw = mmap(nullptr, buffer.bytes + kHugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    const uintptr_t aligned = roundUp(start, kHugePage);
+    if (aligned > start) {
+        munmap(raw, aligned - start);
+    }
+    if (start + kHugePage > aligned) {
+        munmap(reinterpret_cast<void*>(aligned + buffer.bytes), start + kHugePage - aligned);
+    }
+    buffer.data = reinterpret_cast<uchar*>(aligned);
+
+    // 2. back it by huge pages where the kernel allows it; pages are only faulted in on first touch
+#ifdef MADV_HUGEPAGE
+    buffer.huge = madvise(buffer.data, buffer.bytes, MADV_HUGEPAGE) == 0;
+#endif
+
+    ++stats_.allocations;
+    stats_.mapped_bytes += buffer.bytes;
+    stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.mapped_bytes);
+    if (buffer.huge) {
+        stats_.huge_page_bytes += buffer.bytes;
+    }
+    return buffer;
+}
+
+void MatPool::release(Buffer& buffer) {
+    if (!buffer.data) {
+        return;
+    }
+    munmap(buffer.data, buffer.bytes);
+    stats_.mapped_bytes -= buffer.bytes;
+    if (buffer.huge) {
+        stats_.huge_page_bytes -= buffer.bytes;
+    }
+    buffer = Buffer();
+}
+
+cv::Mat MatPool::acquire(const std::string& slot, cv::Size size, int type, bool zero, LoopStage stage) {
+    if (size.width <= 0 || size.height <= 0) {
+        throw std::invalid_argument("Error: pool matrices must not be empty.");
+    }
+    ++stats_.acquires;
+    const size_t elem_size = CV_ELEM_SIZE(type);
+    Buffer& buffer = slots_[slot];
+    bool fresh = false;
+    if (fits(buffer, size, elem_size)) {
+        ++stats_.reuses;
+    } else {
+        release(buffer);
+        buffer = allocate(size, elem_size);
+        fresh = true;
+    }
+    buffer.view = cv::Mat(size, type, buffer.data, buffer.step);
+
+    // fresh pages are touched by the rows of the threads of the stage
+    if (zero || fresh) {
+        const size_t row_bytes = size.width * elem_size;
+        cv::Mat& view = buffer.view;
+        parallelFor(stage, size.height, kTouchRowGrain, [&](int y) {
+            std::memset(view.ptr(y), 0, row_bytes);
+        });
+    }
+    return buffer.view;
+}
+
+cv::Mat MatPool::grow(const std::string& slot, const cv::Mat& content, cv::Size size, int dx, int dy, LoopStage stage) {
+    if (content.empty() || dx < 0 || dy < 0 || content.cols + dx > size.width || content.rows + dy > size.height) {
+        throw std::invalid_argument("Error: grown matrix must contain the content at the offset.");
+    }
+    ++stats_.acquires;
+    const int type = content.type();
+    const size_t elem_size = content.elemSize();
+    Buffer& buffer = slots_[slot];
+    const bool resident = buffer.data && content.data == buffer.view.data && content.size() == buffer.view.size() &&
+                          content.type() == buffer.view.type() && content.step[0] == buffer.step;
+    const size_t left_bytes = dx * elem_size;
+    const size_t content_bytes = content.cols * elem_size;
+    const size_t row_bytes = size.width * elem_size;
+
+    // 1. in place: shift the content by dy rows and dx columns, zero what it left and the new area
+    if (resident && fits(buffer, size, elem_size)) {
+        ++stats_.reuses;
+        ++stats_.in_place_grows;
+        shiftBytes(buffer.data, (content.rows - 1) * buffer.step + content_bytes, dy * buffer.step + left_bytes, stage);
+        buffer.view = cv::Mat(size, type, buffer.data, buffer.step);
+        cv::Mat& view = buffer.view;
+        parallelFor(stage, size.height, kTouchRowGrain, [&](int y) {
+            uchar* row = view.ptr(y);
+            if (y < dy || y >= dy + content.rows) {
+                std::memset(row, 0, row_bytes);
+                return;
+            }
+            std::memset(row, 0, left_bytes);
+            std::memset(row + left_bytes + content_bytes, 0, row_bytes - left_bytes - content_bytes);
+        });
+        return buffer.view;
+    }
+
+    // 2. otherwise copy the content into the slot buffer, a new one if it is too small or the content lives in it
+    const bool aliases = buffer.data && content.data >= buffer.data && content.data < buffer.data + buffer.bytes;
+    Buffer target;
+    if (!aliases && fits(buffer, size, elem_size)) {
+        ++stats_.reuses;
+        target = buffer;
+    } else {
+        target = allocate(size, elem_size);
+    }
+    target.view = cv::Mat(size, type, target.data, target.step);
+    cv::Mat& view = target.view;
+    parallelFor(stage, size.height, kTouchRowGrain, [&](int y) {
+        uchar* row = view.ptr(y);
+        if (y < dy || y >= dy + content.rows) {
+            std::memset(row, 0, row_bytes);
+            return;
+        }
+        std::memset(row, 0, left_bytes);
+        std::memcpy(row + left_bytes, content.ptr(y - dy), content_bytes);
+        std::memset(row + left_bytes + content_bytes, 0, row_bytes - left_bytes - content_bytes);
+    });
+    if (target.data != buffer.data) {
+        release(buffer);
+    }
+    buffer = target;
+    return buffer.view;
+}
+
+void MatPool::resetCounters() {
+    stats_.acquires = 0;
+    stats_.reuses = 0;
+    stats_.in_place_grows = 0;
+    stats_.allocations = 0;
+    stats_.peak_bytes = stats_.mapped_bytes;
+}
+
+void MatPool::report() const {
+    Profiler& profiler = Profiler::instance();
+    profiler.addCounter("pool_acquires", static_cast<double>(stats_.acquires));
+    profiler.addCounter("pool_reuses", static_cast<double>(stats_.reuses));
+    profiler.addCounter("pool_in_place_grows", static_cast<double>(stats_.in_place_grows));
+    profiler.addCounter("pool_allocations", static_cast<double>(stats_.allocations));
+    profiler.addCounter("pool_mapped_bytes", static_cast<double>(stats_.mapped_bytes));
+    profiler.addCounter("pool_peak_bytes", static_cast<double>(stats_.peak_bytes));
+    profiler.addCounter("pool_huge_page_bytes", static_cast<double>(stats_.huge_page_bytes));
+}
@@ -0,0 +1,73 @@
+#ifndef MAT_POOL_H
+#define MAT_POOL_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <map>
+#include <string>
+#include "loopTuning.h"
+
+// Canvas-sized buffers of the iterative stitcher, reused across iterations.
+// The canvas only grows, so every iteration used to allocate (page-fault and zero) new canvas-sized matrices.
+// The pool keeps one buffer per role (slot) and hands out matrix views of it. A buffer is allocated with headroom
+// in both dimensions, so the next, larger canvas usually fits in it: the view is widened and the old content
+// is shifted in place instead of being copied to a new allocation.
+// Buffers are anonymous mappings, 2 MB aligned and marked for transparent huge pages. Fresh pages are first
+// touched (zeroed) by a parallel row loop with the settings of the stage that processes the buffer, so with
+// a static schedule each stripe lands on the memory node of the thread that works on it.
+// A view is valid until the next acquire/grow of its slot or the destruction of the pool: clone what outlives it.
+
+struct MatPoolStats {
+    size_t acquires = 0;        // acquire and grow calls
+    size_t reuses = 0;          // calls served from the existing buffer of the slot
+    size_t in_place_grows = 0;  // grow calls that shifted the content inside the buffer
+    size_t allocations = 0;     // mappings created
+    size_t mapped_bytes = 0;    // bytes currently mapped
+    size_t peak_bytes = 0;      // largest mapped_bytes
+    size_t huge_page_bytes = 0; // bytes of the current mappings marked for huge pages
+};
+
+class MatPool {
+public:
+    // headroom: capacity of a new buffer relative to the requested width and height
+    explicit MatPool(double headroom = 1.5);
+    ~MatPool();
+    MatPool(const MatPool&) = delete;
+    MatPool& operator=(const MatPool&) = delete;
+
+    // size x type matrix of slot, zeroed if zero is set (otherwise the content is undefined).
+    // stage: the loop stage that processes the matrix, its settings distribute the first touch.
+    cv::Mat acquire(const std::string& slot, cv::Size size, int type, bool zero = true,
+                    LoopStage stage = LoopStage::WarpBlendRows);
+    // The matrix last handed out by slot, enlarged to size with its content moved to (dx, dy); the new area is zeroed.
+    // In place if the buffer is large enough. If the slot holds a different matrix than content, content is copied in.
+    cv::Mat grow(const std::string& slot, const cv::Mat& content, cv::Size size, int dx, int dy,
+                 LoopStage stage = LoopStage::WarpBlendRows);
+
+    const MatPoolStats& stats() const { return stats_; }
+    // restart the call counters and the peak at the current mapping, e.g. per stitch of a long-lived pool
+    void resetCounters();
+    // stats as profiler counters (pool_*)
+    void report() const;
+
+private:
+    struct Buffer {
+        uchar* data = nullptr;
+        size_t bytes = 0;   // mapped length
+        size_t step = 0;    // bytes per row
+        int capacity_rows = 0;
+        bool huge = false;  // marked for transparent huge pages
+        cv::Mat view;       // matrix last handed out
+    };
+
+    // unmapped-on-release buffer for size with headroom; its pages are not touched yet
+    Buffer allocate(cv::Size size, size_t elem_size);
+    void release(Buffer& buffer);
+    static bool fits(const Buffer& buffer, cv::Size size, size_t elem_size);
+
+    double headroom_;
+    std::map<std::string, Buffer> slots_;
+    MatPoolStats stats_;
+};
+
+#endif // MAT_POOL_H
@@ -0,0 +1,113 @@
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <set>
+#include <utility>
+#include <omp.h>
+#include "descriptorMatcher.h"
+#include "featureCache.h"
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+// Descriptor matching benchmark: speed and recall of the approximate matchers against brute force.
+// Prints one CSV row per configuration:
+//   matcher,checks,time_ms,matches,matches_per_s,recall,nn_recall
+// recall: share of the brute-force matches (same ratio test and cross-check) that are found
+// nn_recall: share of the queries whose nearest neighbour is the exact one (no ratio test, no cross-check)
+
+namespace {
+
+template <typename F>
+double timeMs(F&& f) {
+    auto start_time = high_resolution_clock::now();
+    f();
+    auto end_time = high_resolution_clock::now();
+    return std::chrono::duration_cast<duration<double, std::milli>>(end_time - start_time).count();
+}
+
+double recall(const std::vector<cv::DMatch>& found, const std::vector<cv::DMatch>& truth) {
+    if (truth.empty()) {
+        return 1.0;
+    }
+    std::set<std::pair<int, int>> found_pairs;
+    for (const cv::DMatch& m : found) {
+        found_pairs.insert({m.queryIdx, m.trainIdx});
+    }
+    size_t hits = 0;
+    for (const cv::DMatch& m : truth) {
+        hits += found_pairs.count({m.queryIdx, m.trainIdx});
+    }
+    return static_cast<double>(hits) / truth.size();
+}
+
+void printRow(const std::string& matcher, int checks, double ms, size_t matches, double recall_value, double nn_recall) {
+    std::cout << matcher << "," << checks << "," << ms << "," << matches << "," << (ms > 0 ? matches / ms * 1000.0 : 0.0)
+              << "," << recall_value << "," << nn_recall << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 2 && argc != 4 && argc != 5) {
+        std::cout << "please run commond: ./match_benchmark thread_num [img_query img_train] [ratio]" << std::endl;
+        return -1;
+    }
+    omp_set_num_threads(atoi(argv[1]));
+    std::string path_q = argc >= 4 ? argv[2] : "../photos/data/mountain_left.jpg";
+    std::string path_t = argc >= 4 ? argv[3] : "../photos/data/mountain_center.jpg";
+    const float ratio = argc == 5 ? static_cast<float>(atof(argv[4])) : 0.8f;
+
+    cv::Mat img_q = cv::imread(path_q);
+    cv::Mat img_t = cv::imread(path_t);
+    if (img_q.empty() || img_t.empty()) {
+        std::cerr << "Could not load images." << std::endl;
+        return -1;
+    }
+    FeatureCache::instance().setDirectory("../results/feature_cache");
+    ImageFeatures fq = detectSIFTFeatures(img_q);
+    ImageFeatures ft = detectSIFTFeatures(img_t);
+    std::cerr << "descriptors: " << fq.descriptors.rows << " x " << ft.descriptors.rows << std::endl;
+
+    std::cout << "matcher,checks,time_ms,matches,matches_per_s,recall,nn_recall" << std::endl;
+
+    // 1. OpenCV baseline, the matcher genSIFTMatches used originally
+    std::vector<cv::DMatch> cv_matches;
+    double cv_ms = timeMs([&] {
+        cv::BFMatcher matcher(cv::NORM_L2, true);
+        matcher.match(fq.descriptors, ft.descriptors, cv_matches);
+    });
+    printRow("cv_bfmatcher", 0, cv_ms, cv_matches.size(), 1.0, 1.0);
+
+    // 2. exact references
+    MatcherOptions exact;
+    exact.ratio = ratio;
+    std::vector<cv::DMatch> truth;
+    double bf_ms = timeMs([&] { truth = matchDescriptors(fq.descriptors, ft.descriptors, exact); });
+    printRow("bruteforce", 0, bf_ms, truth.size(), 1.0, 1.0);
+
+    MatcherOptions exact_nn;
+    exact_nn.cross_check = false;
+    std::vector<cv::DMatch> truth_nn = matchDescriptors(fq.descriptors, ft.descriptors, exact_nn);
+
+    // 3. approximate indexes over the speed/recall knob
+    for (MatcherType type : {MatcherType::KDForest, MatcherType::KMeansTree}) {
+        for (int checks : {16, 32, 64, 128, 256, 512, 1024}) {
+            MatcherOptions options;
+            options.type = type;
+            options.ratio = ratio;
+            options.checks = checks;
+            std::vector<cv::DMatch> matches;
+            double ms = timeMs([&] { matches = matchDescriptors(fq.descriptors, ft.descriptors, options); });
+
+            MatcherOptions nn_options = options;
+            nn_options.ratio = 1.0f;
+            nn_options.cross_check = false;
+            std::vector<cv::DMatch> nn = matchDescriptors(fq.descriptors, ft.descriptors, nn_options);
+            printRow(matcherTypeName(type), checks, ms, matches.size(), recall(matches, truth), recall(nn, truth_nn));
+        }
+    }
+    return 0;
+}
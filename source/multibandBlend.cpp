@@ -0,0 +1,363 @@
+#include "multibandBlend.h"
+#include "profiler.h"
+#include "taskGraph.h"
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+namespace {
+
+// Rows per OpenMP task of the per-level passes (a few hundred KB of a wide level)
+constexpr int kTileRows = 32;
+
+template <typename F>
+void forEachRowTile(int rows, F&& f) {
+    const int tiles = (rows + kTileRows - 1) / kTileRows;
+    parallelFor(LoopStage::MultibandTiles, tiles, 1, [&](int t) {
+        const int end = std::min(rows, (t + 1) * kTileRows);
+        for (int y = t * kTileRows; y < end; ++y) {
+            f(y);
+        }
+    });
+}
+
+// Size of level k of an image (pyrDown rounds up)
+cv::Size levelSize(cv::Size size, int k) {
+    return cv::Size((size.width + (1 << k) - 1) >> k, (size.height + (1 << k) - 1) >> k);
+}
+
+// Number of levels that keeps the coarsest level at least 2 pixels wide
+int usableLevels(cv::Size size, int levels) {
+    int k = 0;
+    while (k < levels && std::min(size.width, size.height) >> (k + 1) >= 2) {
+        ++k;
+    }
+    return k;
+}
+
+std::vector<cv::Mat> gaussianPyramid(const cv::Mat& img, int levels) {
+    std::vector<cv::Mat> pyr(levels + 1);
+    pyr[0] = img;
+    for (int k = 0; k < levels; ++k) {
+        cv::pyrDown(pyr[k], pyr[k + 1]);
+    }
+    return pyr;
+}
+
+std::vector<cv::Mat> laplacianPyramid(const cv::Mat& img, int levels) {
+    std::vector<cv::Mat> pyr = gaussianPyramid(img, levels);
+    for (int k = 0; k < levels; ++k) {
+        cv::Mat up;
+        cv::pyrUp(pyr[k + 1], up, pyr[k].size());
+        pyr[k] = pyr[k] - up;
+    }
+    return pyr;
+}
+
+cv::Mat collapse(const std::vector<cv::Mat>& pyr) {
+    cv::Mat out = pyr.back().clone();
+    for (int k = static_cast<int>(pyr.size()) - 2; k >= 0; --k) {
+        cv::Mat up;
+        cv::pyrUp(out, up, pyr[k].size());
+        out = up + pyr[k];
+    }
+    return out;
+}
+
+// Fill the pixels outside mask (CV_8U) with a smooth extension of the valid ones (push-pull on a Gaussian pyramid),
+// so the Laplacian bands near the border of an image do not see the step to black
+cv::Mat fillHoles(const cv::Mat& img, const cv::Mat& mask, int levels) {
+    cv::Mat m;
+    mask.convertTo(m, CV_32F, 1.0 / 255.0);
+    cv::Mat masked = img.clone();
+    forEachRowTile(img.rows, [&](int y) {
+        float* p = masked.ptr<float>(y);
+        const float* w = m.ptr<float>(y);
+        for (int x = 0; x < img.cols; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                p[3 * x + c] *= w[x];
+            }
+        }
+    });
+    std::vector<cv::Mat> I = gaussianPyramid(masked, levels);
+    std::vector<cv::Mat> M = gaussianPyramid(m, levels);
+
+    // coarsest level: normalized average of the valid pixels
+    cv::Mat filled = I[levels].clone();
+    for (int y = 0; y < filled.rows; ++y) {
+        float* p = filled.ptr<float>(y);
+        const float* w = M[levels].ptr<float>(y);
+        for (int x = 0; x < filled.cols; ++x) {
+            const float inv = w[x] > 1e-6f ? 1.0f / w[x] : 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                p[3 * x + c] *= inv;
+            }
+        }
+    }
+    // finer levels: I_k + (1 - M_k) * upsampled fill (I_k already carries the weight M_k)
+    for (int k = levels - 1; k >= 0; --k) {
+        cv::Mat up;
+        cv::pyrUp(filled, up, I[k].size());
+        forEachRowTile(up.rows, [&](int y) {
+            float* u = up.ptr<float>(y);
+            const float* i = I[k].ptr<float>(y);
+            const float* w = M[k].ptr<float>(y);
+            for (int x = 0; x < up.cols; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    u[3 * x + c] = i[3 * x + c] + (1.0f - w[x]) * u[3 * x + c];
+                }
+            }
+        });
+        filled = up;
+    }
+    return filled;
+}
+
+// Seam mask of "mine" against "other" (CV_8U masks): 1 where mine is valid and either other is not,
+// or mine's border is farther away (ties go to mine if win_ties)
+cv::Mat seamMask(const cv::Mat& mine, const cv::Mat& other, bool win_ties) {
+    cv::Mat d_mine, d_other;
+    cv::distanceTransform(mine, d_mine, cv::DIST_L2, 3);
+    cv::distanceTransform(other, d_other, cv::DIST_L2, 3);
+    cv::Mat seam(mine.size(), CV_32F);
+    forEachRowTile(mine.rows, [&](int y) {
+        const uchar* a = mine.ptr<uchar>(y);
+        const uchar* b = other.ptr<uchar>(y);
+        const float* da = d_mine.ptr<float>(y);
+        const float* db = d_other.ptr<float>(y);
+        float* s = seam.ptr<float>(y);
+        for (int x = 0; x < mine.cols; ++x) {
+            const bool wins = !b[x] || (win_ties ? da[x] >= db[x] : da[x] > db[x]);
+            s[x] = a[x] && wins ? 1.0f : 0.0f;
+        }
+    });
+    return seam;
+}
+
+} // namespace
+
+cv::Mat multibandBlendPair(const cv::Mat& img1, const cv::Mat& mask1, const cv::Mat& img2, const cv::Mat& mask2, int levels) {
+    if (img1.type() != CV_32FC3 || img2.type() != CV_32FC3 || mask1.type() != CV_8U || mask2.type() != CV_8U) {
+        throw std::invalid_argument("Error: multiband blending needs CV_32FC3 images and CV_8U masks.");
+    }
+    cv::Mat m1 = mask1 != 0;
+    cv::Mat m2 = mask2 != 0;
+
+    // 1. outside the overlap every pixel comes from the only image that covers it
+    cv::Mat out = cv::Mat::zeros(img1.size(), img1.type());
+    img2.copyTo(out, m2);
+    img1.copyTo(out, m1);
+
+    cv::Mat overlap = m1 & m2;
+    cv::Rect bbox = cv::boundingRect(overlap);
+    if (bbox.empty()) {
+        return out;
+    }
+
+    // 2. pyramids on the overlap padded by the support of the coarsest level
+    const int margin = 2 << levels;
+    const cv::Rect window = cv::Rect(bbox.x - margin, bbox.y - margin, bbox.width + 2 * margin, bbox.height + 2 * margin) &
+                            cv::Rect(0, 0, img1.cols, img1.rows);
+    const int n_levels = usableLevels(window.size(), levels);
+    const cv::Mat w_m1 = m1(window), w_m2 = m2(window);
+
+    // both images are completed with the other one (or a smooth extension) outside their mask,
+    // so the bands only differ where the images really differ
+    cv::Mat uni = w_m1 | w_m2;
+    cv::Mat base = out(window).clone();
+    cv::Mat filled = fillHoles(base, uni, n_levels);
+    cv::Mat f1 = filled.clone(), f2 = filled.clone();
+    img1(window).copyTo(f1, w_m1);
+    img2(window).copyTo(f2, w_m2);
+
+    std::vector<cv::Mat> L1 = laplacianPyramid(f1, n_levels);
+    std::vector<cv::Mat> L2 = laplacianPyramid(f2, n_levels);
+    std::vector<cv::Mat> G = gaussianPyramid(seamMask(w_m1, w_m2, true), n_levels);
+
+    // 3. blend every band with the smoothed seam of its level: L = L2 + (L1 - L2) * G
+    for (int k = 0; k <= n_levels; ++k) {
+        cv::Mat& l1 = L1[k];
+        const cv::Mat& l2 = L2[k];
+        const cv::Mat& g = G[k];
+        forEachRowTile(l1.rows, [&](int y) {
+            float* a = l1.ptr<float>(y);
+            const float* b = l2.ptr<float>(y);
+            const float* w = g.ptr<float>(y);
+            for (int x = 0; x < l1.cols; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    a[3 * x + c] = b[3 * x + c] + (a[3 * x + c] - b[3 * x + c]) * w[x];
+                }
+            }
+        });
+    }
+    cv::Mat blended = collapse(L1);
+
+    // 4. write the window back, clamped to the valid range, empty pixels stay 0
+    cv::Mat out_w = out(window);
+    forEachRowTile(window.height, [&](int y) {
+        const float* r = blended.ptr<float>(y);
+        const uchar* u = uni.ptr<uchar>(y);
+        float* o = out_w.ptr<float>(y);
+        for (int x = 0; x < window.width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                o[3 * x + c] = u[x] ? std::min(1.0f, std::max(0.0f, r[3 * x + c])) : 0.0f;
+            }
+        }
+    });
+    return out;
+}
+
+MultibandCanvas::MultibandCanvas(int levels) : levels_(std::max(0, levels)) {}
+
+void MultibandCanvas::reset(cv::Size size) {
+    acc_.assign(levels_ + 1, cv::Mat());
+    weight_.assign(levels_ + 1, cv::Mat());
+    for (int k = 0; k <= levels_; ++k) {
+        acc_[k] = cv::Mat::zeros(levelSize(size, k), CV_32FC3);
+        weight_[k] = cv::Mat::zeros(levelSize(size, k), CV_32F);
+    }
+    coverage_ = cv::Mat::zeros(size, CV_8U);
+    rendered_ = cv::Mat::zeros(size, CV_8UC3);
+}
+
+void MultibandCanvas::grow(int left, int top, cv::Size new_size) {
+    if (left % alignment() != 0 || top % alignment() != 0) {
+        throw std::invalid_argument("Error: canvas offsets must be multiples of MultibandCanvas::alignment().");
+    }
+    if (left + coverage_.cols > new_size.width || top + coverage_.rows > new_size.height) {
+        throw std::invalid_argument("Error: the grown canvas must contain the current one.");
+    }
+    if (left == 0 && top == 0 && new_size == coverage_.size()) {
+        return;
+    }
+    // the stored levels are moved, not rebuilt: level k shifts by (left, top) / 2^k exactly
+    for (int k = 0; k <= levels_; ++k) {
+        cv::Mat acc = cv::Mat::zeros(levelSize(new_size, k), CV_32FC3);
+        cv::Mat weight = cv::Mat::zeros(levelSize(new_size, k), CV_32F);
+        const cv::Rect dst(left >> k, top >> k, acc_[k].cols, acc_[k].rows);
+        acc_[k].copyTo(acc(dst));
+        weight_[k].copyTo(weight(dst));
+        acc_[k] = acc;
+        weight_[k] = weight;
+    }
+    cv::Mat coverage = cv::Mat::zeros(new_size, CV_8U);
+    cv::Mat rendered = cv::Mat::zeros(new_size, CV_8UC3);
+    coverage_.copyTo(coverage(cv::Rect(left, top, coverage_.cols, coverage_.rows)));
+    rendered_.copyTo(rendered(cv::Rect(left, top, rendered_.cols, rendered_.rows)));
+    coverage_ = coverage;
+    rendered_ = rendered;
+}
+
+void MultibandCanvas::feed(const cv::Mat& img, const cv::Mat& mask, const cv::Rect& roi) {
+    const cv::Rect canvas_rect(0, 0, coverage_.cols, coverage_.rows);
+    if ((img.type() != CV_32FC3 && img.type() != CV_8UC3) || mask.type() != CV_8U || img.size() != roi.size() || mask.size() != roi.size()) {
+        throw std::invalid_argument("Error: img must be CV_32FC3 or CV_8UC3 and mask CV_8U, both of the size of roi.");
+    }
+    if ((roi & canvas_rect) != roi) {
+        throw std::invalid_argument("Error: roi must lie inside the canvas.");
+    }
+    if (roi.empty()) {
+        return;
+    }
+
+    // 1. window: footprint padded by the support of the coarsest level, origin aligned to the level grid
+    const int a = alignment();
+    const int margin = 2 << levels_;
+    const int x0 = std::max(0, roi.x - margin) / a * a;
+    const int y0 = std::max(0, roi.y - margin) / a * a;
+    const int x1 = std::min(canvas_rect.width, roi.x + roi.width + margin);
+    const int y1 = std::min(canvas_rect.height, roi.y + roi.height + margin);
+    const cv::Rect window(x0, y0, x1 - x0, y1 - y0);
+    const cv::Rect local_roi(roi.x - x0, roi.y - y0, roi.width, roi.height);
+
+    cv::Mat img_w = cv::Mat::zeros(window.size(), CV_32FC3);
+    cv::Mat mask_w = cv::Mat::zeros(window.size(), CV_8U);
+    if (img.type() == CV_8UC3) {
+        cv::Mat img_roi = img_w(local_roi);
+        img.convertTo(img_roi, CV_32FC3, 1.0 / 255.0);
+    } else {
+        img.copyTo(img_w(local_roi));
+    }
+    cv::Mat(mask != 0).copyTo(mask_w(local_roi));
+
+    // 2. bands of the new image and its smoothed seam against the canvas content
+    std::vector<cv::Mat> L, G;
+    {
+        PROFILE_SCOPE("multiband.pyramids");
+        cv::Mat seam = seamMask(mask_w, coverage_(window), false);
+        L = laplacianPyramid(fillHoles(img_w, mask_w, levels_), levels_);
+        G = gaussianPyramid(seam, levels_);
+    }
+
+    // 3. blend into the stored canvas levels: acc = acc * (1 - g) + L * g, weight = weight * (1 - g) + g
+    {
+        PROFILE_SCOPE("multiband.blend");
+        for (int k = 0; k <= levels_; ++k) {
+            const cv::Rect rect(x0 >> k, y0 >> k, L[k].cols, L[k].rows);
+            cv::Mat acc = acc_[k](rect);
+            cv::Mat weight = weight_[k](rect);
+            const cv::Mat& l = L[k];
+            const cv::Mat& g = G[k];
+            forEachRowTile(rect.height, [&](int y) {
+                float* A = acc.ptr<float>(y);
+                float* W = weight.ptr<float>(y);
+                const float* b = l.ptr<float>(y);
+                const float* w = g.ptr<float>(y);
+                for (int x = 0; x < rect.width; ++x) {
+                    const float keep = 1.0f - w[x];
+                    for (int c = 0; c < 3; ++c) {
+                        A[3 * x + c] = A[3 * x + c] * keep + b[3 * x + c] * w[x];
+                    }
+                    W[x] = W[x] * keep + w[x];
+                }
+            });
+        }
+        cv::Mat coverage_w = coverage_(window);
+        cv::bitwise_or(coverage_w, mask_w, coverage_w);
+    }
+
+    // 4. re-render the window: the coarse levels changed over all of it. The collapse reads the levels up to
+    //    the support of the coarsest level around a pixel, so it runs on the window padded by another margin.
+    const int rx0 = std::max(0, x0 - margin) / a * a;
+    const int ry0 = std::max(0, y0 - margin) / a * a;
+    const cv::Rect padded(rx0, ry0, std::min(canvas_rect.width, x1 + margin) - rx0, std::min(canvas_rect.height, y1 + margin) - ry0);
+    render(padded, window);
+}
+
+void MultibandCanvas::render(const cv::Rect& window, const cv::Rect& target) {
+    PROFILE_SCOPE("multiband.render");
+    std::vector<cv::Mat> bands(levels_ + 1);
+    for (int k = 0; k <= levels_; ++k) {
+        const cv::Size size = levelSize(window.size(), k);
+        const cv::Rect rect(window.x >> k, window.y >> k, size.width, size.height);
+        const cv::Mat acc = acc_[k](rect);
+        const cv::Mat weight = weight_[k](rect);
+        cv::Mat band(size, CV_32FC3);
+        forEachRowTile(size.height, [&](int y) {
+            const float* A = acc.ptr<float>(y);
+            const float* W = weight.ptr<float>(y);
+            float* o = band.ptr<float>(y);
+            for (int x = 0; x < size.width; ++x) {
+                const float inv = W[x] > 1e-6f ? 1.0f / W[x] : 0.0f;
+                for (int c = 0; c < 3; ++c) {
+                    o[3 * x + c] = A[3 * x + c] * inv;
+                }
+            }
+        });
+        bands[k] = band;
+    }
+    cv::Mat img = collapse(bands);
+
+    const int off_x = target.x - window.x;
+    const int off_y = target.y - window.y;
+    forEachRowTile(target.height, [&](int y) {
+        const float* r = img.ptr<float>(off_y + y) + off_x * 3;
+        const uchar* m = coverage_.ptr<uchar>(target.y + y) + target.x;
+        uchar* o = rendered_.ptr<uchar>(target.y + y) + target.x * 3;
+        for (int x = 0; x < target.width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                o[3 * x + c] = m[x] ? cv::saturate_cast<uchar>(r[3 * x + c] * 255.0f) : 0;
+            }
+        }
+    });
+}
@@ -0,0 +1,54 @@
+#ifndef MULTIBAND_BLEND_H
+#define MULTIBAND_BLEND_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Default number of pyramid levels (bands - 1) of the multiband blender
+constexpr int kDefaultBandLevels = 5;
+
+// Multiband (Laplacian pyramid) blend of two images, blendImagePair mode "multiband".
+// img1, img2: CV_32FC3, range [0.0f, 1.0f]; mask1, mask2: CV_8U, non-zero = valid
+// The pyramids are only built on the overlap of the masks, padded by the support of the coarsest level;
+// every other pixel is copied from the image that covers it. Inside the overlap the seam follows
+// the distance transforms (each pixel goes to the image whose border is farther away), and every band
+// is blended with the Gaussian-smoothed seam mask of its level.
+cv::Mat multibandBlendPair(const cv::Mat& img1, const cv::Mat& mask1, const cv::Mat& img2, const cv::Mat& mask2,
+                           int levels = kDefaultBandLevels);
+
+// Multiband panorama blender for the stitching pipeline.
+// Keeps the weighted Laplacian pyramid of the accumulated canvas, so adding an image only builds the
+// pyramid of that image on its footprint and blends it into the stored levels; the canvas itself is
+// never decomposed again. After every image the 8-bit canvas is re-rendered on the window whose levels changed.
+class MultibandCanvas {
+public:
+    explicit MultibandCanvas(int levels = kDefaultBandLevels);
+
+    // Canvas offsets passed to grow() must be multiples of this, so the stored levels stay aligned
+    int alignment() const { return 1 << levels_; }
+
+    // Empty canvas of the given size
+    void reset(cv::Size size);
+    // Enlarge the canvas to new_size, moving the current content by (left, top) (multiples of alignment())
+    void grow(int left, int top, cv::Size new_size);
+
+    // Blend an image into the canvas.
+    // img: CV_32FC3, range [0.0f, 1.0f], or CV_8UC3, covering roi of the canvas; mask: CV_8U of the same size, non-zero = valid
+    void feed(const cv::Mat& img, const cv::Mat& mask, const cv::Rect& roi);
+
+    // Rendered panorama (CV_8UC3, empty pixels are 0)
+    const cv::Mat& canvas() const { return rendered_; }
+    // Pixels covered by at least one image (CV_8U, 0 or 255)
+    const cv::Mat& coverage() const { return coverage_; }
+
+private:
+    void render(const cv::Rect& window, const cv::Rect& target);
+
+    int levels_;
+    std::vector<cv::Mat> acc_;     // per level: sum of weight * Laplacian, CV_32FC3
+    std::vector<cv::Mat> weight_;  // per level: sum of weights, CV_32F
+    cv::Mat coverage_;
+    cv::Mat rendered_;
+};
+
+#endif // MULTIBAND_BLEND_H
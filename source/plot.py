@@ -1,4 +1,5 @@
 import matplotlib.pyplot as plt
+import csv
 import os
 
 # Function to plot the time cost and save the result to a PDF
@@ -30,12 +31,47 @@ def plot_time_cost(file_name, output_pdf):
     # Close the plot to avoid overlap in subsequent plots
     plt.clf()
 
+# Function to plot the per-stage time of one benchmark configuration from the stitch_image reports
+# report_dir holds threads_<n>.csv files written by "./stitch_image <n> <report_dir>/threads_<n>"
+def plot_stage_breakdown(report_dir, output_pdf):
+    stage_times = {}  # stage -> {threads: ms}
+    for file in os.listdir(report_dir):
+        if not file.endswith('.csv'):
+            continue
+        with open(os.path.join(report_dir, file), 'r') as f:
+            for row in csv.DictReader(f):
+                if row['kind'] != 'time_ms' or row['name'] in ('iteration', 'total'):
+                    continue
+                threads = int(row['threads'])
+                per_thread = stage_times.setdefault(row['name'], {})
+                per_thread[threads] = per_thread.get(threads, 0.0) + float(row['value'])
+
+    for stage, per_thread in sorted(stage_times.items()):
+        threads = sorted(per_thread.keys())
+        plt.plot(threads, [per_thread[t] for t in threads], marker='o', label=stage)
+
+    plt.xlabel('Number of Threads')
+    plt.ylabel('Time Cost (ms)')
+    plt.title('Stage Time vs. Threads - {}'.format(os.path.basename(report_dir)))
+    plt.grid(True)
+    plt.legend(fontsize='small')
+    plt.savefig(output_pdf)
+    plt.clf()
+
 file_names = []
 # Example usage with different files
-for root, _, files in os.walk("../results/"):
-    for file in files:
+for file in os.listdir("../results/"):
+    if file.endswith('.txt'):
         file_name = os.path.splitext(file)[0]
         file_names.append(file_name)
 print(file_names)
 for name in file_names:
-    plot_time_cost('../results/{}.txt'.format(name), '../results/{}.pdf'.format(name))
\ No newline at end of file
+    plot_time_cost('../results/{}.txt'.format(name), '../results/{}.pdf'.format(name))
+
+# Per-stage breakdown, one plot per benchmark configuration
+profile_root = "../results/profile/"
+if os.path.isdir(profile_root):
+    for config in sorted(os.listdir(profile_root)):
+        report_dir = os.path.join(profile_root, config)
+        if os.path.isdir(report_dir):
+            plot_stage_breakdown(report_dir, os.path.join(profile_root, '{}_stages.pdf'.format(config)))
\ No newline at end of file
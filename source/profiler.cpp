@@ -0,0 +1,153 @@
+#include "profiler.h"
+#include <fstream>
+#include <map>
+#include <utility>
+#include <omp.h>
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+thread_local int Profiler::iteration_ = -1;
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::enable(bool on) {
+    enabled_.store(on, std::memory_order_relaxed);
+}
+
+void Profiler::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    records_.clear();
+    iteration_ = -1;
+}
+
+void Profiler::setIteration(int iteration) {
+    iteration_ = iteration;
+}
+
+void Profiler::addTime(const std::string& stage, double ms) {
+    if (!enabled()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    records_.push_back({iteration_, "time_ms", stage, ms});
+}
+
+void Profiler::addCounter(const std::string& name, double value) {
+    if (!enabled()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    records_.push_back({iteration_, "counter", name, value});
+}
+
+std::vector<Profiler::Record> Profiler::records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+}
+
+namespace {
+
+// Name -> accumulated value, kept in first-seen order so the report follows the pipeline order
+using Accumulator = std::vector<std::pair<std::string, double>>;
+
+void accumulate(Accumulator& acc, const std::string& name, double value) {
+    for (auto& entry : acc) {
+        if (entry.first == name) {
+            entry.second += value;
+            return;
+        }
+    }
+    acc.emplace_back(name, value);
+}
+
+void writeObject(std::ofstream& out, const Accumulator& acc) {
+    out << "{";
+    for (size_t i = 0; i < acc.size(); ++i) {
+        out << (i ? ", " : "") << "\"" << acc[i].first << "\": " << acc[i].second;
+    }
+    out << "}";
+}
+
+} // namespace
+
+bool Profiler::writeJSON(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+
+    // 1. Aggregate records per iteration and over the whole run
+    std::vector<Record> records = this->records();
+    Accumulator total_times, total_counters;
+    std::map<int, std::pair<Accumulator, Accumulator>> per_iteration;
+    for (const Record& r : records) {
+        auto& slot = per_iteration[r.iteration];
+        if (r.kind == "time_ms") {
+            accumulate(total_times, r.name, r.value);
+            accumulate(slot.first, r.name, r.value);
+        } else {
+            accumulate(total_counters, r.name, r.value);
+            accumulate(slot.second, r.name, r.value);
+        }
+    }
+
+    // 2. Emit the report
+    out << "{\n";
+    out << "  \"threads\": " << omp_get_max_threads() << ",\n";
+    out << "  \"stages_ms\": ";
+    writeObject(out, total_times);
+    out << ",\n  \"counters\": ";
+    writeObject(out, total_counters);
+    out << ",\n  \"iterations\": [";
+    bool first = true;
+    for (const auto& [iteration, slot] : per_iteration) {
+        out << (first ? "\n" : ",\n") << "    {\"index\": " << iteration << ", \"timings_ms\": ";
+        writeObject(out, slot.first);
+        out << ", \"counters\": ";
+        writeObject(out, slot.second);
+        out << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+bool Profiler::writeCSV(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    int threads = omp_get_max_threads();
+    out << "threads,iteration,kind,name,value\n";
+    for (const Record& r : records()) {
+        out << threads << "," << r.iteration << "," << r.kind << "," << r.name << "," << r.value << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+ScopedIteration::ScopedIteration(int iteration) : previous_(Profiler::instance().iteration()) {
+    Profiler::instance().setIteration(iteration);
+}
+
+ScopedIteration::~ScopedIteration() {
+    Profiler::instance().setIteration(previous_);
+}
+
+ScopedTimer::ScopedTimer(const char* name)
+    : name_(name), active_(Profiler::instance().enabled()) {
+    if (active_) {
+        start_ = high_resolution_clock::now();
+    }
+}
+
+ScopedTimer::~ScopedTimer() {
+    stop();
+}
+
+void ScopedTimer::stop() {
+    if (active_) {
+        auto elapsed = std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start_);
+        Profiler::instance().addTime(name_, elapsed.count());
+        active_ = false;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Lightweight instrumentation layer for the stitching pipeline.
+// Stages record wall-clock time with ScopedTimer, and interesting sizes (keypoints, matches,
+// inliers, canvas pixels ...) with Profiler::addCounter. Every record is tagged with the
+// stitch iteration of the recording thread, so the report shows how each stage behaves as the canvas grows.
+// The iteration is per thread: concurrent stitches (batch workers, pipeline tasks) tag their own records.
+// Recording is a no-op until the profiler is enabled, so the default binary pays nothing.
+class Profiler {
+public:
+    struct Record {
+        int iteration;      // stitch iteration (image index), -1 for whole-run records
+        std::string kind;   // "time_ms" or "counter"
+        std::string name;   // stage or counter name
+        double value;
+    };
+
+    static Profiler& instance();
+
+    void enable(bool on);
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+    void reset();
+
+    // Tag subsequent records of the calling thread with the given stitch iteration (-1: not inside an iteration)
+    void setIteration(int iteration);
+    int iteration() const { return iteration_; }
+
+    void addTime(const std::string& stage, double ms);
+    void addCounter(const std::string& name, double value);
+
+    std::vector<Record> records() const;
+
+    // Report writers, return false if the file could not be opened
+    bool writeJSON(const std::string& path) const;
+    bool writeCSV(const std::string& path) const;
+
+private:
+    Profiler() = default;
+
+    std::atomic<bool> enabled_{false};
+    static thread_local int iteration_;
+    mutable std::mutex mutex_;
+    std::vector<Record> records_;
+};
+
+// RAII iteration tag: records of the calling thread inside the scope belong to iteration, the previous tag is
+// restored at the end. Tasks that run on other threads than the loop that spawned them tag themselves with it.
+class ScopedIteration {
+public:
+    explicit ScopedIteration(int iteration);
+    ~ScopedIteration();
+
+    ScopedIteration(const ScopedIteration&) = delete;
+    ScopedIteration& operator=(const ScopedIteration&) = delete;
+
+private:
+    int previous_;
+};
+
+// RAII timer: records the elapsed time of its scope as stage "name".
+// stop() ends the measurement early, for stages that do not map onto a C++ scope.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char* name);
+    ~ScopedTimer();
+
+    void stop();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    const char* name_;
+    bool active_;
+    std::chrono::high_resolution_clock::time_point start_;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+#endif // PROFILER_H
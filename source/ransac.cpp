@@ -3,86 +3,221 @@
 #include "helper.h"
 #include "backwardWarpImg.h"
 #include "common.h"
+#include "profiler.h"
+#include "loopTuning.h"
+#include "taskGraph.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d.hpp>
 #include <iostream>
 #include <random>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
 #include <omp.h>
 
+namespace {
+
+// Points scored between two checks of the early bail-out
+constexpr int kScoreBlock = 256;
+
+// Twice the area (pixels^2) below which three sample points count as collinear
+constexpr double kDegenerateArea = 1.0;
+
+// Correspondences as structure-of-arrays, so the scoring loop vectorizes
+struct PointsSoA {
+    std::vector<double> xs, ys, xd, yd;
+};
+
+// Number of correspondences that H (row-major) maps within sqrt(eps2) of their destination.
+// Returns -1 as soon as the count can no longer exceed to_beat.
+int countInliers(const double* H, const PointsSoA& pts, double eps2, int to_beat) {
+    const int n = static_cast<int>(pts.xs.size());
+    const double* xs = pts.xs.data();
+    const double* ys = pts.ys.data();
+    const double* xd = pts.xd.data();
+    const double* yd = pts.yd.data();
+    int count = 0;
+    for (int b = 0; b < n; b += kScoreBlock) {
+        const int e = std::min(n, b + kScoreBlock);
+        int block_count = 0;
+        #pragma omp simd reduction(+:block_count)
+        for (int j = b; j < e; ++j) {
+            double w = H[6] * xs[j] + H[7] * ys[j] + H[8];
+            double dx = (H[0] * xs[j] + H[1] * ys[j] + H[2]) / w - xd[j];
+            double dy = (H[3] * xs[j] + H[4] * ys[j] + H[5]) / w - yd[j];
+            block_count += (dx * dx + dy * dy < eps2) ? 1 : 0;
+        }
+        count += block_count;
+        if (count + (n - e) <= to_beat) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+// True if any three of the four points are (nearly) collinear
+bool degenerateSample(const Eigen::Vector2d p[4]) {
+    static const int triples[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
+    for (const auto& t : triples) {
+        Eigen::Vector2d u = p[t[1]] - p[t[0]];
+        Eigen::Vector2d v = p[t[2]] - p[t[0]];
+        if (std::abs(u.x() * v.y() - u.y() * v.x()) < kDegenerateArea) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hypotheses needed to draw one all-inlier sample with the given confidence
+int requiredIterations(int inliers, int n, double confidence, int max_iterations) {
+    const double w4 = std::pow(static_cast<double>(inliers) / n, 4);
+    if (w4 >= 1.0) {
+        return 1;
+    }
+    const double denom = std::log1p(-w4);
+    if (denom >= 0.0) {
+        return max_iterations;
+    }
+    const double k = std::ceil(std::log(1.0 - confidence) / denom);
+    return static_cast<int>(std::min<double>(k, max_iterations));
+}
+
+} // namespace
+
 std::pair<std::vector<bool>, Eigen::Matrix3d> runRANSAC(
     const std::vector<Eigen::Vector2d>& src_pt,
     const std::vector<Eigen::Vector2d>& dest_pt,
     int ransac_n,
-    double eps) {
-    
-    std::vector<int> best_point;
-    Eigen::Matrix3d best_H;
-    
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, src_pt.size() - 1);
-
-    #pragma omp parallel
-    {
-        // thread-private variable
-        std::vector<int> local_best_point;
-        Eigen::Matrix3d local_best_H;
-
-        // Creating a thread-private random number generator
-        std::mt19937 local_gen(rd() + omp_get_thread_num());
-
-
-        #pragma omp for 
-        for (int i = 0; i < ransac_n; ++i) {
-            // Randomly select 4 points
-            std::vector<int> idx(4);
-            for (int& id : idx) {
-                id = dis(local_gen);
-            }
+    double eps,
+    double confidence,
+    unsigned seed) {
+    if (src_pt.size() != dest_pt.size()) {
+        throw std::invalid_argument("Error: src_pt and dest_pt must have the same size.");
+    }
+    if (src_pt.size() < 4) {
+        throw std::invalid_argument("Error: RANSAC needs at least 4 correspondences.");
+    }
+    const int n = static_cast<int>(src_pt.size());
+    const double eps2 = eps * eps;
 
-            std::vector<Eigen::Vector2d> src(4);
-            std::vector<Eigen::Vector2d> dest(4);
-            for (int j = 0; j < 4; ++j) {
-                src[j] = src_pt[idx[j]];
-                dest[j] = dest_pt[idx[j]];
-            }
+    PointsSoA pts;
+    pts.xs.resize(n);
+    pts.ys.resize(n);
+    pts.xd.resize(n);
+    pts.yd.resize(n);
+    for (int j = 0; j < n; ++j) {
+        pts.xs[j] = src_pt[j].x();
+        pts.ys[j] = src_pt[j].y();
+        pts.xd[j] = dest_pt[j].x();
+        pts.yd[j] = dest_pt[j].y();
+    }
+
+    // shared state: next hypothesis index, adaptive iteration limit, best inlier count so far
+    std::atomic<int> next_iteration(0);
+    std::atomic<int> iteration_limit(ransac_n);
+    std::atomic<int> best_count(0);
+    std::atomic<int> degenerate(0);
 
-            // Compute homography
-            Eigen::Matrix3d H = computeHomography(src, dest);
+    const unsigned base_seed = seed ? seed : std::random_device()();
 
-            // Apply homography
-            std::vector<Eigen::Vector2d> dest_hat = applyHomography(H, src_pt);
+    // workers and hypotheses claimed at a time of the RANSAC stage (see loopTuning.h).
+    // The workers run through parallelFor: inside a stitch task they become tasks of the running team.
+    LoopTuning& tuning = LoopTuning::instance();
+    const LoopSettings& settings = tuning.settings(LoopStage::Ransac);
+    const int chunk = std::max(1, settings.chunk);
+    const int workers = settings.threads > 0 ? std::min(settings.threads, omp_get_max_threads()) : omp_get_max_threads();
+    std::vector<int> worker_best(workers, 0);
+    std::vector<Eigen::Matrix3d> worker_H(workers, Eigen::Matrix3d::Identity());
+    const auto start_time = std::chrono::steady_clock::now();
 
-            // Find inliers
-            std::vector<int> valid_point;
-            for (size_t j = 0; j < dest_hat.size(); ++j) {
-                double distance = (dest_hat[j] - dest_pt[j]).norm();
-                if (distance < eps) {
-                    valid_point.push_back(j);
+    parallelFor(workers, 1, [&](int w) {
+        // worker-private variables and sample buffers
+        int local_best = 0;
+        Eigen::Matrix3d local_best_H = Eigen::Matrix3d::Identity();
+        Eigen::Vector2d src[4], dest[4];
+        int idx[4];
+
+        // Creating a worker-private random number generator and distribution (distributions may keep state)
+        std::mt19937 local_gen(base_seed + w);
+        std::uniform_int_distribution<> dis(0, n - 1);
+
+        int first;
+        while ((first = next_iteration.fetch_add(chunk, std::memory_order_relaxed)) < iteration_limit.load(std::memory_order_relaxed)) {
+            for (int iteration = first; iteration < first + chunk && iteration < iteration_limit.load(std::memory_order_relaxed); ++iteration) {
+                // 1. Randomly select 4 distinct points, skip degenerate samples
+                for (int j = 0; j < 4; ++j) {
+                    bool repeated;
+                    do {
+                        idx[j] = dis(local_gen);
+                        repeated = false;
+                        for (int k = 0; k < j; ++k) {
+                            repeated = repeated || idx[k] == idx[j];
+                        }
+                    } while (repeated);
+                    src[j] = src_pt[idx[j]];
+                    dest[j] = dest_pt[idx[j]];
+                }
+                if (degenerateSample(src) || degenerateSample(dest)) {
+                    degenerate.fetch_add(1, std::memory_order_relaxed);
+                    continue;
                 }
-            }
 
-            // Update thread local best result
-            if (valid_point.size() > local_best_point.size()) {
-                local_best_point = valid_point;
+                // 2. Compute homography (minimal solver) and score it, giving up once it cannot beat the best hypothesis of any worker
+                Eigen::Matrix3d H_sample;
+                if (!computeHomography4(src, dest, H_sample)) {
+                    degenerate.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                const Eigen::Matrix<double, 3, 3, Eigen::RowMajor> H = H_sample;
+                const int to_beat = std::max(local_best, best_count.load(std::memory_order_relaxed));
+                const int count = countInliers(H.data(), pts, eps2, to_beat);
+                if (count <= to_beat) {
+                    continue;
+                }
+
+                // 3. Update the worker best result, publish the count and shrink the iteration limit
+                local_best = count;
                 local_best_H = H;
+                int shared = best_count.load(std::memory_order_relaxed);
+                while (count > shared && !best_count.compare_exchange_weak(shared, count, std::memory_order_relaxed)) {
+                }
+                const int needed = requiredIterations(count, n, confidence, ransac_n);
+                int limit = iteration_limit.load(std::memory_order_relaxed);
+                while (needed < limit && !iteration_limit.compare_exchange_weak(limit, needed, std::memory_order_relaxed)) {
+                }
             }
         }
-        // Using critical sections to update the global optimal result
-        #pragma omp critical
-        {
-            if (local_best_point.size() > best_point.size()) {
-                best_point = local_best_point;
-                best_H = local_best_H;
-            }
+        worker_best[w] = local_best;
+        worker_H[w] = local_best_H;
+    });
+
+    // best hypothesis over the workers, the first one on ties
+    int best_inliers = 0;
+    Eigen::Matrix3d best_H = Eigen::Matrix3d::Identity();
+    for (int w = 0; w < workers; ++w) {
+        if (worker_best[w] > best_inliers) {
+            best_inliers = worker_best[w];
+            best_H = worker_H[w];
         }
     }
 
+    if (tuning.measuring()) {
+        tuning.record(LoopStage::Ransac, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
+    }
+    Profiler::instance().addCounter("ransac_iterations", std::min(next_iteration.load(), iteration_limit.load()));
+    Profiler::instance().addCounter("ransac_degenerate", degenerate.load());
+    Profiler::instance().addCounter("inliers", best_inliers);
+
     // Create inliers mask
-    std::vector<bool> inliers_mask(src_pt.size(), false);
-    #pragma omp parallel for 
-    for (int idx : best_point) {
-        inliers_mask[idx] = true;
+    const Eigen::Matrix<double, 3, 3, Eigen::RowMajor> H = best_H;
+    std::vector<bool> inliers_mask(n, false);
+    for (int j = 0; j < n; ++j) {
+        double w = H(2, 0) * pts.xs[j] + H(2, 1) * pts.ys[j] + H(2, 2);
+        double dx = (H(0, 0) * pts.xs[j] + H(0, 1) * pts.ys[j] + H(0, 2)) / w - pts.xd[j];
+        double dy = (H(1, 0) * pts.xs[j] + H(1, 1) * pts.ys[j] + H(1, 2)) / w - pts.yd[j];
+        inliers_mask[j] = dx * dx + dy * dy < eps2;
     }
 
     return {inliers_mask, best_H};
@@ -5,10 +5,18 @@
 #include <Eigen/Dense>
 #include <vector>
 
+// Robust homography from src_pt to dest_pt.
+// ransac_n is the maximum number of hypotheses: the search stops as soon as the inlier ratio of the best
+// hypothesis says that an all-inlier sample has been drawn with the given confidence.
+// seed: thread t samples with seed + t, 0 draws the seed from std::random_device (with a seed and one thread
+// the result is reproducible).
+// Returns the inlier mask (reprojection error < eps) and the best hypothesis.
 std::pair<std::vector<bool>, Eigen::Matrix3d> runRANSAC(
     const std::vector<Eigen::Vector2d>& src_pt,
     const std::vector<Eigen::Vector2d>& dest_pt,
     int ransac_n,
-    double eps);
+    double eps,
+    double confidence = 0.99,
+    unsigned seed = 0);
 
 #endif // RANSAC_H
\ No newline at end of file
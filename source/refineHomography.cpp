@@ -0,0 +1,214 @@
+#include "refineHomography.h"
+#include "homography.h"
+#include "profiler.h"
+#include "taskGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Below this many correspondences the residuals are evaluated on the calling thread
+constexpr int kParallelPoints = 2048;
+
+// Correspondences per task of the residual loops; block partial sums are added in block order
+constexpr int kPointBlock = 512;
+
+using Matrix8d = Eigen::Matrix<double, 8, 8>;
+using Vector8d = Eigen::Matrix<double, 8, 1>;
+
+// Partial sums of the normal equations over one block of correspondences
+struct NormalTerms {
+    Matrix8d A = Matrix8d::Zero();
+    Vector8d b = Vector8d::Zero();
+    double cost = 0.0;
+};
+
+// Reprojection cost of h (row-major H with H(2, 2) = 1) and, if JtJ is given, the Gauss-Newton normal equations.
+// Per-block accumulators, summed in block order.
+double normalEquations(const std::vector<Eigen::Vector2d>& src, const std::vector<Eigen::Vector2d>& dest,
+                       const Vector8d& h, Matrix8d* JtJ, Vector8d* Jtr) {
+    const int n = src.size();
+    const int blocks = (n + kPointBlock - 1) / kPointBlock;
+    std::vector<NormalTerms> partial(blocks);
+
+    auto accumulate = [&](int k) {
+        NormalTerms& terms = partial[k];
+        Eigen::Matrix<double, 2, 8> J;
+        const int end = std::min(n, (k + 1) * kPointBlock);
+        for (int i = k * kPointBlock; i < end; ++i) {
+            const double x = src[i].x(), y = src[i].y();
+            const double iw = 1.0 / (h[6] * x + h[7] * y + 1.0);
+            const double px = (h[0] * x + h[1] * y + h[2]) * iw;
+            const double py = (h[3] * x + h[4] * y + h[5]) * iw;
+            const Eigen::Vector2d r(px - dest[i].x(), py - dest[i].y());
+            terms.cost += r.squaredNorm();
+            if (JtJ) {
+                J << x * iw, y * iw, iw, 0.0, 0.0, 0.0, -x * px * iw, -y * px * iw,
+                     0.0, 0.0, 0.0, x * iw, y * iw, iw, -x * py * iw, -y * py * iw;
+                terms.A.noalias() += J.transpose() * J;
+                terms.b.noalias() += J.transpose() * r;
+            }
+        }
+    };
+    if (n >= kParallelPoints) {
+        parallelFor(blocks, 1, accumulate);
+    } else {
+        for (int k = 0; k < blocks; ++k) {
+            accumulate(k);
+        }
+    }
+
+    NormalTerms total;
+    for (const NormalTerms& terms : partial) {
+        total.A += terms.A;
+        total.b += terms.b;
+        total.cost += terms.cost;
+    }
+    if (JtJ) {
+        *JtJ = total.A;
+        *Jtr = total.b;
+    }
+    return total.cost;
+}
+
+std::vector<bool> scoreInliers(const std::vector<Eigen::Vector2d>& src_pt, const std::vector<Eigen::Vector2d>& dest_pt,
+                               const Eigen::Matrix3d& H, double eps, int& count) {
+    const int n = src_pt.size();
+    std::vector<char> inlier(n);
+    auto score = [&](int i) {
+        const Eigen::Vector3d p = H * src_pt[i].homogeneous();
+        inlier[i] = (p.hnormalized() - dest_pt[i]).squaredNorm() < eps * eps;
+    };
+    if (n >= kParallelPoints) {
+        parallelFor(n, kPointBlock, score);
+    } else {
+        for (int i = 0; i < n; ++i) {
+            score(i);
+        }
+    }
+    count = static_cast<int>(std::count(inlier.begin(), inlier.end(), 1));
+    return std::vector<bool>(inlier.begin(), inlier.end());
+}
+
+} // namespace
+
+Eigen::Matrix3d levenbergMarquardtHomography(
+    const std::vector<Eigen::Vector2d>& src_pt,
+    const std::vector<Eigen::Vector2d>& dest_pt,
+    const Eigen::Matrix3d& H,
+    int max_iterations) {
+    if (src_pt.size() != dest_pt.size()) {
+        throw std::invalid_argument("Error: src_pt and dest_pt must have the same size.");
+    }
+    if (src_pt.size() < 4) {
+        return H;
+    }
+
+    // 1. Hartley-normalized coordinates: the dest scaling multiplies every residual by the same factor
+    const Eigen::Matrix3d Ts = normalizationTransform(src_pt);
+    const Eigen::Matrix3d Td = normalizationTransform(dest_pt);
+    std::vector<Eigen::Vector2d> src(src_pt.size()), dest(dest_pt.size());
+    for (size_t i = 0; i < src_pt.size(); ++i) {
+        src[i] = (Ts * src_pt[i].homogeneous()).head<2>();
+        dest[i] = (Td * dest_pt[i].homogeneous()).head<2>();
+    }
+    Eigen::Matrix3d Hn = Td * H * Ts.inverse();
+    if (std::abs(Hn(2, 2)) < 1e-12) {
+        return H;  // H(2, 2) = 1 parametrization not available
+    }
+    Hn /= Hn(2, 2);
+    Vector8d h;
+    h << Hn(0, 0), Hn(0, 1), Hn(0, 2), Hn(1, 0), Hn(1, 1), Hn(1, 2), Hn(2, 0), Hn(2, 1);
+
+    // 2. damped Gauss-Newton steps, Marquardt scaling of the diagonal
+    Matrix8d JtJ;
+    Vector8d Jtr;
+    double cost = normalEquations(src, dest, h, &JtJ, &Jtr);
+    double lambda = 1e-3;
+    for (int it = 0; it < max_iterations; ++it) {
+        Matrix8d A = JtJ;
+        A.diagonal() *= 1.0 + lambda;
+        const Vector8d delta = A.ldlt().solve(-Jtr);
+        if (!delta.allFinite()) {
+            break;
+        }
+        const Vector8d h_new = h + delta;
+        const double new_cost = normalEquations(src, dest, h_new, nullptr, nullptr);
+        if (new_cost < cost) {
+            const bool converged = cost - new_cost < 1e-12 * cost || delta.norm() < 1e-12 * h.norm();
+            h = h_new;
+            cost = new_cost;
+            lambda = std::max(lambda * 0.1, 1e-12);
+            if (converged) {
+                break;
+            }
+            normalEquations(src, dest, h, &JtJ, &Jtr);
+        } else {
+            lambda *= 10.0;
+            if (lambda > 1e12) {
+                break;
+            }
+        }
+    }
+
+    Hn << h[0], h[1], h[2],
+          h[3], h[4], h[5],
+          h[6], h[7], 1.0;
+    Eigen::Matrix3d refined = Td.inverse() * Hn * Ts;
+    return refined / refined.norm();
+}
+
+Eigen::Matrix3d refineHomography(
+    const std::vector<Eigen::Vector2d>& src_pt,
+    const std::vector<Eigen::Vector2d>& dest_pt,
+    const Eigen::Matrix3d& H,
+    double eps,
+    std::vector<bool>& inliers_mask,
+    int max_rounds) {
+    if (src_pt.size() != dest_pt.size()) {
+        throw std::invalid_argument("Error: src_pt and dest_pt must have the same size.");
+    }
+    int best_count = 0;
+    if (inliers_mask.size() != src_pt.size()) {
+        inliers_mask = scoreInliers(src_pt, dest_pt, H, eps, best_count);
+    } else {
+        best_count = std::count(inliers_mask.begin(), inliers_mask.end(), true);
+    }
+    Eigen::Matrix3d best_H = H;
+
+    int rounds = 0;
+    std::vector<Eigen::Vector2d> src_in, dest_in;
+    while (rounds < max_rounds && best_count >= 4) {
+        ++rounds;
+        // 1. normalized DLT + Levenberg-Marquardt on the current inliers
+        src_in.clear();
+        dest_in.clear();
+        for (size_t i = 0; i < src_pt.size(); ++i) {
+            if (inliers_mask[i]) {
+                src_in.push_back(src_pt[i]);
+                dest_in.push_back(dest_pt[i]);
+            }
+        }
+        Eigen::Matrix3d refined = computeHomography(src_in, dest_in);
+        refined = levenbergMarquardtHomography(src_in, dest_in, refined);
+
+        // 2. guided re-scoring of all correspondences with the refined estimate
+        int count = 0;
+        std::vector<bool> mask = scoreInliers(src_pt, dest_pt, refined, eps, count);
+        if (count < best_count) {
+            break;  // keep the previous estimate
+        }
+        const bool changed = mask != inliers_mask;
+        best_H = refined;
+        best_count = count;
+        inliers_mask.swap(mask);
+        if (!changed) {
+            break;
+        }
+    }
+
+    Profiler::instance().addCounter("refine_rounds", rounds);
+    Profiler::instance().addCounter("refined_inliers", best_count);
+    return best_H;
+}
@@ -0,0 +1,30 @@
+#ifndef REFINE_HOMOGRAPHY_H
+#define REFINE_HOMOGRAPHY_H
+
+#include <Eigen/Dense>
+#include <vector>
+
+// Refine a RANSAC hypothesis on its inlier set.
+// Every round fits a normalized DLT to the current inliers, polishes it with Levenberg-Marquardt on the
+// reprojection error in the destination image, then re-scores all correspondences (inlier: error < eps).
+// Rounds stop when the inlier set no longer changes, after max_rounds, or if a round would lose inliers.
+// src_pt, dest_pt: all correspondences
+// H: RANSAC hypothesis
+// inliers_mask: inliers of H on input, inliers of the returned homography on output
+Eigen::Matrix3d refineHomography(
+    const std::vector<Eigen::Vector2d>& src_pt,
+    const std::vector<Eigen::Vector2d>& dest_pt,
+    const Eigen::Matrix3d& H,
+    double eps,
+    std::vector<bool>& inliers_mask,
+    int max_rounds = 5);
+
+// Levenberg-Marquardt on the reprojection error sum_i |H(src_i) - dest_i|^2, starting from H.
+// Parameters: the 8 entries of H with H(2, 2) fixed to 1, in Hartley-normalized coordinates.
+Eigen::Matrix3d levenbergMarquardtHomography(
+    const std::vector<Eigen::Vector2d>& src_pt,
+    const std::vector<Eigen::Vector2d>& dest_pt,
+    const Eigen::Matrix3d& H,
+    int max_iterations = 20);
+
+#endif // REFINE_HOMOGRAPHY_H
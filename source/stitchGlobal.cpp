@@ -0,0 +1,392 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <omp.h>
+#include "stitchImg.h"
+#include "homography.h"
+#include "helper.h"
+#include "ransac.h"
+#include "refineHomography.h"
+#include "warpBlend.h"
+#include "backwardWarpImg.h"
+#include "multibandBlend.h"
+#include "warpMap.h"
+#include "tiledCanvas.h"
+#include "profiler.h"
+
+namespace {
+
+// Source image in the pixel format the warp runs on
+cv::Mat sourcePixels(const cv::Mat& img, StitchPrecision precision) {
+    if (precision == StitchPrecision::Byte) {
+        return img;
+    }
+    cv::Mat pixels;
+    img.convertTo(pixels, CV_32FC3, 1.0 / 255.0);
+    return pixels;
+}
+
+// Registration state of one stitch, shared by the tasks of the graph.
+// The token vectors only provide the addresses of the OpenMP task dependences.
+struct Registration {
+    int n = 0;
+    int ref = 0;
+    std::vector<ImageFeatures> features;
+    std::vector<Eigen::Matrix3d> pair_H;   // pair i maps imgs[i + 1] onto imgs[i]
+    std::vector<Eigen::Matrix3d> to_ref;   // to_ref[i] maps imgs[i] onto imgs[ref]
+    std::vector<std::string> errors;       // per image (detection, warp) and per pair, first one wins
+    std::atomic<bool> failed{false};
+    std::mutex errors_mutex;
+    std::vector<char> detected, registered, chained;
+
+    Registration(int images, int reference)
+        : n(images), ref(reference), features(images), pair_H(std::max(images - 1, 0), Eigen::Matrix3d::Identity()),
+          to_ref(images, Eigen::Matrix3d::Identity()),
+          errors(2 * images), detected(images), registered(images), chained(images) {}
+
+    void fail(int slot, const std::string& error) {
+        std::lock_guard<std::mutex> lock(errors_mutex);
+        if (errors[slot].empty()) {
+            errors[slot] = error;
+        }
+        failed = true;
+    }
+
+    void rethrow() const {
+        for (const std::string& error : errors) {
+            if (!error.empty()) {
+                throw std::runtime_error(error);
+            }
+        }
+    }
+};
+
+// Pair i from the features of both images
+Eigen::Matrix3d registerPair(const cv::Mat& img_s, const cv::Mat& img_d, const ImageFeatures& features_s, const ImageFeatures& features_d,
+                             int i, const StitchOptions& options) {
+    auto [xs, xd] = matchFeatures(features_s, features_d, options.matcher);
+    if (xs.size() < 4) {
+        throw std::runtime_error("Error: not enough matches between image " + std::to_string(i) + " and " + std::to_string(i + 1) + ".");
+    }
+    auto [inliers, H] = runRANSAC(xs, xd, options.ransac_n, options.ransac_eps, options.ransac_confidence, options.ransac_seed);
+    if (options.refine) {
+        H = refineHomography(xs, xd, H, options.ransac_eps, inliers);
+    }
+    return refineOnOverlap(img_s, img_d, H, options);
+}
+
+// Bounding box of the projected corners of an image
+void projectedBounds(const Eigen::Matrix3d& H, const cv::Size& size, double& min_x, double& min_y, double& max_x, double& max_y) {
+    std::vector<Eigen::Vector2d> corners = {
+        {0, 0}, {size.width - 1, 0}, {size.width - 1, size.height - 1}, {0, size.height - 1}};
+    for (const Eigen::Vector2d& pt : applyHomography(H, corners)) {
+        min_x = std::min(min_x, pt.x());
+        min_y = std::min(min_y, pt.y());
+        max_x = std::max(max_x, pt.x());
+        max_y = std::max(max_y, pt.y());
+    }
+}
+
+// Registration task graph, spawned by the single thread of a team:
+// 1. every image is detected once, all detections run concurrently
+// 2. pair i is matched (and RANSAC / refined) as soon as images i and i + 1 are detected
+// 3. to_ref[i] is chained as soon as the pairs between image i and the reference are known
+// A task of image i depending on chained[i] runs once to_ref[i] is set (or the registration failed), and after
+// the detection of image i. Every task tags its profiler records with the image it registers.
+void spawnRegistration(const std::vector<cv::Mat>& imgs, const StitchOptions& options, Registration& reg) {
+    const int n = reg.n;
+    const int ref = reg.ref;
+    [[maybe_unused]] char* detected = reg.detected.data();
+    [[maybe_unused]] char* registered = reg.registered.data();
+    [[maybe_unused]] char* chained = reg.chained.data();
+
+    for (int i = 0; i < n; ++i) {
+        #pragma omp task firstprivate(i) shared(imgs, reg) depend(out: detected[i])
+        {
+            ScopedIteration tag(i);
+            try {
+                PROFILE_SCOPE("sift.detectAndCompute");
+                reg.features[i] = detectRegistrationFeatures(imgs[i], options);
+            } catch (const std::exception& e) {
+                reg.fail(i, e.what());
+            }
+        }
+    }
+    for (int i = 0; i < n - 1; ++i) {
+        #pragma omp task firstprivate(i) shared(options, reg) depend(in: detected[i], detected[i + 1]) depend(out: registered[i])
+        {
+            ScopedIteration tag(i + 1);
+            if (!reg.failed) {
+                try {
+                    ScopedTimer pair_timer("pairwise");
+                    reg.pair_H[i] = registerPair(imgs[i + 1], imgs[i], reg.features[i + 1], reg.features[i], i, options);
+                } catch (const std::exception& e) {
+                    reg.fail(n + i, e.what());
+                }
+            }
+        }
+    }
+    #pragma omp task shared(reg) depend(in: detected[ref]) depend(out: chained[ref])
+    reg.to_ref[ref] = Eigen::Matrix3d::Identity();
+    for (int i = ref + 1; i < n; ++i) {
+        #pragma omp task firstprivate(i) shared(reg) depend(in: chained[i - 1], registered[i - 1]) depend(out: chained[i])
+        reg.to_ref[i] = reg.to_ref[i - 1] * reg.pair_H[i - 1];
+    }
+    for (int i = ref - 1; i >= 0; --i) {
+        #pragma omp task firstprivate(i) shared(reg) depend(in: chained[i + 1], registered[i]) depend(out: chained[i])
+        reg.to_ref[i] = reg.to_ref[i + 1] * reg.pair_H[i].inverse();
+    }
+}
+
+// Final canvas bounds, computed once from all projected corners
+GlobalLayout layoutFromRegistration(const std::vector<cv::Mat>& imgs, const Registration& reg) {
+    GlobalLayout layout;
+    layout.reference = reg.ref;
+    layout.pair_H = reg.pair_H;
+    double min_x = 0, min_y = 0, max_x = imgs[reg.ref].cols - 1, max_y = imgs[reg.ref].rows - 1;
+    for (int i = 0; i < reg.n; ++i) {
+        projectedBounds(reg.to_ref[i], imgs[i].size(), min_x, min_y, max_x, max_y);
+    }
+    Eigen::Matrix3d shift = Eigen::Matrix3d::Identity();
+    shift(0, 2) = std::ceil(-min_x);
+    shift(1, 2) = std::ceil(-min_y);
+    layout.canvas_size = cv::Size(static_cast<int>(std::ceil(max_x + shift(0, 2))) + 1, static_cast<int>(std::ceil(max_y + shift(1, 2))) + 1);
+    layout.canvas_to_img.resize(reg.n);
+    for (int i = 0; i < reg.n; ++i) {
+        layout.canvas_to_img[i] = (shift * reg.to_ref[i]).inverse();
+    }
+    return layout;
+}
+
+// Reference first, then outwards
+std::vector<int> compositionOrder(int n, int ref) {
+    std::vector<int> order = {ref};
+    for (int d = 1; d < n; ++d) {
+        if (ref - d >= 0) order.push_back(ref - d);
+        if (ref + d < n) order.push_back(ref + d);
+    }
+    return order;
+}
+
+int referenceIndex(int n, const StitchOptions& options) {
+    return options.reference >= 0 && options.reference < n ? options.reference : n / 2;
+}
+
+} // namespace
+
+GlobalLayout estimateGlobalLayout(const std::vector<cv::Mat>& imgs, const StitchOptions& options) {
+    if (imgs.empty()) {
+        throw std::invalid_argument("Error: no input images.");
+    }
+    const int n = static_cast<int>(imgs.size());
+    Registration reg(n, referenceIndex(n, options));
+    #pragma omp parallel
+    #pragma omp single
+    spawnRegistration(imgs, options, reg);
+    reg.rethrow();
+    return layoutFromRegistration(imgs, reg);
+}
+
+std::vector<WarpMap> buildWarpMaps(const GlobalLayout& layout, const std::vector<cv::Size>& img_sizes, WarpInterp mode) {
+    if (img_sizes.size() != layout.canvas_to_img.size()) {
+        throw std::invalid_argument("Error: the layout does not match the number of images.");
+    }
+    std::vector<WarpMap> maps;
+    for (size_t i = 0; i < img_sizes.size(); ++i) {
+        maps.push_back(WarpMap::build(layout.canvas_to_img[i], layout.canvas_size, img_sizes[i], mode));
+    }
+    return maps;
+}
+
+cv::Mat composeGlobal(const std::vector<cv::Mat>& imgs, const GlobalLayout& layout, const StitchOptions& options,
+                      const std::vector<WarpMap>* warp_maps) {
+    const int n = static_cast<int>(imgs.size());
+    if (n != static_cast<int>(layout.canvas_to_img.size()) || (warp_maps && n != static_cast<int>(warp_maps->size()))) {
+        throw std::invalid_argument("Error: the layout does not match the number of images.");
+    }
+    const int ref = layout.reference;
+    const cv::Size canvas_shape = layout.canvas_size;
+    Profiler::instance().addCounter("canvas_pixels", canvas_shape.area());
+
+    // 4. compose: reference first, then outwards so every image overlaps content that is already placed
+    cv::Mat canvas(canvas_shape, CV_8UC3, cv::Scalar::all(0));
+    MultibandCanvas multiband(options.band_levels);
+    if (options.blend == StitchBlend::Multiband) {
+        multiband.reset(canvas_shape);
+    }
+    for (int i : compositionOrder(n, ref)) {
+        Profiler::instance().setIteration(i);
+        const cv::Mat img = sourcePixels(imgs[i], options.precision);
+        if (warp_maps) {
+            // gather through the precomputed map, no projective math per pixel
+            ScopedTimer compose_timer("warpMapBlend");
+            WarpROI warped = (*warp_maps)[i].apply(img);
+            if (options.blend == StitchBlend::Multiband) {
+                if (!warped.roi.empty()) {
+                    multiband.feed(warped.img, warped.mask, warped.roi);
+                }
+            } else {
+                blendWarpedInto(canvas, warped);
+            }
+            compose_timer.stop();
+            Profiler::instance().addCounter("warp_roi_pixels", warped.roi.area());
+            continue;
+        }
+        if (options.blend == StitchBlend::Multiband) {
+            ScopedTimer compose_timer("multibandBlend");
+            WarpROI warped = backwardWarpImgROI(img, layout.canvas_to_img[i], canvas_shape, options.interp);
+            if (!warped.roi.empty()) {
+                multiband.feed(warped.img, warped.mask, warped.roi);
+            }
+            compose_timer.stop();
+            Profiler::instance().addCounter("warp_roi_pixels", warped.roi.area());
+            continue;
+        }
+        ScopedTimer compose_timer("warpBlend");
+        cv::Rect roi = warpBlendInto(canvas, img, layout.canvas_to_img[i], options.interp);
+        compose_timer.stop();
+        Profiler::instance().addCounter("warp_roi_pixels", roi.area());
+    }
+    Profiler::instance().setIteration(-1);
+
+    if (options.blend == StitchBlend::Multiband) {
+        return multiband.canvas().clone();
+    }
+    return canvas;
+}
+
+void composeGlobal(const std::vector<cv::Mat>& imgs, const GlobalLayout& layout, TiledCanvas& canvas, const StitchOptions& options) {
+    const int n = static_cast<int>(imgs.size());
+    if (n != static_cast<int>(layout.canvas_to_img.size())) {
+        throw std::invalid_argument("Error: the layout does not match the number of images.");
+    }
+    if (canvas.size() != layout.canvas_size) {
+        throw std::invalid_argument("Error: the tiled canvas does not have the size of the layout.");
+    }
+    if (options.blend != StitchBlend::Distance) {
+        throw std::invalid_argument("Error: the tiled canvas only supports the distance blend.");
+    }
+    Profiler::instance().addCounter("canvas_pixels", layout.canvas_size.area());
+
+    // same order as composeGlobal, every image touches the tiles of its footprint only
+    for (int i : compositionOrder(n, layout.reference)) {
+        Profiler::instance().setIteration(i);
+        const cv::Mat img = sourcePixels(imgs[i], options.precision);
+        ScopedTimer compose_timer("warpBlend");
+        cv::Rect roi = warpBlendInto(canvas, img, layout.canvas_to_img[i], options.interp);
+        compose_timer.stop();
+        Profiler::instance().addCounter("warp_roi_pixels", roi.area());
+    }
+    Profiler::instance().setIteration(-1);
+    Profiler::instance().addCounter("tiles_allocated", canvas.allocatedTiles());
+    Profiler::instance().addCounter("tile_spills", canvas.spills());
+    Profiler::instance().addCounter("tile_loads", canvas.loads());
+}
+
+cv::Mat stitchImgGlobal(const std::vector<cv::Mat>& imgs, const StitchOptions& options) {
+    if (imgs.empty()) {
+        throw std::invalid_argument("Error: no input images.");
+    }
+    if (imgs.size() == 1) {
+        return imgs[0].clone();
+    }
+    const int n = static_cast<int>(imgs.size());
+    Registration reg(n, referenceIndex(n, options));
+
+    // Pipelined estimateGlobalLayout + composeGlobal, one task graph on one team:
+    // registration as in estimateGlobalLayout, every image is warped onto its own footprint as soon as its
+    // chain to the reference is known (while later pairs are still matched), and the blend of an image
+    // starts as soon as the canvas bounds and its warp are ready.
+    std::vector<WarpROI> warped(n);
+    std::vector<cv::Point> origin(n);  // footprint origin on the reference frame (integer, so the samples match the canvas)
+    std::vector<char> warp_done(n);
+    cv::Mat result;
+    #pragma omp parallel
+    #pragma omp single
+    {
+        spawnRegistration(imgs, options, reg);
+        [[maybe_unused]] char* chained = reg.chained.data();
+        [[maybe_unused]] char* warp_ready = warp_done.data();
+
+        // 1. warp tasks
+        for (int i = 0; i < n; ++i) {
+            #pragma omp task firstprivate(i) shared(imgs, options, reg, warped, origin) depend(in: chained[i]) depend(out: warp_ready[i])
+            {
+                ScopedIteration tag(i);
+                if (!reg.failed) {
+                    try {
+                        ScopedTimer warp_timer("backwardWarpImg");
+                        double min_x = std::numeric_limits<double>::max(), min_y = min_x;
+                        double max_x = std::numeric_limits<double>::lowest(), max_y = max_x;
+                        projectedBounds(reg.to_ref[i], imgs[i].size(), min_x, min_y, max_x, max_y);
+                        origin[i] = cv::Point(static_cast<int>(std::floor(min_x)), static_cast<int>(std::floor(min_y)));
+                        Eigen::Matrix3d to_footprint = Eigen::Matrix3d::Identity();
+                        to_footprint(0, 2) = -origin[i].x;
+                        to_footprint(1, 2) = -origin[i].y;
+                        const cv::Size footprint(static_cast<int>(std::ceil(max_x)) - origin[i].x + 1,
+                                                 static_cast<int>(std::ceil(max_y)) - origin[i].y + 1);
+                        const cv::Mat img = sourcePixels(imgs[i], options.precision);
+                        warped[i] = backwardWarpImgROI(img, (to_footprint * reg.to_ref[i]).inverse(), footprint, options.interp);
+                    } catch (const std::exception& e) {
+                        reg.fail(i, e.what());
+                    }
+                }
+            }
+        }
+
+        // 2. canvas bounds once every image is chained
+        for (int i = 0; i < n; ++i) {
+            #pragma omp taskwait depend(in: chained[i])
+        }
+        if (!reg.failed) {
+            const GlobalLayout layout = layoutFromRegistration(imgs, reg);
+            const cv::Point shift(static_cast<int>(std::lround(-layout.canvas_to_img[reg.ref](0, 2))),
+                                  static_cast<int>(std::lround(-layout.canvas_to_img[reg.ref](1, 2))));
+            Profiler::instance().addCounter("canvas_pixels", layout.canvas_size.area());
+
+            // 3. blend in composition order, each image as soon as its warp is done
+            cv::Mat canvas(layout.canvas_size, CV_8UC3, cv::Scalar::all(0));
+            MultibandCanvas multiband(options.band_levels);
+            if (options.blend == StitchBlend::Multiband) {
+                multiband.reset(layout.canvas_size);
+            }
+            for (int i : compositionOrder(n, reg.ref)) {
+                #pragma omp taskwait depend(in: warp_ready[i])
+                if (reg.failed) {
+                    break;
+                }
+                WarpROI& w = warped[i];
+                w.roi.x += origin[i].x + shift.x;
+                w.roi.y += origin[i].y + shift.y;
+                // footprint and canvas bounds are rounded separately, drop a pixel rounding put outside the canvas
+                const cv::Rect inside = w.roi & cv::Rect(0, 0, layout.canvas_size.width, layout.canvas_size.height);
+                if (inside != w.roi) {
+                    const cv::Rect local(inside.x - w.roi.x, inside.y - w.roi.y, inside.width, inside.height);
+                    w.img = w.img(local);
+                    w.mask = w.mask(local);
+                    w.roi = inside;
+                }
+                ScopedIteration tag(i);
+                Profiler::instance().addCounter("warp_roi_pixels", w.roi.area());
+                if (options.blend == StitchBlend::Multiband) {
+                    ScopedTimer compose_timer("multibandBlend");
+                    if (!w.roi.empty()) {
+                        multiband.feed(w.img, w.mask, w.roi);
+                    }
+                } else {
+                    ScopedTimer compose_timer("warpBlend");
+                    blendWarpedInto(canvas, w);
+                }
+                w = WarpROI();
+            }
+            result = options.blend == StitchBlend::Multiband ? multiband.canvas().clone() : canvas;
+        }
+    }
+    reg.rethrow();
+    return result;
+}
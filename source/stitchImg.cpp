@@ -2,19 +2,22 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
-#include <omp.h>
-#include <chrono>
 #include <string>
-#include <cstdlib>
 #include "stitchImg.h"
 #include "homography.h"
 #include "helper.h"
 #include "ransac.h"
+#include "refineHomography.h"
 #include "blendImagePair.h"
 #include "backwardWarpImg.h"
-
-using std::chrono::high_resolution_clock;
-using std::chrono::duration;
+#include "warpBlend.h"
+#include "profiler.h"
+#include "featureCache.h"
+#include "multibandBlend.h"
+#include "taskGraph.h"
+#include "canvasRegions.h"
+#include "matPool.h"
+#include <tuple>
 
 void PrintMat(const cv::Mat& img, std::string name)
 {
@@ -28,22 +31,97 @@ Eigen::Matrix3d transferHomography(const Eigen::Matrix3d& H, double tx, double t
     return transfer_matrix * H;
 }
 
-cv::Mat stitchImg(const std::vector<cv::Mat>& imgs) {
+cv::Mat stitchImg(const std::vector<cv::Mat>& imgs, const StitchOptions& options, MatPool* caller_pool) {
+    if (options.composition == StitchComposition::Global) {
+        return stitchImgGlobal(imgs, options);
+    }
     constexpr int dimension = 255;
-    cv::Mat left = imgs[0].clone();
+    constexpr int kMaskRowGrain = 16;  // rows per task of the canvas mask loop
+
+    // multiband blending in the fused pipeline keeps the pyramid of the canvas across iterations
+    const bool canvas_pyramid = options.blend == StitchBlend::Multiband && options.fused;
+    MultibandCanvas multiband(options.band_levels);
+    // canvas-sized matrices of the iterations, reused and grown in place as the canvas grows,
+    // and kept for the next call if the caller owns the pool
+    MatPool local_pool;
+    MatPool& pool = caller_pool ? *caller_pool : local_pool;
+    pool.resetCounters();
+    const LoopStage canvas_stage = options.fused ? LoopStage::WarpBlendRows : LoopStage::BlendRows;
+    cv::Mat left;
+    if (canvas_pyramid) {
+        left = imgs[0].clone();
+    } else {
+        left = pool.acquire("canvas", imgs[0].size(), imgs[0].type(), false, canvas_stage);
+        imgs[0].copyTo(left);
+    }
+    // reference pipeline: distance field of the canvas, carried over to the next iteration
+    BlendDistanceCache distance_cache;
+    if (canvas_pyramid) {
+        multiband.reset(left.size());
+        multiband.feed(left, cv::Mat(left.size(), CV_8U, cv::Scalar(255)), cv::Rect(0, 0, left.cols, left.rows));
+    }
+
+    // features of every input image, all detected concurrently up front
+    std::vector<ImageFeatures> features(imgs.size());
+    {
+        ScopedTimer detect_timer("detectInputs");
+        runTasks(static_cast<int>(imgs.size()), [&](int i) {
+            features[i] = detectRegistrationFeatures(imgs[i], options);
+        });
+    }
+    // keypoints of the placed images in canvas coordinates, instead of detecting the canvas every iteration
+    constexpr size_t kMinRegionInliers = 20;  // fewer inliers in the predicted overlap: retry against all placed images
+    CanvasRegions regions;
+    if (!options.detect_canvas) {
+        regions.add(0, features[0], Eigen::Matrix3d::Identity(), imgs[0].size(), left.size());
+    }
 
     for (size_t idx = 1; idx < imgs.size(); ++idx) {
+        Profiler::instance().setIteration(static_cast<int>(idx));
+        PROFILE_SCOPE("iteration");
         cv::Mat right = imgs[idx].clone();
 
 
         // 1. first get the Homography after denoising
-        auto [xs, xd] = genSIFTMatches(right, left);
-
-        int ransac_n = 2000;
-        double ransac_eps = 10.0;
-        auto [_, H] = runRANSAC(xs, xd, ransac_n, ransac_eps);
+        std::vector<Eigen::Vector2d> xs, xd;
+        std::vector<bool> inliers;
+        Eigen::Matrix3d H;
+        // reused keypoints: the predicted overlap (footprints of the last placed images, i.e. sequence adjacency)
+        // first, all placed images if that does not register
+        const bool restrict_overlap = !options.detect_canvas && options.overlap_regions > 0 &&
+                                      regions.regions().size() > static_cast<size_t>(options.overlap_regions);
+        for (int attempt = restrict_overlap ? 0 : 1; attempt < 2; ++attempt) {
+            ScopedTimer sift_timer("genSIFTMatches");
+            ImageFeatures canvas_features;
+            if (options.detect_canvas) {
+                canvas_features = idx == 1 ? features[0] : detectRegistrationFeatures(left, options);
+            } else {
+                canvas_features = regions.features(attempt == 0 ? regions.recentFootprint(options.overlap_regions)
+                                                                : cv::Rect(0, 0, left.cols, left.rows));
+                Profiler::instance().addCounter("canvas_keypoints", canvas_features.keypoints.size());
+            }
+            std::tie(xs, xd) = matchFeatures(features[idx], canvas_features, options.matcher);
+            sift_timer.stop();
+            if (attempt == 0 && xs.size() < kMinRegionInliers) {
+                continue;
+            }
+
+            ScopedTimer ransac_timer("runRANSAC");
+            std::tie(inliers, H) = runRANSAC(xs, xd, options.ransac_n, options.ransac_eps, options.ransac_confidence, options.ransac_seed);
+            ransac_timer.stop();
+            if (attempt == 1 || std::count(inliers.begin(), inliers.end(), true) >= static_cast<long>(kMinRegionInliers)) {
+                break;
+            }
+        }
+
+        if (options.refine) {
+            ScopedTimer refine_timer("refineHomography");
+            H = refineHomography(xs, xd, H, options.ransac_eps, inliers);
+        }
+        H = refineOnOverlap(right, left, H, options);
 
         // 2. pick four corners (two functions: 1. compute the size of warp img; 2. compute the update Homography)
+        ScopedTimer layout_timer("canvasLayout");
         std::vector<Eigen::Vector2d> right_corners = {
             {0, 0}, {right.cols - 1, 0}, {right.cols - 1, right.rows - 1}, {0, right.rows - 1}};
         auto left_corners = applyHomography(H, right_corners);
@@ -55,6 +133,11 @@ cv::Mat stitchImg(const std::vector<cv::Mat>& imgs) {
 
         double new_origin_x = std::max(0.0, -origin_x);
         double new_origin_y = std::max(0.0, -origin_y);
+        if (canvas_pyramid) {
+            // the stored pyramid levels can only move by whole pixels of the coarsest level
+            new_origin_x = std::ceil(new_origin_x / multiband.alignment()) * multiband.alignment();
+            new_origin_y = std::ceil(new_origin_y / multiband.alignment()) * multiband.alignment();
+        }
 
         int new_x_len = static_cast<int>(std::ceil(std::max_element(left_corners.begin(), left_corners.end(),
                                                                      [](const Eigen::Vector2d& a, const Eigen::Vector2d& b) { return a.x() < b.x(); })->x() +
@@ -65,94 +148,97 @@ cv::Mat stitchImg(const std::vector<cv::Mat>& imgs) {
                                                     new_origin_y));
         new_y_len = std::max(new_y_len, left.rows + int(new_origin_y));
         H = transferHomography(H, new_origin_x, new_origin_y);
+        if (!options.detect_canvas) {
+            regions.shift(static_cast<int>(new_origin_x), static_cast<int>(new_origin_y));
+            regions.add(static_cast<int>(idx), features[idx], H, right.size(), cv::Size(new_x_len, new_y_len));
+        }
+        features[idx] = ImageFeatures();
 
         cv::Size dest_canvas_shape(new_x_len, new_y_len);
-        cv::Mat curr_canvas(dest_canvas_shape, left.type(), cv::Scalar::all(0));
-        left.copyTo(curr_canvas(cv::Rect(static_cast<int>(new_origin_x), static_cast<int>(new_origin_y), left.cols, left.rows)));
-
-
-        cv::Mat channels[3];
-        cv::split(curr_canvas, channels);
-        cv::Mat mask = (channels[0] != 0) | (channels[1] != 0) | (channels[2] != 0);
-        
-
-        right.convertTo(right, CV_32FC3, 1.0 / 255.0);
-        auto [dest_mask, dest_img] = backwardWarpImg(right, H.inverse(), dest_canvas_shape);
+        cv::Mat curr_canvas;
+        if (canvas_pyramid) {
+            multiband.grow(static_cast<int>(new_origin_x), static_cast<int>(new_origin_y), dest_canvas_shape);
+        } else {
+            curr_canvas = pool.grow("canvas", left, dest_canvas_shape, static_cast<int>(new_origin_x), static_cast<int>(new_origin_y),
+                                    canvas_stage);
+        }
+        layout_timer.stop();
+        Profiler::instance().addCounter("canvas_pixels", dest_canvas_shape.area());
+
+        if (options.precision == StitchPrecision::Float || !options.fused) {
+            right.convertTo(right, CV_32FC3, 1.0 / 255.0);
+        }
+        if (canvas_pyramid) {
+            // 3. warp right on its footprint and blend its bands into the canvas pyramid
+            ScopedTimer warp_timer("backwardWarpImg");
+            WarpROI warped = backwardWarpImgROI(right, H.inverse(), dest_canvas_shape, options.interp);
+            warp_timer.stop();
+            Profiler::instance().addCounter("warp_roi_pixels", warped.roi.area());
+
+            ScopedTimer blend_timer("multibandBlend");
+            if (!warped.roi.empty()) {
+                multiband.feed(warped.img, warped.mask, warped.roi);
+            }
+            left = multiband.canvas();
+            blend_timer.stop();
+            continue;
+        }
+        if (options.fused) {
+            // 3. warp right and blend it into the 8-bit canvas in one pass over its footprint
+            ScopedTimer fused_timer("warpBlend");
+            cv::Rect roi = warpBlendInto(curr_canvas, right, H.inverse(), options.interp);
+            left = curr_canvas;
+            fused_timer.stop();
+            Profiler::instance().addCounter("warp_roi_pixels", roi.area());
+            continue;
+        }
+
+        // 3. reference path: full-canvas mask, warp and blend stages
+        ScopedTimer split_timer("maskSplit");
+        cv::Mat mask = pool.acquire("canvas_mask", dest_canvas_shape, CV_8U, false, LoopStage::BlendRows);
+        parallelFor(LoopStage::BlendRows, mask.rows, kMaskRowGrain, [&](int y) {
+            const uchar* c = curr_canvas.ptr<uchar>(y);
+            uchar* m = mask.ptr<uchar>(y);
+            for (int x = 0; x < mask.cols; ++x) {
+                m[x] = (c[3 * x] | c[3 * x + 1] | c[3 * x + 2]) ? 255 : 0;
+            }
+        });
+        split_timer.stop();
+
+        // only the footprint of right on the canvas is warped, then placed on the full canvas for blending
+        ScopedTimer warp_timer("backwardWarpImg");
+        WarpROI warped = backwardWarpImgROI(right, H.inverse(), dest_canvas_shape, options.interp);
+        cv::Mat dest_img = pool.acquire("warped", dest_canvas_shape, CV_32FC3, true, LoopStage::BlendRows);
+        cv::Mat dest_mask = pool.acquire("warped_mask", dest_canvas_shape, CV_8U, true, LoopStage::BlendRows);
+        if (!warped.roi.empty()) {
+            warped.img.copyTo(dest_img(warped.roi));
+            warped.mask.copyTo(dest_mask(warped.roi));
+        }
+        warp_timer.stop();
+        Profiler::instance().addCounter("warp_roi_pixels", warped.roi.area());
 
         // Normalize the image to the range [0, 1] and convert to floating point
-        curr_canvas.convertTo(curr_canvas, CV_32F, 1.0 / 255.0);
-        left = blendImagePair(curr_canvas, mask, dest_img, dest_mask, "blend");
-        left.convertTo(left, CV_8U, 255.0);
+        ScopedTimer blend_timer("blendImagePair");
+        cv::Mat canvas_float = pool.acquire("canvas_float", dest_canvas_shape, CV_32FC3, false, LoopStage::BlendRows);
+        curr_canvas.convertTo(canvas_float, CV_32F, 1.0 / 255.0);
+        cv::Mat blended;
+        if (options.blend == StitchBlend::Multiband) {
+            blended = multibandBlendPair(canvas_float, mask, dest_img, dest_mask, options.band_levels);
+        } else {
+            distance_cache.grow(static_cast<int>(new_origin_x), static_cast<int>(new_origin_y), dest_canvas_shape, &pool);
+            blended = blendImagePair(canvas_float, mask, dest_img, dest_mask, "blend", &distance_cache, &pool);
+        }
+        // back into the pooled canvas, which the next iteration grows in place
+        blended.convertTo(curr_canvas, CV_8U, 255.0);
+        left = curr_canvas;
+        blend_timer.stop();
     }
+    Profiler::instance().setIteration(-1);
 
-    return left;
-}
-
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cout << "please run commond: ./stitch_image thread_num " << std::endl;
-        return -1;
-    }
-    int thread_num = atoi(argv[1]);
-    // Load images
-    cv::Mat img_center = cv::imread("../photos/data/mountain_center.jpg");
-    cv::Mat img_left = cv::imread("../photos/data/mountain_left.jpg");
-    cv::Mat img_right = cv::imread("../photos/data/mountain_right.jpg");
-
-    if (img_center.empty() || img_left.empty() || img_right.empty()) {
-        std::cerr << "Could not load images." << std::endl;
-        return -1;
+    pool.report();
+    if (canvas_pyramid) {
+        // drop the border left by rounding the canvas offsets
+        return multiband.canvas()(cv::boundingRect(multiband.coverage())).clone();
     }
-
-    std::vector<cv::Mat> imgs;
-    imgs.push_back(img_center);
-    imgs.push_back(img_left);
-    imgs.push_back(img_right);
-
-    // set thread_num
-    omp_set_num_threads(thread_num);
-
-    auto start_time = high_resolution_clock::now();
-    // stitch images
-    cv::Mat result = stitchImg(imgs);
-    auto end_time = high_resolution_clock::now();
-    auto duration_sec = std::chrono::duration_cast<duration<double, std::milli>>(end_time - start_time);
-
-    // std::cout<<"Success! Total time:"<< duration_sec.count()<<"ms"<<std::endl;
-    std::cout<<duration_sec.count()<<std::endl;
-    
-
-    // Save the result
-    cv::imwrite("../photos/data/stitched_mountain.png", result);
-
-    // if (argc != 2) {
-    //     std::cout << "please run commond: ./stitch_image thread_num " << std::endl;
-    //     return -1;
-    // }
-    // int thread_num = atoi(argv[1]);
-
-    // std::vector<cv::Mat> imgs;
-    // for (int i = 2; i >= 0; i--) {
-    //     imgs.emplace_back(cv::imread("../photos/data/input/1114008" + std::to_string(i) + "_l.PNG"));
-    // }
-    // for (int i = 3; i < 6; i++) {
-    //     imgs.emplace_back(cv::imread("../photos/data/input/1114008" + std::to_string(i) + "_l.PNG"));
-    // } 
-
-    // // set thread_num
-    // omp_set_num_threads(thread_num);
-
-    // auto start_time = high_resolution_clock::now();
-    // // stitch images
-    // cv::Mat result = stitchImg(imgs);
-    // auto end_time = high_resolution_clock::now();
-    // auto duration_sec = std::chrono::duration_cast<duration<double, std::milli>>(end_time - start_time);
-
-    // // std::cout<<"Success! Total time:"<< duration_sec.count()<<"ms"<<std::endl;
-    // std::cout<<duration_sec.count()<<std::endl;
-    // // Save the result
-    // cv::imwrite("../photos/data/stitched_school.png", result);
-
-
-    return 0;
-}
\ No newline at end of file
+    return left.clone();  // the views of the pool are overwritten by the next call
+}
@@ -5,6 +5,82 @@
 #include <vector>
 #include <Eigen/Dense> 
 
-cv::Mat stitchImg(const std::vector<cv::Mat>& imgs);
+#include "warpKernel.h"
+#include "descriptorMatcher.h"
+#include "multibandBlend.h"
+#include "coarseToFine.h"
+#include "matPool.h"
+
+// How the panorama is assembled
+enum class StitchComposition {
+    Iterative,  // stitch every image against the accumulated canvas (original behaviour)
+    Global      // pairwise homographies between neighbours, chained to a reference frame, one composition pass
+};
+
+// How overlapping images are merged
+enum class StitchBlend {
+    Distance,   // distance-transform feathering (original behaviour)
+    Multiband   // Laplacian pyramid blending: low frequencies mixed over a wide band, details over a narrow one
+};
+
+// Pixel format of the source images and warped footprints
+enum class StitchPrecision {
+    Float,      // CV_32FC3 in [0, 1], 12 bytes per pixel (original behaviour)
+    Byte        // CV_8UC3, 3 bytes per pixel: interpolation still runs in float, the result is rounded once per pixel
+};
+
+// Tunable parameters of stitchImg
+struct StitchOptions {
+    int ransac_n = 2000;                         // RANSAC hypotheses (upper bound of the adaptive search)
+    double ransac_eps = 10.0;                    // RANSAC inlier threshold (pixels)
+    double ransac_confidence = 0.99;             // RANSAC stops once an all-inlier sample is this likely
+    unsigned ransac_seed = 0;                    // RANSAC sampling seed, 0 = random
+    bool refine = true;                          // refine the RANSAC hypothesis on its inliers (DLT + Levenberg-Marquardt)
+    WarpInterp interp = WarpInterp::Bilinear;    // sampling of the warped image
+    bool fused = true;                           // fused warp-and-blend pass instead of backwardWarpImg + blendImagePair
+    StitchBlend blend = StitchBlend::Distance;
+    StitchPrecision precision = StitchPrecision::Float;  // fused and global pipelines; the reference stages stay float
+    int band_levels = kDefaultBandLevels;        // multiband blending: pyramid levels
+    StitchComposition composition = StitchComposition::Iterative;
+    int reference = -1;                          // global composition: reference image index, -1 for the middle image
+    FeatureParams features;                      // registration keypoints: SIFT or binary (ORB, AKAZE) descriptors
+    MatcherOptions matcher;                      // descriptor matching of genSIFTMatches
+    CoarseToFineOptions coarse;                  // pyramid level of the registration keypoints
+    bool detect_canvas = false;                  // iterative: detect the whole canvas every iteration (original behaviour)
+                                                 // instead of reusing the keypoints of the placed images
+    int overlap_regions = 2;                     // iterative: match against the keypoints of the last k placed images, 0 = all
+};
+
+// pool: canvas-sized matrices of the iterative composition. A caller that stitches repeatedly (Stitcher) passes
+// its own pool so the buffers of one call are reused by the next; otherwise the call uses a pool of its own.
+cv::Mat stitchImg(const std::vector<cv::Mat>& imgs, const StitchOptions& options = StitchOptions(), MatPool* pool = nullptr);
+
+// Global composition of an ordered sequence: imgs[i] and imgs[i + 1] must overlap.
+// The cost is linear in the number of images since no image is registered against the growing canvas.
+cv::Mat stitchImgGlobal(const std::vector<cv::Mat>& imgs, const StitchOptions& options = StitchOptions());
+
+// Geometry of a global composition: everything stitchImgGlobal derives from the image content.
+// It only depends on the camera poses, so a fixed rig can reuse it for every frame.
+struct GlobalLayout {
+    std::vector<Eigen::Matrix3d> pair_H;         // pair i maps imgs[i + 1] onto imgs[i]
+    std::vector<Eigen::Matrix3d> canvas_to_img;  // per image: canvas to image homography
+    cv::Size canvas_size;
+    int reference = 0;
+};
+
+class WarpMap;
+class TiledCanvas;
+
+// Steps of stitchImgGlobal: registration (matching, RANSAC, chaining, canvas bounds) and composition (warp and blend)
+GlobalLayout estimateGlobalLayout(const std::vector<cv::Mat>& imgs, const StitchOptions& options = StitchOptions());
+// warp_maps: optional precomputed warps of the layout, one per image (see buildWarpMaps)
+cv::Mat composeGlobal(const std::vector<cv::Mat>& imgs, const GlobalLayout& layout, const StitchOptions& options = StitchOptions(),
+                      const std::vector<WarpMap>* warp_maps = nullptr);
+// composeGlobal onto a tiled canvas of layout.canvas_size, so the panorama never has to fit in memory as one image.
+// Distance blending only; throws std::invalid_argument for multiband.
+void composeGlobal(const std::vector<cv::Mat>& imgs, const GlobalLayout& layout, TiledCanvas& canvas,
+                   const StitchOptions& options = StitchOptions());
+// Warp maps of a layout for images of the given sizes
+std::vector<WarpMap> buildWarpMaps(const GlobalLayout& layout, const std::vector<cv::Size>& img_sizes, WarpInterp mode);
 
 #endif
@@ -0,0 +1,401 @@
+#include <vector>
+#include <iostream>
+#include <omp.h>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <filesystem>
+#include "stitchImg.h"
+#include "stitcher.h"
+#include "featureCache.h"
+#include "streamStitch.h"
+#include "batchStitch.h"
+#include "tiledCanvas.h"
+#include "profiler.h"
+#include "loopTuning.h"
+#include "autotune.h"
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+int main(int argc, char *argv[]) {
+    const std::string usage = "please run commond: ./stitch_image thread_num [--report report_prefix] [--interp nearest|bilinear|bicubic] "
+                              "[--pipeline fused|reference] [--blend distance|multiband] [--precision float|u8] [--mode iterative|global] [--images img1 img2 ...] [--output path] [--feature-cache dir] "
+                              "[--features sift|orb|akaze] [--matcher bruteforce|kdforest|kmeans] [--ratio r] [--checks n] [--no-cross-check] [--no-refine] [--seed n] [--coarse level] [--no-overlap-refine] [--detect-canvas] [--overlap-regions k] "
+                              "[--stream frame_dir] [--stream-output dir] [--revalidate k] [--warp-maps dir|off] "
+                              "[--batch manifest|frame_dir] [--batch-output dir] [--jobs n] [--tiled budget_mb] [--tile-size n] [--scratch dir] "
+                              "[--loop-profile path|off] [--autotune] [--loop-schedule static|dynamic|guided[,chunk]]";
+    if (argc < 2) {
+        std::cout << usage << std::endl;
+        return -1;
+    }
+    int thread_num = atoi(argv[1]);
+
+    // optional arguments
+    // --report: per-stage report, written to <report_prefix>.json and <report_prefix>.csv
+    // --interp: sampling of the warped images
+    // --pipeline: fused warp-and-blend pass (default) or the separate full-canvas stages
+    // --blend: distance-transform feathering (default) or multiband (Laplacian pyramid) blending
+    // --precision: float (default) or 8-bit source images and warped footprints (fused and global pipelines)
+    // --mode: iterative stitching against the growing canvas (default) or global composition of the ordered sequence
+    // --images: input images in sequence order instead of the three mountain photos
+    // --output: result path
+    // --feature-cache: directory of the persistent feature cache, reused across runs
+    // --features: registration keypoints, SIFT (default) or binary ORB / AKAZE descriptors matched by Hamming distance
+    // --matcher, --ratio, --checks, --no-cross-check: descriptor matching (search structure, Lowe's ratio, speed/recall knob)
+    // --no-refine: use the RANSAC hypothesis as is
+    // --seed: fixed RANSAC seed (reproducible registration with one thread)
+    // --coarse, --no-overlap-refine: detect and match on pyramid level `level`, then (unless disabled) correct the
+    //   homography with full-resolution keypoints of the predicted overlap
+    // --detect-canvas, --overlap-regions: iterative mode, detect the whole canvas every iteration, or (default) reuse the
+    //   keypoints of the placed images that lie in the footprints of the last k of them (0 = all)
+    // --stream, --stream-output, --revalidate: fixed-rig video mode over the <name>_l.PNG / <name>_r.PNG pairs of a directory,
+    //   calibrated once (re-checked every k frames if k > 0), one stitched image per frame
+    // --batch, --batch-output, --jobs: stitch many independent image sets (manifest lines "name img1 img2 ...", or the
+    //   <name>_l.PNG / <name>_r.PNG pairs of a directory) with n concurrent jobs sharing the threads
+    // --tiled, --tile-size, --scratch: global composition onto a tiled canvas with at most budget_mb of resident tiles,
+    //   the others spilled to a scratch file in dir; --output *.ppm streams one PPM, any other path is a directory of tiles
+    // --warp-maps: stream mode, keep the precomputed warps in dir for the next run, or "off" to warp every frame from scratch
+    // --loop-profile: per-stage schedule, chunk size and thread count of the parallel loops, loaded at startup if the file
+    //   exists (default ../results/loop_profile.txt), "off" keeps the defaults
+    // --autotune: search the loop settings on this machine and the input images, save them to the loop profile, then stitch
+    // --loop-schedule: one schedule (and chunk) for every stage instead of the profile, e.g. for a schedule sweep
+    std::string report_prefix;
+    std::string output_path = "../photos/data/stitched_mountain.png";
+    std::vector<std::string> image_paths;
+    std::string stream_dir;
+    std::string stream_output = "../results/stream";
+    std::string batch_source;
+    BatchOptions batch_options;
+    StitchOptions options;
+    StreamOptions stream_options;
+    bool tiled = false;
+    TiledCanvasOptions tiled_options;
+    std::string loop_profile = "../results/loop_profile.txt";
+    bool autotune = false;
+    std::string loop_schedule;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--report" && i + 1 < argc) {
+            report_prefix = argv[++i];
+        } else if (arg == "--interp" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "nearest") {
+                options.interp = WarpInterp::Nearest;
+            } else if (mode == "bilinear") {
+                options.interp = WarpInterp::Bilinear;
+            } else if (mode == "bicubic") {
+                options.interp = WarpInterp::Bicubic;
+            } else {
+                std::cout << usage << std::endl;
+                return -1;
+            }
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            std::string pipeline = argv[++i];
+            if (pipeline != "fused" && pipeline != "reference") {
+                std::cout << usage << std::endl;
+                return -1;
+            }
+            options.fused = pipeline == "fused";
+        } else if (arg == "--blend" && i + 1 < argc) {
+            std::string blend = argv[++i];
+            if (blend != "distance" && blend != "multiband") {
+                std::cout << usage << std::endl;
+                return -1;
+            }
+            options.blend = blend == "multiband" ? StitchBlend::Multiband : StitchBlend::Distance;
+        } else if (arg == "--precision" && i + 1 < argc) {
+            std::string precision = argv[++i];
+            if (precision != "float" && precision != "u8") {
+                std::cout << usage << std::endl;
+                return -1;
+            }
+            options.precision = precision == "u8" ? StitchPrecision::Byte : StitchPrecision::Float;
+        } else if (arg == "--mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode != "iterative" && mode != "global") {
+                std::cout << usage << std::endl;
+                return -1;
+            }
+            options.composition = mode == "global" ? StitchComposition::Global : StitchComposition::Iterative;
+        } else if (arg == "--images") {
+            while (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+                image_paths.push_back(argv[++i]);
+            }
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--loop-profile" && i + 1 < argc) {
+            loop_profile = argv[++i];
+        } else if (arg == "--autotune") {
+            autotune = true;
+        } else if (arg == "--loop-schedule" && i + 1 < argc) {
+            loop_schedule = argv[++i];
+        } else if (arg == "--feature-cache" && i + 1 < argc) {
+            FeatureCache::instance().setDirectory(argv[++i]);
+        } else if (arg == "--features" && i + 1 < argc) {
+            std::string features = argv[++i];
+            if (features == "sift") {
+                options.features.type = FeatureType::SIFT;
+            } else if (features == "orb") {
+                options.features.type = FeatureType::ORB;
+            } else if (features == "akaze") {
+                options.features.type = FeatureType::AKAZE;
+            } else {
+                std::cout << usage << std::endl;
+                return -1;
+            }
+        } else if (arg == "--matcher" && i + 1 < argc) {
+            std::string matcher = argv[++i];
+            if (matcher == "bruteforce") {
+                options.matcher.type = MatcherType::BruteForce;
+            } else if (matcher == "kdforest") {
+                options.matcher.type = MatcherType::KDForest;
+            } else if (matcher == "kmeans") {
+                options.matcher.type = MatcherType::KMeansTree;
+            } else {
+                std::cout << usage << std::endl;
+                return -1;
+            }
+        } else if (arg == "--ratio" && i + 1 < argc) {
+            options.matcher.ratio = static_cast<float>(atof(argv[++i]));
+        } else if (arg == "--checks" && i + 1 < argc) {
+            options.matcher.checks = atoi(argv[++i]);
+        } else if (arg == "--no-cross-check") {
+            options.matcher.cross_check = false;
+        } else if (arg == "--no-refine") {
+            options.refine = false;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.ransac_seed = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--coarse" && i + 1 < argc) {
+            options.coarse.level = atoi(argv[++i]);
+        } else if (arg == "--no-overlap-refine") {
+            options.coarse.refine = false;
+        } else if (arg == "--detect-canvas") {
+            options.detect_canvas = true;
+        } else if (arg == "--overlap-regions" && i + 1 < argc) {
+            options.overlap_regions = atoi(argv[++i]);
+        } else if (arg == "--stream" && i + 1 < argc) {
+            stream_dir = argv[++i];
+        } else if (arg == "--stream-output" && i + 1 < argc) {
+            stream_output = argv[++i];
+        } else if (arg == "--revalidate" && i + 1 < argc) {
+            stream_options.revalidate_every = atoi(argv[++i]);
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_source = argv[++i];
+        } else if (arg == "--batch-output" && i + 1 < argc) {
+            batch_options.output_dir = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            batch_options.parallel_jobs = atoi(argv[++i]);
+        } else if (arg == "--tiled" && i + 1 < argc) {
+            tiled = true;
+            tiled_options.max_resident_bytes = static_cast<size_t>(strtoull(argv[++i], nullptr, 10)) << 20;
+        } else if (arg == "--tile-size" && i + 1 < argc) {
+            tiled_options.tile_size = atoi(argv[++i]);
+        } else if (arg == "--scratch" && i + 1 < argc) {
+            tiled_options.scratch_dir = argv[++i];
+        } else if (arg == "--warp-maps" && i + 1 < argc) {
+            std::string dir = argv[++i];
+            stream_options.use_warp_maps = dir != "off";
+            stream_options.warp_map_dir = dir != "off" ? dir : "";
+        } else {
+            std::cout << usage << std::endl;
+            return -1;
+        }
+    }
+    Profiler::instance().enable(!report_prefix.empty());
+
+    // per-stage loop settings: the saved profile, or one schedule for every stage
+    if (!loop_schedule.empty()) {
+        const size_t comma = loop_schedule.find(',');
+        LoopSettings settings;
+        if (!parseLoopSchedule(loop_schedule.substr(0, comma), settings.schedule)) {
+            std::cout << usage << std::endl;
+            return -1;
+        }
+        settings.chunk = comma == std::string::npos ? 0 : std::max(0, atoi(loop_schedule.c_str() + comma + 1));
+        for (int s = 0; s < kLoopStages; ++s) {
+            LoopTuning::instance().set(static_cast<LoopStage>(s), settings);
+        }
+    } else if (!autotune && loop_profile != "off" && std::filesystem::exists(loop_profile)) {
+        if (LoopTuning::instance().load(loop_profile)) {
+            std::cerr << "Loop profile " << loop_profile << " loaded" << std::endl;
+        } else {
+            std::cerr << "Loop profile " << loop_profile << " ignored (unreadable or tuned on another machine)" << std::endl;
+        }
+    }
+
+    if (!batch_source.empty()) {
+        std::vector<BatchJob> jobs;
+        if (std::filesystem::is_directory(batch_source)) {
+            for (const RigFrame& frame : listRigFrames(batch_source, {"_l.PNG", "_r.PNG"})) {
+                jobs.push_back(BatchJob{frame.name, frame.paths});
+            }
+        } else {
+            jobs = readBatchManifest(batch_source);
+        }
+        if (jobs.empty()) {
+            std::cerr << "No jobs found in " << batch_source << std::endl;
+            return -1;
+        }
+        batch_options.threads = thread_num;
+        BatchStats stats = runBatch(jobs, options, batch_options);
+        std::cout << "jobs,failed,parallel_jobs,threads_per_job,total_ms,panoramas_per_s,p50_ms,p99_ms" << std::endl;
+        std::cout << stats.jobs << "," << stats.failed << "," << stats.parallel_jobs << "," << stats.threads_per_job << ","
+                  << stats.total_ms << "," << stats.throughput << "," << stats.p50_ms << "," << stats.p99_ms << std::endl;
+        if (!report_prefix.empty()) {
+            Profiler::instance().addTime("total", stats.total_ms);
+            if (!Profiler::instance().writeJSON(report_prefix + ".json") || !Profiler::instance().writeCSV(report_prefix + ".csv")) {
+                std::cerr << "Could not write report " << report_prefix << std::endl;
+            }
+        }
+        return stats.failed == 0 ? 0 : -1;
+    }
+
+    if (!stream_dir.empty()) {
+        omp_set_num_threads(thread_num);
+        std::vector<RigFrame> frames = listRigFrames(stream_dir, {"_l.PNG", "_r.PNG"});
+        if (frames.empty()) {
+            std::cerr << "No frames found in " << stream_dir << std::endl;
+            return -1;
+        }
+        StreamStats stats = stitchRigStream(frames, stream_output, options, stream_options);
+        std::cout << stats.total_ms << std::endl;
+        std::cerr << stats.frames << " frames, " << stats.calibrations << " calibrations, "
+                  << (stats.total_ms > 0 ? stats.frames * 1000.0 / stats.total_ms : 0.0) << " frames/s" << std::endl;
+        if (!report_prefix.empty()) {
+            Profiler::instance().addTime("total", stats.total_ms);
+            if (!Profiler::instance().writeJSON(report_prefix + ".json") || !Profiler::instance().writeCSV(report_prefix + ".csv")) {
+                std::cerr << "Could not write report " << report_prefix << std::endl;
+            }
+        }
+        return 0;
+    }
+
+    // Load images
+    std::vector<cv::Mat> imgs;
+    if (!image_paths.empty()) {
+        for (const std::string& path : image_paths) {
+            imgs.push_back(cv::imread(path));
+            if (imgs.back().empty()) {
+                std::cerr << "Could not load image " << path << std::endl;
+                return -1;
+            }
+        }
+    } else {
+        cv::Mat img_center = cv::imread("../photos/data/mountain_center.jpg");
+        cv::Mat img_left = cv::imread("../photos/data/mountain_left.jpg");
+        cv::Mat img_right = cv::imread("../photos/data/mountain_right.jpg");
+
+        if (img_center.empty() || img_left.empty() || img_right.empty()) {
+            std::cerr << "Could not load images." << std::endl;
+            return -1;
+        }
+
+        if (options.composition == StitchComposition::Global || tiled) {
+            // global composition needs the images in sequence order, the middle one is the reference
+            imgs = {img_left, img_center, img_right};
+        } else {
+            imgs.push_back(img_center);
+            imgs.push_back(img_left);
+            imgs.push_back(img_right);
+        }
+    }
+
+    // set thread_num
+    omp_set_num_threads(thread_num);
+
+    if (autotune) {
+        std::vector<StageTuning> stages = autotuneLoops(imgs, options);
+        std::cerr << "stage,schedule,chunk,threads,default_ms,tuned_ms" << std::endl;
+        for (const StageTuning& stage : stages) {
+            std::cerr << loopStageName(stage.stage) << "," << loopScheduleName(stage.settings.schedule) << "," << stage.settings.chunk
+                      << "," << stage.settings.threads << "," << stage.default_ms << "," << stage.tuned_ms << std::endl;
+        }
+        if (loop_profile != "off") {
+            const std::string comment = "tuned with " + std::to_string(thread_num) + " threads on " + std::to_string(imgs.size()) +
+                                        " images of " + std::to_string(imgs[0].cols) + "x" + std::to_string(imgs[0].rows);
+            if (!LoopTuning::instance().save(loop_profile, comment)) {
+                std::cerr << "Could not write loop profile " << loop_profile << std::endl;
+            }
+        }
+    }
+
+    if (tiled) {
+        // out-of-core global composition, written out tile row by tile row
+        auto start_time = high_resolution_clock::now();
+        const GlobalLayout layout = estimateGlobalLayout(imgs, options);
+        TiledCanvas canvas(layout.canvas_size, tiled_options);
+        composeGlobal(imgs, layout, canvas, options);
+        auto duration_ms = std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start_time);
+        std::cout << duration_ms.count() << std::endl;
+        std::cerr << layout.canvas_size.width << "x" << layout.canvas_size.height << " canvas, " << canvas.allocatedTiles()
+                  << " tiles, " << canvas.spills() << " spills, " << canvas.loads() << " loads" << std::endl;
+
+        const bool ppm = std::filesystem::path(output_path).extension() == ".ppm";
+        if (!(ppm ? canvas.writePPM(output_path) : canvas.writeTiles(output_path))) {
+            std::cerr << "Could not write " << output_path << std::endl;
+            return -1;
+        }
+        if (!report_prefix.empty()) {
+            Profiler::instance().addTime("total", duration_ms.count());
+            Profiler::instance().addCounter("images", imgs.size());
+            if (!Profiler::instance().writeJSON(report_prefix + ".json") || !Profiler::instance().writeCSV(report_prefix + ".csv")) {
+                std::cerr << "Could not write report " << report_prefix << std::endl;
+            }
+        }
+        return 0;
+    }
+
+    auto start_time = high_resolution_clock::now();
+    // stitch images
+    Stitcher stitcher(options, thread_num);
+    cv::Mat result = stitcher.stitch(imgs).panorama;
+    auto end_time = high_resolution_clock::now();
+    auto duration_sec = std::chrono::duration_cast<duration<double, std::milli>>(end_time - start_time);
+
+    // std::cout<<"Success! Total time:"<< duration_sec.count()<<"ms"<<std::endl;
+    std::cout<<duration_sec.count()<<std::endl;
+
+    if (!report_prefix.empty()) {
+        Profiler::instance().addTime("total", duration_sec.count());
+        Profiler::instance().addCounter("images", imgs.size());
+        if (!Profiler::instance().writeJSON(report_prefix + ".json") || !Profiler::instance().writeCSV(report_prefix + ".csv")) {
+            std::cerr << "Could not write report " << report_prefix << std::endl;
+        }
+    }
+    
+
+    // Save the result
+    cv::imwrite(output_path, result);
+
+    // if (argc != 2) {
+    //     std::cout << "please run commond: ./stitch_image thread_num " << std::endl;
+    //     return -1;
+    // }
+    // int thread_num = atoi(argv[1]);
+
+    // std::vector<cv::Mat> imgs;
+    // for (int i = 2; i >= 0; i--) {
+    //     imgs.emplace_back(cv::imread("../photos/data/input/1114008" + std::to_string(i) + "_l.PNG"));
+    // }
+    // for (int i = 3; i < 6; i++) {
+    //     imgs.emplace_back(cv::imread("../photos/data/input/1114008" + std::to_string(i) + "_l.PNG"));
+    // } 
+
+    // // set thread_num
+    // omp_set_num_threads(thread_num);
+
+    // auto start_time = high_resolution_clock::now();
+    // // stitch images
+    // cv::Mat result = stitchImg(imgs);
+    // auto end_time = high_resolution_clock::now();
+    // auto duration_sec = std::chrono::duration_cast<duration<double, std::milli>>(end_time - start_time);
+
+    // // std::cout<<"Success! Total time:"<< duration_sec.count()<<"ms"<<std::endl;
+    // std::cout<<duration_sec.count()<<std::endl;
+    // // Save the result
+    // cv::imwrite("../photos/data/stitched_school.png", result);
+
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "stitcher.h"
+#include <chrono>
+#include <stdexcept>
+#include <omp.h>
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+Stitcher::Stitcher(const StitchOptions& options, int threads) : options_(options), threads_(0) {
+    setThreads(threads);
+}
+
+void Stitcher::setThreads(int threads) {
+    if (threads < 0) {
+        throw std::invalid_argument("Error: threads must not be negative.");
+    }
+    threads_ = threads > 0 ? threads : omp_get_max_threads();
+}
+
+StitchResult Stitcher::stitch(const std::vector<cv::Mat>& imgs) {
+    // *** Validate Inputs ***
+    if (imgs.empty()) {
+        throw std::invalid_argument("Error: no input images.");
+    }
+    for (const cv::Mat& img : imgs) {
+        if (img.empty() || img.type() != CV_8UC3) {
+            throw std::invalid_argument("Error: every image must be a non-empty CV_8UC3 (3-channel, uint8) image.");
+        }
+    }
+
+    // the team size is a setting of the calling thread, restore it for the caller
+    const int caller_threads = omp_get_max_threads();
+    omp_set_num_threads(threads_);
+    auto start_time = high_resolution_clock::now();
+    StitchResult result;
+    try {
+        result.panorama = stitchImg(imgs, options_, &pool_);
+    } catch (...) {
+        omp_set_num_threads(caller_threads);
+        ++totals_.calls;
+        ++totals_.failed;
+        throw;
+    }
+    omp_set_num_threads(caller_threads);
+
+    result.stats.images = static_cast<int>(imgs.size());
+    result.stats.panorama_size = result.panorama.size();
+    result.stats.total_ms = std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start_time).count();
+    ++totals_.calls;
+    totals_.total_ms += result.stats.total_ms;
+    return result;
+}
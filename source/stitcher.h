@@ -0,0 +1,61 @@
+#ifndef STITCHER_H
+#define STITCHER_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "stitchImg.h"
+#include "matPool.h"
+
+// Library entry point for embedding the stitcher in a long-running service.
+// A Stitcher keeps its configuration and its OpenMP team size across calls. Calls made from the same
+// thread reuse the OpenMP worker threads of that thread and the SIFT detectors already created on them
+// (see detectSIFTFeatures), so only the first job pays the setup cost.
+// The canvas-sized matrices of the iterative composition come from a pool owned by the Stitcher, so a call
+// starts with the buffers of the previous one (grown as needed) instead of mapping and zeroing new ones.
+// They stay mapped for the lifetime of the Stitcher.
+// One Stitcher serves one calling thread at a time; use one per worker thread to run jobs concurrently.
+
+// Measurements of one stitch() call
+struct StitchStats {
+    int images = 0;
+    cv::Size panorama_size;
+    double total_ms = 0.0;
+};
+
+struct StitchResult {
+    cv::Mat panorama;  // CV_8UC3
+    StitchStats stats;
+};
+
+// Totals over the calls served by a Stitcher
+struct StitcherTotals {
+    int calls = 0;
+    int failed = 0;
+    double total_ms = 0.0;
+};
+
+class Stitcher {
+public:
+    // threads: OpenMP threads per call, 0 = omp_get_max_threads() of the constructing thread
+    explicit Stitcher(const StitchOptions& options = StitchOptions(), int threads = 0);
+
+    const StitchOptions& options() const { return options_; }
+    void setOptions(const StitchOptions& options) { options_ = options; }
+    int threads() const { return threads_; }
+    void setThreads(int threads);
+
+    // Stitch in-memory BGR images (CV_8UC3), in the order of options().composition.
+    // Throws std::invalid_argument for an empty list or images of another type; errors of the pipeline
+    // (e.g. too few matches) are rethrown and counted as failed calls.
+    StitchResult stitch(const std::vector<cv::Mat>& imgs);
+
+    const StitcherTotals& totals() const { return totals_; }
+
+private:
+    StitchOptions options_;
+    int threads_;
+    StitcherTotals totals_;
+    MatPool pool_;  // canvas buffers reused across calls
+};
+
+#endif // STITCHER_H
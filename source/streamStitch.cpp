@@ -0,0 +1,283 @@
+#include "streamStitch.h"
+#include "helper.h"
+#include "homography.h"
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+namespace {
+
+// Bounded blocking queue between two pipeline stages. close() wakes every waiter: push() then drops the item
+// and pop() drains the remaining items before returning nothing.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [&] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        items_.push(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items_.front());
+        items_.pop();
+        not_full_.notify_one();
+        return item;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    bool closed_ = false;
+    std::queue<T> items_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+struct DecodedFrame {
+    std::string name;
+    std::vector<cv::Mat> imgs;
+};
+
+struct StitchedFrame {
+    std::string name;
+    cv::Mat panorama;
+};
+
+double elapsedMs(high_resolution_clock::time_point start) {
+    return std::chrono::duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+}
+
+std::string warpMapPath(const std::string& dir, int camera) {
+    return (std::filesystem::path(dir) / ("camera_" + std::to_string(camera) + ".warpmap")).string();
+}
+
+// Maps stored by an earlier run, usable only if there is one per camera with the current image sizes and sampling
+bool loadWarpMaps(const std::string& dir, const std::vector<cv::Mat>& imgs, WarpInterp mode, std::vector<WarpMap>& maps) {
+    std::vector<WarpMap> loaded(imgs.size());
+    for (size_t i = 0; i < imgs.size(); ++i) {
+        if (!loaded[i].load(warpMapPath(dir, static_cast<int>(i))) || loaded[i].srcSize() != imgs[i].size() ||
+            loaded[i].mode() != mode || loaded[i].canvasSize() != loaded[0].canvasSize()) {
+            return false;
+        }
+    }
+    maps.swap(loaded);
+    return true;
+}
+
+bool sizesMatch(const std::vector<WarpMap>& maps, const std::vector<cv::Mat>& imgs) {
+    if (maps.size() != imgs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < maps.size(); ++i) {
+        if (maps[i].srcSize() != imgs[i].size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<RigFrame> listRigFrames(const std::string& dir, const std::vector<std::string>& suffixes) {
+    if (suffixes.empty()) {
+        throw std::invalid_argument("Error: at least one camera suffix is needed.");
+    }
+    std::vector<RigFrame> frames;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        const std::string file = entry.path().filename().string();
+        const std::string& first = suffixes[0];
+        if (file.size() <= first.size() || file.compare(file.size() - first.size(), first.size(), first) != 0) {
+            continue;
+        }
+        RigFrame frame;
+        frame.name = file.substr(0, file.size() - first.size());
+        for (const std::string& suffix : suffixes) {
+            std::filesystem::path path = std::filesystem::path(dir) / (frame.name + suffix);
+            if (!std::filesystem::exists(path)) {
+                break;
+            }
+            frame.paths.push_back(path.string());
+        }
+        if (frame.paths.size() == suffixes.size()) {
+            frames.push_back(frame);
+        }
+    }
+    std::sort(frames.begin(), frames.end(), [](const RigFrame& a, const RigFrame& b) { return a.name < b.name; });
+    return frames;
+}
+
+GlobalLayout layoutFromWarpMaps(const std::vector<WarpMap>& maps, const StitchOptions& options) {
+    if (maps.empty()) {
+        throw std::invalid_argument("Error: no warp maps.");
+    }
+    const int n = static_cast<int>(maps.size());
+    GlobalLayout layout;
+    layout.reference = options.reference >= 0 && options.reference < n ? options.reference : n / 2;
+    layout.canvas_size = maps[0].canvasSize();
+    for (int i = 0; i < n; ++i) {
+        layout.canvas_to_img.push_back(maps[i].homography());
+    }
+    // imgs[i + 1] -> canvas -> imgs[i]
+    for (int i = 0; i + 1 < n; ++i) {
+        layout.pair_H.push_back(layout.canvas_to_img[i] * layout.canvas_to_img[i + 1].inverse());
+    }
+    return layout;
+}
+
+double layoutAgreement(const std::vector<cv::Mat>& imgs, const GlobalLayout& layout, const StitchOptions& options) {
+    if (layout.pair_H.size() + 1 != imgs.size()) {
+        throw std::invalid_argument("Error: the layout does not match the number of images.");
+    }
+    double agreement = 1.0;
+    for (size_t i = 0; i + 1 < imgs.size(); ++i) {
+        auto [xs, xd] = genSIFTMatches(imgs[i + 1], imgs[i], options.matcher, options.features);
+        if (xs.empty()) {
+            return 0.0;
+        }
+        std::vector<Eigen::Vector2d> projected = applyHomography(layout.pair_H[i], xs);
+        size_t agree = 0;
+        for (size_t k = 0; k < xs.size(); ++k) {
+            agree += (projected[k] - xd[k]).norm() < options.ransac_eps;
+        }
+        agreement = std::min(agreement, static_cast<double>(agree) / xs.size());
+    }
+    return agreement;
+}
+
+StreamStats stitchRigStream(const std::vector<RigFrame>& frames, const std::string& output_dir,
+                            const StitchOptions& options, const StreamOptions& stream) {
+    std::filesystem::create_directories(output_dir);
+    BoundedQueue<DecodedFrame> decoded(stream.queue_depth);
+    BoundedQueue<StitchedFrame> stitched(stream.queue_depth);
+    StreamStats stats;
+    auto start_time = high_resolution_clock::now();
+
+    // 1. decode thread: reads frame N + 1 while frame N is composed
+    std::thread reader([&] {
+        for (const RigFrame& frame : frames) {
+            ScopedTimer decode_timer("streamDecode");
+            DecodedFrame item{frame.name, {}};
+            for (const std::string& path : frame.paths) {
+                item.imgs.push_back(cv::imread(path));
+                if (item.imgs.back().empty()) {
+                    std::cerr << "Could not load image " << path << ", frame skipped" << std::endl;
+                    break;
+                }
+            }
+            decode_timer.stop();
+            if (item.imgs.empty() || item.imgs.back().empty()) {
+                continue;
+            }
+            if (!decoded.push(std::move(item))) {
+                break;
+            }
+        }
+        decoded.close();
+    });
+
+    // 2. encode thread: writes frame N - 1 while frame N is composed
+    std::thread writer([&] {
+        while (std::optional<StitchedFrame> item = stitched.pop()) {
+            ScopedTimer encode_timer("streamEncode");
+            const std::string path = (std::filesystem::path(output_dir) / (item->name + "_stitched.png")).string();
+            if (!cv::imwrite(path, item->panorama)) {
+                std::cerr << "Could not write " << path << std::endl;
+            }
+        }
+    });
+
+    // 3. compose on the calling thread, it owns the OpenMP team
+    try {
+        std::optional<GlobalLayout> layout;
+        std::vector<WarpMap> maps;
+        int index = 0;
+        while (std::optional<DecodedFrame> item = decoded.pop()) {
+            auto frame_start = high_resolution_clock::now();
+            if (!layout && stream.use_warp_maps && !stream.warp_map_dir.empty() &&
+                loadWarpMaps(stream.warp_map_dir, item->imgs, options.interp, maps)) {
+                // hot start: the calibration of an earlier run
+                layout = layoutFromWarpMaps(maps, options);
+                Profiler::instance().addCounter("warp_maps_loaded", maps.size());
+            }
+            bool calibrate = !layout || (stream.use_warp_maps && !sizesMatch(maps, item->imgs));
+            if (!calibrate && stream.revalidate_every > 0 && index % stream.revalidate_every == 0) {
+                ScopedTimer validate_timer("streamValidate");
+                calibrate = layoutAgreement(item->imgs, *layout, options) < stream.min_agreement;
+            }
+            if (calibrate) {
+                ScopedTimer calibrate_timer("streamCalibrate");
+                layout = estimateGlobalLayout(item->imgs, options);
+                ++stats.calibrations;
+                if (stream.use_warp_maps) {
+                    std::vector<cv::Size> sizes;
+                    for (const cv::Mat& img : item->imgs) {
+                        sizes.push_back(img.size());
+                    }
+                    maps = buildWarpMaps(*layout, sizes, options.interp);
+                    if (!stream.warp_map_dir.empty()) {
+                        std::filesystem::create_directories(stream.warp_map_dir);
+                        for (size_t i = 0; i < maps.size(); ++i) {
+                            const std::string path = warpMapPath(stream.warp_map_dir, static_cast<int>(i));
+                            if (!maps[i].save(path)) {
+                                std::cerr << "Could not write warp map " << path << std::endl;
+                            }
+                        }
+                    }
+                }
+            }
+            cv::Mat panorama = composeGlobal(item->imgs, *layout, options, stream.use_warp_maps ? &maps : nullptr);
+            Profiler::instance().addTime("streamFrame", elapsedMs(frame_start));
+            ++stats.frames;
+            ++index;
+            if (!stitched.push(StitchedFrame{item->name, panorama})) {
+                break;
+            }
+        }
+    } catch (...) {
+        decoded.close();
+        stitched.close();
+        reader.join();
+        writer.join();
+        throw;
+    }
+    decoded.close();
+    stitched.close();
+    reader.join();
+    writer.join();
+
+    stats.total_ms = elapsedMs(start_time);
+    Profiler::instance().addCounter("stream_frames", stats.frames);
+    Profiler::instance().addCounter("stream_calibrations", stats.calibrations);
+    return stats;
+}
@@ -0,0 +1,51 @@
+#ifndef STREAM_STITCH_H
+#define STREAM_STITCH_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "stitchImg.h"
+#include "warpMap.h"
+
+// Streaming mode for a fixed camera rig.
+// The relative geometry of the cameras never changes, so the layout (homographies and canvas) is estimated
+// on the first frame only and every later frame just runs warp and blend. Decoding frame N + 1, composing
+// frame N and encoding frame N - 1 run on separate threads connected by bounded queues.
+// The warps of a calibration are precomputed as WarpMaps, so a frame only gathers and blends; with
+// warp_map_dir the maps are kept on disk and a later run starts without calibrating.
+
+struct StreamOptions {
+    int revalidate_every = 0;       // check the calibration every K frames against fresh matches, 0 = never
+    double min_agreement = 0.5;     // recalibrate when fewer matches than this agree with the calibration
+    int queue_depth = 2;            // frames buffered between the decode, compose and encode threads
+    bool use_warp_maps = true;      // precompute the warp of every camera once per calibration
+    std::string warp_map_dir;       // load / store the warp maps as <dir>/camera_<i>.warpmap, empty = memory only
+};
+
+// Image files of one time step, one per camera, in panorama order
+struct RigFrame {
+    std::string name;
+    std::vector<std::string> paths;
+};
+
+struct StreamStats {
+    int frames = 0;
+    int calibrations = 0;
+    double total_ms = 0.0;
+};
+
+// Time steps of a rig stored as <dir>/<name><suffix> for every suffix (e.g. "_l.PNG", "_r.PNG"), sorted by name.
+// Names missing one of the cameras are skipped.
+std::vector<RigFrame> listRigFrames(const std::string& dir, const std::vector<std::string>& suffixes);
+
+// Layout of a calibration stored as warp maps (the maps carry the canvas to camera homographies)
+GlobalLayout layoutFromWarpMaps(const std::vector<WarpMap>& maps, const StitchOptions& options = StitchOptions());
+
+// Share of the matches of every neighbour pair that the layout maps within options.ransac_eps (minimum over pairs)
+double layoutAgreement(const std::vector<cv::Mat>& imgs, const GlobalLayout& layout, const StitchOptions& options);
+
+// Stitch every frame and write <output_dir>/<name>_stitched.png
+StreamStats stitchRigStream(const std::vector<RigFrame>& frames, const std::string& output_dir,
+                            const StitchOptions& options = StitchOptions(), const StreamOptions& stream = StreamOptions());
+
+#endif // STREAM_STITCH_H
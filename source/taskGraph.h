@@ -0,0 +1,109 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <algorithm>
+#include <chrono>
+#include <omp.h>
+#include "loopTuning.h"
+#include "profiler.h"
+
+// OpenMP task helpers of the pipelined stitcher.
+// Stages of stitchImgGlobal run as tasks of one team (see stitchGlobal.cpp), so a loop inside a stage must not
+// open a nested parallel region: nesting is inactive by default and the loop would run on one thread, with it
+// enabled the machine would be oversubscribed. These helpers open a team when called from serial code and
+// otherwise hand the work to the running team as tasks, where idle threads pick it up.
+
+// body(i) for i in [0, n), grain iterations per task
+template <typename F>
+void parallelFor(int n, int grain, F&& body) {
+    if (n <= 0) {
+        return;
+    }
+    if (omp_in_parallel()) {
+        #pragma omp taskloop grainsize(grain) shared(body)
+        for (int i = 0; i < n; ++i) {
+            body(i);
+        }
+    } else {
+        #pragma omp parallel for schedule(dynamic, grain)
+        for (int i = 0; i < n; ++i) {
+            body(i);
+        }
+    }
+}
+
+// parallelFor with the settings of stage (see loopTuning.h): grain is the default chunk of the loop.
+// As a taskloop inside a running team only the chunk applies, the team and its scheduling are the caller's.
+template <typename F>
+void parallelFor(LoopStage stage, int n, int grain, F&& body) {
+    if (n <= 0) {
+        return;
+    }
+    LoopTuning& tuning = LoopTuning::instance();
+    const LoopSettings& settings = tuning.settings(stage);
+    const int chunk = settings.chunk > 0 ? settings.chunk : std::max(1, grain);
+    const bool measuring = tuning.measuring();
+    const auto start_time = measuring ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    if (omp_in_parallel()) {
+        #pragma omp taskloop grainsize(chunk) shared(body)
+        for (int i = 0; i < n; ++i) {
+            body(i);
+        }
+    } else {
+        const int threads = settings.threads > 0 ? std::min(settings.threads, omp_get_max_threads()) : omp_get_max_threads();
+        switch (settings.schedule) {
+            case LoopSchedule::Static:
+                #pragma omp parallel for schedule(static, chunk) num_threads(threads)
+                for (int i = 0; i < n; ++i) {
+                    body(i);
+                }
+                break;
+            case LoopSchedule::Guided:
+                #pragma omp parallel for schedule(guided, chunk) num_threads(threads)
+                for (int i = 0; i < n; ++i) {
+                    body(i);
+                }
+                break;
+            default:
+                #pragma omp parallel for schedule(dynamic, chunk) num_threads(threads)
+                for (int i = 0; i < n; ++i) {
+                    body(i);
+                }
+                break;
+        }
+    }
+    if (measuring) {
+        tuning.record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
+    }
+}
+
+// body(i) for i in [0, n), one task each; returns when all tasks are done.
+// The tasks record under the profiler iteration of the caller.
+template <typename F>
+void runTasks(int n, F&& body) {
+    const int iteration = Profiler::instance().iteration();
+    auto task = [&](int i) {
+        ScopedIteration tag(iteration);
+        body(i);
+    };
+    if (omp_in_parallel()) {
+        #pragma omp taskgroup
+        {
+            for (int i = 0; i < n; ++i) {
+                #pragma omp task firstprivate(i) shared(task)
+                task(i);
+            }
+        }
+    } else {
+        #pragma omp parallel
+        #pragma omp single
+        {
+            for (int i = 0; i < n; ++i) {
+                #pragma omp task firstprivate(i) shared(task)
+                task(i);
+            }
+        }
+    }
+}
+
+#endif // TASK_GRAPH_H
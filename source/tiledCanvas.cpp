@@ -0,0 +1,220 @@
+#include "tiledCanvas.h"
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+TiledCanvas::TiledCanvas(cv::Size size, const TiledCanvasOptions& options)
+    : size_(size), tile_size_(options.tile_size), max_resident_bytes_(options.max_resident_bytes),
+      scratch_dir_(options.scratch_dir) {
+    if (size.width <= 0 || size.height <= 0) {
+        throw std::invalid_argument("Error: the canvas size must be positive.");
+    }
+    if (options.tile_size <= 0) {
+        throw std::invalid_argument("Error: tile_size must be positive.");
+    }
+    tiles_x_ = (size.width + tile_size_ - 1) / tile_size_;
+    tiles_y_ = (size.height + tile_size_ - 1) / tile_size_;
+    const size_t tiles = static_cast<size_t>(tiles_x_) * tiles_y_;
+    state_.assign(tiles, TileState::Empty);
+    resident_.resize(tiles);
+    lru_pos_.resize(tiles);
+}
+
+TiledCanvas::~TiledCanvas() {
+    if (scratch_) {
+        ::munmap(scratch_, scratch_bytes_);
+    }
+    if (scratch_fd_ >= 0) {
+        ::close(scratch_fd_);
+    }
+}
+
+cv::Rect TiledCanvas::tileRect(int tx, int ty) const {
+    const int x = tx * tile_size_, y = ty * tile_size_;
+    return cv::Rect(x, y, std::min(tile_size_, size_.width - x), std::min(tile_size_, size_.height - y));
+}
+
+bool TiledCanvas::allocated(int tx, int ty) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_[ty * tiles_x_ + tx] != TileState::Empty;
+}
+
+size_t TiledCanvas::tileBytes(int index) const {
+    return tileRect(index % tiles_x_, index / tiles_x_).area() * size_t(3);
+}
+
+uchar* TiledCanvas::slot(int index) const {
+    return scratch_ + static_cast<size_t>(index) * slot_bytes_;
+}
+
+cv::Mat TiledCanvas::view(int index) const {
+    if (state_[index] == TileState::Resident) {
+        return resident_[index];
+    }
+    // spilled tiles are stored row after row without padding
+    return cv::Mat(tileRect(index % tiles_x_, index / tiles_x_).size(), CV_8UC3, slot(index));
+}
+
+void TiledCanvas::openScratch() {
+    const std::filesystem::path dir = scratch_dir_.empty() ? std::filesystem::temp_directory_path()
+                                                           : std::filesystem::path(scratch_dir_);
+    std::string name = (dir / "tiledCanvas_XXXXXX").string();
+    scratch_fd_ = ::mkstemp(&name[0]);
+    if (scratch_fd_ < 0) {
+        throw std::runtime_error("Error: could not create the scratch file in " + dir.string() + ".");
+    }
+    // the file only lives as long as the descriptor
+    ::unlink(name.c_str());
+
+    // page-aligned slots, so a spilled tile can be dropped from memory on its own
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    slot_bytes_ = (static_cast<size_t>(tile_size_) * tile_size_ * 3 + page - 1) / page * page;
+    scratch_bytes_ = slot_bytes_ * state_.size();
+    // sparse: disk space is only used by the tiles that are spilled
+    if (::ftruncate(scratch_fd_, static_cast<off_t>(scratch_bytes_)) != 0) {
+        throw std::runtime_error("Error: could not size the scratch file.");
+    }
+    void* data = ::mmap(nullptr, scratch_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, scratch_fd_, 0);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Error: could not map the scratch file.");
+    }
+    scratch_ = static_cast<uchar*>(data);
+}
+
+void TiledCanvas::spill(int index) {
+    if (!scratch_) {
+        openScratch();
+    }
+    // 1. copy to the slot, then let the kernel write the pages back and drop them from this process
+    cv::Mat stored(resident_[index].size(), CV_8UC3, slot(index));
+    resident_[index].copyTo(stored);
+    ::madvise(slot(index), slot_bytes_, MADV_DONTNEED);
+
+    // 2. release the tile
+    lru_.erase(lru_pos_[index]);
+    resident_[index].release();
+    resident_bytes_ -= tileBytes(index);
+    state_[index] = TileState::Spilled;
+    ++spills_;
+}
+
+cv::Mat TiledCanvas::tile(int tx, int ty) {
+    if (tx < 0 || ty < 0 || tx >= tiles_x_ || ty >= tiles_y_) {
+        throw std::invalid_argument("Error: tile index out of range.");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int index = ty * tiles_x_ + tx;
+    if (state_[index] == TileState::Resident) {
+        lru_.splice(lru_.begin(), lru_, lru_pos_[index]);
+        return resident_[index];
+    }
+
+    // 1. make room: spill the least recently used tiles (one tile always stays resident)
+    const size_t bytes = tileBytes(index);
+    while (!lru_.empty() && resident_bytes_ + bytes > max_resident_bytes_) {
+        spill(lru_.back());
+    }
+
+    // 2. allocate, or load the spilled content
+    cv::Mat pixels;
+    if (state_[index] == TileState::Spilled) {
+        view(index).copyTo(pixels);
+        ++loads_;
+    } else {
+        pixels = cv::Mat::zeros(tileRect(tx, ty).size(), CV_8UC3);
+    }
+    resident_[index] = pixels;
+    state_[index] = TileState::Resident;
+    lru_.push_front(index);
+    lru_pos_[index] = lru_.begin();
+    resident_bytes_ += bytes;
+    return pixels;
+}
+
+cv::Mat TiledCanvas::read(const cv::Rect& rect) const {
+    if ((rect & cv::Rect(0, 0, size_.width, size_.height)) != rect) {
+        throw std::invalid_argument("Error: the rectangle must lie inside the canvas.");
+    }
+    cv::Mat result = cv::Mat::zeros(rect.size(), CV_8UC3);
+    if (rect.empty()) {
+        return result;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int ty = rect.y / tile_size_; ty <= (rect.y + rect.height - 1) / tile_size_; ++ty) {
+        for (int tx = rect.x / tile_size_; tx <= (rect.x + rect.width - 1) / tile_size_; ++tx) {
+            const int index = ty * tiles_x_ + tx;
+            if (state_[index] == TileState::Empty) {
+                continue;
+            }
+            const cv::Rect tile_rect = tileRect(tx, ty);
+            const cv::Rect part = tile_rect & rect;
+            view(index)(cv::Rect(part.x - tile_rect.x, part.y - tile_rect.y, part.width, part.height))
+                .copyTo(result(cv::Rect(part.x - rect.x, part.y - rect.y, part.width, part.height)));
+        }
+    }
+    return result;
+}
+
+bool TiledCanvas::writePPM(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    out << "P6\n" << size_.width << " " << size_.height << "\n255\n";
+    std::vector<uchar> row(size_.width * size_t(3));
+    for (int ty = 0; ty < tiles_y_; ++ty) {
+        const cv::Rect strip_rect = cv::Rect(0, ty * tile_size_, size_.width, tileRect(0, ty).height);
+        const cv::Mat strip = read(strip_rect);
+        for (int r = 0; r < strip.rows; ++r) {
+            // BGR to RGB
+            const uchar* s = strip.ptr<uchar>(r);
+            for (int x = 0; x < size_.width; ++x) {
+                row[3 * x] = s[3 * x + 2];
+                row[3 * x + 1] = s[3 * x + 1];
+                row[3 * x + 2] = s[3 * x];
+            }
+            out.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool TiledCanvas::writeTiles(const std::string& dir) const {
+    std::filesystem::create_directories(dir);
+    std::ofstream layout(std::filesystem::path(dir) / "layout.txt");
+    if (!layout) {
+        return false;
+    }
+    layout << size_.width << " " << size_.height << " " << tile_size_ << "\n";
+    for (int ty = 0; ty < tiles_y_; ++ty) {
+        for (int tx = 0; tx < tiles_x_; ++tx) {
+            if (!allocated(tx, ty)) {
+                continue;
+            }
+            const std::string name = "tile_" + std::to_string(ty) + "_" + std::to_string(tx) + ".png";
+            if (!cv::imwrite((std::filesystem::path(dir) / name).string(), read(tileRect(tx, ty)))) {
+                return false;
+            }
+        }
+    }
+    return static_cast<bool>(layout);
+}
+
+size_t TiledCanvas::residentBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resident_bytes_;
+}
+
+size_t TiledCanvas::allocatedTiles() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (TileState state : state_) {
+        count += state != TileState::Empty;
+    }
+    return count;
+}
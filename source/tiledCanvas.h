@@ -0,0 +1,87 @@
+#ifndef TILED_CANVAS_H
+#define TILED_CANVAS_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Memory bounds of a TiledCanvas
+struct TiledCanvasOptions {
+    int tile_size = 512;                          // tile edge in pixels
+    size_t max_resident_bytes = size_t(512) << 20; // tiles kept in memory, the least recently used ones are spilled
+    std::string scratch_dir;                      // directory of the scratch file, empty for the system temp directory
+};
+
+// 8-bit panorama canvas (CV_8UC3, pixels equal to 0 in all channels are empty) too large for one cv::Mat.
+// The canvas is cut into fixed-size tiles. A tile is only allocated when it is first written; the resident
+// tiles are bounded by max_resident_bytes, and the least recently used ones are spilled to a memory-mapped
+// scratch file and loaded again on the next access. The scratch file is sparse and is removed with the canvas.
+class TiledCanvas {
+public:
+    explicit TiledCanvas(cv::Size size, const TiledCanvasOptions& options = TiledCanvasOptions());
+    ~TiledCanvas();
+
+    TiledCanvas(const TiledCanvas&) = delete;
+    TiledCanvas& operator=(const TiledCanvas&) = delete;
+
+    cv::Size size() const { return size_; }
+    int tileSize() const { return tile_size_; }
+    int tilesX() const { return tiles_x_; }
+    int tilesY() const { return tiles_y_; }
+    // Canvas rectangle of tile (tx, ty); the last row / column of tiles may be smaller
+    cv::Rect tileRect(int tx, int ty) const;
+    // True once the tile has been written
+    bool allocated(int tx, int ty) const;
+
+    // Writable tile (zeros on first access), loaded from the scratch file if it was spilled.
+    // The Mat stays valid until the next call to tile(), which may spill it.
+    cv::Mat tile(int tx, int ty);
+    // Copy of a canvas rectangle; tiles that were never written read as 0. Nothing is loaded or spilled.
+    cv::Mat read(const cv::Rect& rect) const;
+
+    // Streaming output, one row of tiles at a time: binary PPM (P6) of the whole canvas,
+    // or one PNG per written tile (<dir>/tile_<ty>_<tx>.png). Return false if a file could not be written.
+    bool writePPM(const std::string& path) const;
+    bool writeTiles(const std::string& dir) const;
+
+    size_t residentBytes() const;
+    size_t allocatedTiles() const;
+    size_t spills() const { return spills_; }
+    size_t loads() const { return loads_; }
+
+private:
+    enum class TileState : char { Empty, Resident, Spilled };
+
+    size_t tileBytes(int index) const;
+    uchar* slot(int index) const;
+    cv::Mat view(int index) const;
+    void spill(int index);
+    void openScratch();
+
+    cv::Size size_;
+    int tile_size_;
+    int tiles_x_;
+    int tiles_y_;
+    size_t max_resident_bytes_;
+    std::string scratch_dir_;
+
+    mutable std::mutex mutex_;
+    std::vector<TileState> state_;
+    std::vector<cv::Mat> resident_;               // per tile, empty unless Resident
+    std::list<int> lru_;                          // resident tiles, most recently used first
+    std::vector<std::list<int>::iterator> lru_pos_;
+    size_t resident_bytes_ = 0;
+    size_t spills_ = 0;
+    size_t loads_ = 0;
+
+    // scratch file: one page-aligned slot of tile_size^2 pixels per tile, mapped on the first spill
+    int scratch_fd_ = -1;
+    uchar* scratch_ = nullptr;
+    size_t slot_bytes_ = 0;
+    size_t scratch_bytes_ = 0;
+};
+
+#endif // TILED_CANVAS_H
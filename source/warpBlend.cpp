@@ -0,0 +1,270 @@
+#include "warpBlend.h"
+#include "backwardWarpImg.h"
+#include "featherWeight.h"
+#include "common.h"
+#include "profiler.h"
+#include "taskGraph.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <omp.h>
+
+namespace {
+
+// Canvas rows handled per task of the fused pass
+constexpr int kTileRows = 16;
+
+// Distance fields of the canvas (on the footprint padded by kFeatherMargin) and of the footprint
+struct BlendFields {
+    cv::Rect window;
+    cv::Mat dist1;     // window.size()
+    cv::Mat dist2;     // roi.size() + a one pixel ring
+};
+
+// Canvas window of the distance fields: the footprint padded by kFeatherMargin, so the capped canvas
+// distances on the footprint are exact
+cv::Rect blendWindow(const cv::Rect& roi, cv::Size canvas_size) {
+    return cv::Rect(roi.x - kFeatherMargin, roi.y - kFeatherMargin,
+                    roi.width + 2 * kFeatherMargin, roi.height + 2 * kFeatherMargin) &
+           cv::Rect(0, 0, canvas_size.width, canvas_size.height);
+}
+
+// canvas_window: canvas content on window (see blendWindow)
+// footprint_row(r, m) writes the 0 / 1 mask of footprint row r (roi.width bytes)
+template <typename FootprintRow>
+BlendFields blendFields(const cv::Mat& canvas_window, const cv::Rect& window, const cv::Rect& roi, FootprintRow&& footprint_row) {
+    PROFILE_SCOPE("warpBlend.distance");
+    BlendFields fields;
+    fields.window = window;
+    cv::Mat mask1(window.size(), CV_8U);
+    cv::Mat mask2 = cv::Mat::zeros(roi.height + 2, roi.width + 2, CV_8U);
+
+    parallelFor(LoopStage::WarpBlendRows, window.height, kTileRows, [&](int r) {
+        const uchar* c = canvas_window.ptr<uchar>(r);
+        uchar* m = mask1.ptr<uchar>(r);
+        for (int x = 0; x < window.width; ++x) {
+            m[x] = (c[3 * x] | c[3 * x + 1] | c[3 * x + 2]) ? 255 : 0;
+        }
+    });
+
+    parallelFor(LoopStage::WarpBlendRows, roi.height, kTileRows, [&](int r) {
+        uchar* m = mask2.ptr<uchar>(r + 1) + 1;
+        footprint_row(r, m);
+        for (int x = 0; x < roi.width; ++x) {
+            m[x] *= 255;
+        }
+    });
+
+    // Distance Transform (these functions are already optimized in OpenCV)
+    cv::distanceTransform(mask1, fields.dist1, cv::DIST_L2, 3);
+    cv::distanceTransform(mask2, fields.dist2, cv::DIST_L2, 3);
+    return fields;
+}
+
+// Blend len warped pixels (row_img, row_mask) of footprint row r starting at canvas column x_begin into the canvas.
+// out: canvas pixel (x_begin, roi.y + r); row_img: float32 in [0, 1] or uint8
+template <typename T>
+inline void blendRow(uchar* out, const BlendFields& fields, const cv::Rect& roi, int r, int x_begin, int len,
+                     const T* row_img, const uchar* row_mask) {
+    constexpr float kInvMax = 1.0f / WarpPixel<T>::kMax;
+    const float* d1 = fields.dist1.ptr<float>(roi.y - fields.window.y + r) + (x_begin - fields.window.x);
+    const float* d2 = fields.dist2.ptr<float>(r + 1) + 1 + (x_begin - roi.x);
+    for (int i = 0; i < len; ++i) {
+        if (!row_mask[i]) {
+            continue;  // canvas pixel unchanged
+        }
+        const T* c2 = &row_img[i * 3];
+        // canvas weight is 0 on empty canvas pixels (their distance is 0)
+        float w1 = featherWeight(d1[i]);
+        float w2 = featherWeight(d2[i]);
+        float sum = w1 + w2;
+        if (sum <= 0.0f) {
+            w2 = sum = 1.0f;
+        }
+        // (img1 * w1 + img2 * w2) / (w1 + w2), with img1 = canvas / 255 and img2 = row_img / kMax
+        float a = w1 / (sum * 255.0f);
+        float b = w2 / sum * kInvMax;
+        for (int k = 0; k < 3; ++k) {
+            out[3 * i + k] = cv::saturate_cast<uchar>((out[3 * i + k] * a + c2[k] * b) * 255.0f);
+        }
+    }
+}
+
+// Fused pass: warp a tile of rows into a row buffer and blend it straight into the 8-bit canvas
+template <typename T>
+void warpBlendTiles(cv::Mat& canvas, const cv::Mat& src_img, const double* H, const std::vector<WarpSpan>& spans,
+                    const cv::Rect& roi, const BlendFields& fields, WarpInterp mode) {
+    const WarpSourceT<T> src = {src_img.ptr<T>(), src_img.step / sizeof(T), src_img.cols, src_img.rows};
+    const int tiles = (roi.height + kTileRows - 1) / kTileRows;
+
+    PROFILE_SCOPE("warpBlend.tiles");
+    parallelFor(LoopStage::WarpBlendTiles, tiles, 1, [&](int t) {
+        // row buffers of the tile, footprint width only
+        std::vector<T> row_img(roi.width * 3);
+        std::vector<uchar> row_mask(roi.width);
+
+        const int r_end = std::min(roi.height, (t + 1) * kTileRows);
+        for (int r = t * kTileRows; r < r_end; ++r) {
+            const WarpSpan& span = spans[r];
+            const int len = span.x_end - span.x_begin;
+            if (len <= 0) {
+                continue;
+            }
+            warpRow(src, H, roi.y + r, span.x_begin, span.x_end, row_img.data(), row_mask.data(), mode);
+            blendRow(canvas.ptr<uchar>(roi.y + r) + span.x_begin * 3, fields, roi, r, span.x_begin, len,
+                     row_img.data(), row_mask.data());
+        }
+    });
+}
+
+// Fused pass on a tiled canvas: one canvas tile at a time, rows of the tile in parallel.
+// Tiles the footprint does not reach are never allocated.
+template <typename T>
+void warpBlendCanvasTiles(TiledCanvas& canvas, const cv::Mat& src_img, const double* H, const std::vector<WarpSpan>& spans,
+                          const cv::Rect& roi, const BlendFields& fields, WarpInterp mode) {
+    const WarpSourceT<T> src = {src_img.ptr<T>(), src_img.step / sizeof(T), src_img.cols, src_img.rows};
+    const int ts = canvas.tileSize();
+
+    PROFILE_SCOPE("warpBlend.tiles");
+    for (int ty = roi.y / ts; ty <= (roi.y + roi.height - 1) / ts; ++ty) {
+        for (int tx = roi.x / ts; tx <= (roi.x + roi.width - 1) / ts; ++tx) {
+            const cv::Rect tile_rect = canvas.tileRect(tx, ty);
+            const cv::Rect part = tile_rect & roi;
+            // columns of footprint row r inside the tile
+            auto columns = [&](int r, int& x_begin, int& x_end) {
+                x_begin = std::max(spans[r].x_begin, tile_rect.x);
+                x_end = std::min(spans[r].x_end, tile_rect.x + tile_rect.width);
+                return x_end > x_begin;
+            };
+            bool covered = false;
+            for (int r = part.y - roi.y, x_begin, x_end; r < part.y + part.height - roi.y && !covered; ++r) {
+                covered = columns(r, x_begin, x_end);
+            }
+            if (!covered) {
+                continue;
+            }
+
+            cv::Mat tile = canvas.tile(tx, ty);
+            const int chunks = (part.height + kTileRows - 1) / kTileRows;
+            parallelFor(LoopStage::WarpBlendTiles, chunks, 1, [&](int c) {
+                std::vector<T> row_img(part.width * 3);
+                std::vector<uchar> row_mask(part.width);
+                const int r_end = std::min(part.height, (c + 1) * kTileRows);
+                for (int i = c * kTileRows; i < r_end; ++i) {
+                    const int r = part.y - roi.y + i;
+                    int x_begin, x_end;
+                    if (!columns(r, x_begin, x_end)) {
+                        continue;
+                    }
+                    warpRow(src, H, roi.y + r, x_begin, x_end, row_img.data(), row_mask.data(), mode);
+                    blendRow(tile.ptr<uchar>(roi.y + r - tile_rect.y) + (x_begin - tile_rect.x) * 3, fields, roi, r, x_begin,
+                             x_end - x_begin, row_img.data(), row_mask.data());
+                }
+            });
+        }
+    }
+}
+
+} // namespace
+
+cv::Rect warpBlendInto(cv::Mat& canvas, const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, WarpInterp mode) {
+    // *** Validate Inputs ***
+    if (canvas.empty() || src_img.empty()) {
+        throw std::invalid_argument("Error: canvas or src_img is empty.");
+    }
+    if (canvas.type() != CV_8UC3) {
+        throw std::invalid_argument("Error: canvas must be of type CV_8UC3 (3-channel, uint8).");
+    }
+    if (src_img.type() != CV_32FC3 && src_img.type() != CV_8UC3) {
+        throw std::invalid_argument("Error: src_img must be of type CV_32FC3 (3-channel, float32) or CV_8UC3 (3-channel, uint8).");
+    }
+
+    // 1. Footprint of the source image on the canvas
+    cv::Rect roi;
+    std::vector<WarpSpan> spans = warpFootprintSpans(src_img.size(), destToSrc_H, canvas.size(), roi);
+    if (roi.empty()) {
+        return roi;
+    }
+    const Eigen::Matrix<double, 3, 3, Eigen::RowMajor> H = destToSrc_H;
+
+    // 2. Masks: canvas content on the padded window, warped footprint on the ROI (with a zero ring)
+    const cv::Rect window = blendWindow(roi, canvas.size());
+    const BlendFields fields = blendFields(canvas(window), window, roi, [&](int r, uchar* m) {
+        const WarpSpan& span = spans[r];
+        warpMaskRow(src_img.cols, src_img.rows, H.data(), roi.y + r, span.x_begin, span.x_end, m + (span.x_begin - roi.x));
+    });
+
+    // 3. Fused pass over tiles of rows, in the pixel format of the source
+    if (src_img.type() == CV_8UC3) {
+        warpBlendTiles<uint8_t>(canvas, src_img, H.data(), spans, roi, fields, mode);
+    } else {
+        warpBlendTiles<float>(canvas, src_img, H.data(), spans, roi, fields, mode);
+    }
+
+    return roi;
+}
+
+cv::Rect blendWarpedInto(cv::Mat& canvas, const WarpROI& warped) {
+    if (canvas.type() != CV_8UC3) {
+        throw std::invalid_argument("Error: canvas must be of type CV_8UC3 (3-channel, uint8).");
+    }
+    const cv::Rect roi = warped.roi;
+    if (roi.empty()) {
+        return roi;
+    }
+    if ((roi & cv::Rect(0, 0, canvas.cols, canvas.rows)) != roi) {
+        throw std::invalid_argument("Error: the warped ROI must lie inside the canvas.");
+    }
+
+    const cv::Rect window = blendWindow(roi, canvas.size());
+    const BlendFields fields = blendFields(canvas(window), window, roi, [&](int r, uchar* m) {
+        const uchar* w = warped.mask.ptr<uchar>(r);
+        for (int x = 0; x < roi.width; ++x) {
+            m[x] = w[x] ? 1 : 0;
+        }
+    });
+
+    PROFILE_SCOPE("warpBlend.tiles");
+    const bool byte_pixels = warped.img.type() == CV_8UC3;
+    parallelFor(LoopStage::WarpBlendRows, roi.height, kTileRows, [&](int r) {
+        uchar* out = canvas.ptr<uchar>(roi.y + r) + roi.x * 3;
+        if (byte_pixels) {
+            blendRow(out, fields, roi, r, roi.x, roi.width, warped.img.ptr<uchar>(r), warped.mask.ptr<uchar>(r));
+        } else {
+            blendRow(out, fields, roi, r, roi.x, roi.width, warped.img.ptr<float>(r), warped.mask.ptr<uchar>(r));
+        }
+    });
+    return roi;
+}
+
+cv::Rect warpBlendInto(TiledCanvas& canvas, const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H, WarpInterp mode) {
+    if (src_img.empty()) {
+        throw std::invalid_argument("Error: src_img is empty.");
+    }
+    if (src_img.type() != CV_32FC3 && src_img.type() != CV_8UC3) {
+        throw std::invalid_argument("Error: src_img must be of type CV_32FC3 (3-channel, float32) or CV_8UC3 (3-channel, uint8).");
+    }
+
+    // 1. Footprint of the source image on the canvas
+    cv::Rect roi;
+    std::vector<WarpSpan> spans = warpFootprintSpans(src_img.size(), destToSrc_H, canvas.size(), roi);
+    if (roi.empty()) {
+        return roi;
+    }
+    const Eigen::Matrix<double, 3, 3, Eigen::RowMajor> H = destToSrc_H;
+
+    // 2. Distance fields on the window around the footprint, read from the tiles
+    const cv::Rect window = blendWindow(roi, canvas.size());
+    const BlendFields fields = blendFields(canvas.read(window), window, roi, [&](int r, uchar* m) {
+        const WarpSpan& span = spans[r];
+        warpMaskRow(src_img.cols, src_img.rows, H.data(), roi.y + r, span.x_begin, span.x_end, m + (span.x_begin - roi.x));
+    });
+
+    // 3. Fused pass, canvas tile by canvas tile
+    if (src_img.type() == CV_8UC3) {
+        warpBlendCanvasTiles<uint8_t>(canvas, src_img, H.data(), spans, roi, fields, mode);
+    } else {
+        warpBlendCanvasTiles<float>(canvas, src_img, H.data(), spans, roi, fields, mode);
+    }
+    return roi;
+}
@@ -0,0 +1,33 @@
+#ifndef WARP_BLEND_H
+#define WARP_BLEND_H
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Dense>
+#include "warpKernel.h"
+#include "backwardWarpImg.h"
+#include "tiledCanvas.h"
+
+// Fused backwardWarpImg + blendImagePair("blend") stage.
+// Warps src_img into canvas and blends it with the existing canvas content in place, in one tiled pass
+// over the footprint of src_img: no canvas-sized float image, mask or weight buffer is created.
+// canvas: CV_8UC3 accumulated panorama (pixels equal to 0 in all channels are empty), updated in place
+// src_img: CV_32FC3 image, range [0.0f, 1.0f], or CV_8UC3 (warped and blended without a float copy of the image)
+// destToSrc_H: canvas to source homography
+// Returns the footprint ROI of src_img on the canvas.
+//
+// The distance-transform weights (see featherWeight.h) are computed on the footprint ROI padded by the
+// feathering margin instead of the whole canvas; the capped distances are exact there, so the weights are
+// those of blendImagePair("blend"). Outside the overlap the result is identical to the two-stage path.
+cv::Rect warpBlendInto(cv::Mat& canvas, const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H,
+                       WarpInterp mode = WarpInterp::Nearest);
+
+// Blend step of warpBlendInto for an image that is already warped (e.g. by a WarpMap), same weights.
+// warped.img may be CV_32FC3 or CV_8UC3. Returns warped.roi.
+cv::Rect blendWarpedInto(cv::Mat& canvas, const WarpROI& warped);
+
+// warpBlendInto on a TiledCanvas: the distance fields are computed on the window around the footprint,
+// then the footprint is warped and blended one canvas tile at a time. Same result as the cv::Mat version.
+cv::Rect warpBlendInto(TiledCanvas& canvas, const cv::Mat& src_img, const Eigen::Matrix3d& destToSrc_H,
+                       WarpInterp mode = WarpInterp::Nearest);
+
+#endif // WARP_BLEND_H
@@ -0,0 +1,548 @@
+#include "warpKernel.h"
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+namespace {
+
+// Keys cubic convolution coefficient, same as OpenCV's INTER_CUBIC
+constexpr float kCubicA = -0.75f;
+
+inline void cubicWeights(float t, float w[4]) {
+    w[0] = ((kCubicA * (t + 1) - 5 * kCubicA) * (t + 1) + 8 * kCubicA) * (t + 1) - 4 * kCubicA;
+    w[1] = ((kCubicA + 2) * t - (kCubicA + 3)) * t * t + 1;
+    w[2] = ((kCubicA + 2) * (1 - t) - (kCubicA + 3)) * (1 - t) * (1 - t) + 1;
+    w[3] = 1.0f - w[0] - w[1] - w[2];
+}
+
+inline int clampIndex(int v, int hi) {
+    return std::max(0, std::min(v, hi));
+}
+
+// Sample one pixel at (sx, sy), which must round into the source image
+template <typename T>
+inline void samplePixel(const WarpSourceT<T>& src, double sx, double sy, WarpInterp mode, float* out) {
+    if (mode == WarpInterp::Nearest) {
+        const T* p = src.data + static_cast<int>(std::round(sy)) * src.stride + static_cast<int>(std::round(sx)) * 3;
+        out[0] = p[0];
+        out[1] = p[1];
+        out[2] = p[2];
+        return;
+    }
+
+    int x0 = static_cast<int>(std::floor(sx));
+    int y0 = static_cast<int>(std::floor(sy));
+    float ax = static_cast<float>(sx - x0);
+    float ay = static_cast<float>(sy - y0);
+
+    if (mode == WarpInterp::Bilinear) {
+        int xa = clampIndex(x0, src.width - 1), xb = clampIndex(x0 + 1, src.width - 1);
+        int ya = clampIndex(y0, src.height - 1), yb = clampIndex(y0 + 1, src.height - 1);
+        const T* p00 = src.data + ya * src.stride + xa * 3;
+        const T* p01 = src.data + ya * src.stride + xb * 3;
+        const T* p10 = src.data + yb * src.stride + xa * 3;
+        const T* p11 = src.data + yb * src.stride + xb * 3;
+        for (int c = 0; c < 3; ++c) {
+            float top = p00[c] + ax * (float(p01[c]) - p00[c]);
+            float bottom = p10[c] + ax * (float(p11[c]) - p10[c]);
+            out[c] = top + ay * (bottom - top);
+        }
+        return;
+    }
+
+    // Bicubic
+    float wx[4], wy[4];
+    cubicWeights(ax, wx);
+    cubicWeights(ay, wy);
+    float acc[3] = {0.0f, 0.0f, 0.0f};
+    for (int j = 0; j < 4; ++j) {
+        const T* row = src.data + clampIndex(y0 - 1 + j, src.height - 1) * src.stride;
+        for (int i = 0; i < 4; ++i) {
+            const T* p = row + clampIndex(x0 - 1 + i, src.width - 1) * 3;
+            float w = wx[i] * wy[j];
+            acc[0] += w * p[0];
+            acc[1] += w * p[1];
+            acc[2] += w * p[2];
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        out[c] = std::max(0.0f, std::min(acc[c], WarpPixel<T>::kMax));
+    }
+}
+
+// Scalar fallback, also used for the row tails of the SIMD paths
+template <typename T>
+void warpRowScalar(const WarpSourceT<T>& src, const double* H, int y, int x_begin, int x_end,
+                   T* dest, uint8_t* mask, WarpInterp mode) {
+    const double u_row = H[1] * y + H[2];
+    const double v_row = H[4] * y + H[5];
+    const double w_row = H[7] * y + H[8];
+
+    for (int x = x_begin; x < x_end; ++x) {
+        double w = H[6] * x + w_row;
+        double sx = (H[0] * x + u_row) / w;
+        double sy = (H[3] * x + v_row) / w;
+
+        // same validity test as the nearest neighbour lookup: the rounded position is inside the source image
+        int sx_int = static_cast<int>(std::round(sx));
+        int sy_int = static_cast<int>(std::round(sy));
+        T* out = dest + (x - x_begin) * 3;
+        if (sx_int >= 0 && sx_int < src.width && sy_int >= 0 && sy_int < src.height) {
+            float c[3];
+            samplePixel(src, sx, sy, mode, c);
+            out[0] = WarpPixel<T>::store(c[0]);
+            out[1] = WarpPixel<T>::store(c[1]);
+            out[2] = WarpPixel<T>::store(c[2]);
+            mask[x - x_begin] = 1;
+        } else {
+            out[0] = out[1] = out[2] = 0;
+            mask[x - x_begin] = 0;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////
+// AVX2: 8 pixels per iteration
+/////////////////////////////////////////////////////////////
+
+// std::round (half away from zero) of 4 doubles, as int32
+__attribute__((target("avx2")))
+inline __m128i roundPdAVX2(__m256d s) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d t = _mm256_round_pd(s, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    const __m256d frac = _mm256_andnot_pd(sign, _mm256_sub_pd(s, t));
+    const __m256d step = _mm256_and_pd(_mm256_cmp_pd(frac, _mm256_set1_pd(0.5), _CMP_GE_OQ),
+                                       _mm256_or_pd(_mm256_and_pd(s, sign), _mm256_set1_pd(1.0)));
+    return _mm256_cvttpd_epi32(_mm256_add_pd(t, step));
+}
+
+// Rounded source positions of the 8 pixels x .. x + 7 of a row, in double exactly like warpRowScalar and
+// warpMaskRow. They give the nearest source pixel and the validity mask of every mode: float coordinates round
+// a few pixels in 1e5 to the other neighbour, so the output and the mask (and the WarpMap) would depend on the
+// ISA. No FMA target and not inlined: the products cannot be fused into FMAs.
+__attribute__((target("avx2"), noinline))
+void roundedCoords8(const double* H, double u_row, double v_row, double w_row, int x, int32_t* xi, int32_t* yi) {
+    for (int h = 0; h < 2; ++h) {
+        const __m256d xd = _mm256_add_pd(_mm256_set1_pd(x + 4 * h), _mm256_setr_pd(0, 1, 2, 3));
+        const __m256d w = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(H[6]), xd), _mm256_set1_pd(w_row));
+        const __m256d u = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(H[0]), xd), _mm256_set1_pd(u_row));
+        const __m256d v = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(H[3]), xd), _mm256_set1_pd(v_row));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(xi + 4 * h), roundPdAVX2(_mm256_div_pd(u, w)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yi + 4 * h), roundPdAVX2(_mm256_div_pd(v, w)));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256i clampEpi32AVX2(__m256i v, __m256i hi) {
+    return _mm256_max_epi32(_mm256_setzero_si256(), _mm256_min_epi32(v, hi));
+}
+
+__attribute__((target("avx2,fma")))
+inline void gather3AVX2(const float* base, __m256i idx, __m256& c0, __m256& c1, __m256& c2) {
+    c0 = _mm256_i32gather_ps(base, idx, 4);
+    c1 = _mm256_i32gather_ps(base + 1, idx, 4);
+    c2 = _mm256_i32gather_ps(base + 2, idx, 4);
+}
+
+// 8-bit source: lane by lane (a 32-bit gather of the 3 bytes of a pixel could read past the image)
+__attribute__((target("avx2,fma")))
+inline void gather3AVX2(const uint8_t* base, __m256i idx, __m256& c0, __m256& c1, __m256& c2) {
+    alignas(32) int32_t offset[8], p[3][8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(offset), idx);
+    for (int i = 0; i < 8; ++i) {
+        const uint8_t* q = base + offset[i];
+        p[0][i] = q[0];
+        p[1][i] = q[1];
+        p[2][i] = q[2];
+    }
+    c0 = _mm256_cvtepi32_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(p[0])));
+    c1 = _mm256_cvtepi32_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(p[1])));
+    c2 = _mm256_cvtepi32_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(p[2])));
+}
+
+__attribute__((target("avx2,fma")))
+inline void cubicWeightsAVX2(__m256 t, __m256 w[4]) {
+    const __m256 a = _mm256_set1_ps(kCubicA);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 a2 = _mm256_set1_ps(kCubicA + 2), a3 = _mm256_set1_ps(kCubicA + 3);
+    __m256 t1 = _mm256_add_ps(t, one);
+    __m256 s = _mm256_sub_ps(one, t);
+    // w0 = ((a * t1 - 5a) * t1 + 8a) * t1 - 4a
+    w[0] = _mm256_fmsub_ps(_mm256_fmadd_ps(_mm256_fmsub_ps(a, t1, _mm256_set1_ps(5 * kCubicA)), t1, _mm256_set1_ps(8 * kCubicA)), t1,
+                           _mm256_set1_ps(4 * kCubicA));
+    // w1 = ((a + 2) * t - (a + 3)) * t * t + 1
+    w[1] = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_fmsub_ps(a2, t, a3), t), t, one);
+    w[2] = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_fmsub_ps(a2, s, a3), s), s, one);
+    w[3] = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(one, w[0]), w[1]), w[2]);
+}
+
+template <typename T>
+__attribute__((target("avx2,fma")))
+void warpRowAVX2(const WarpSourceT<T>& src, const double* H, int y, int x_begin, int x_end,
+                 T* dest, uint8_t* mask, WarpInterp mode) {
+    const double u_row = H[1] * y + H[2];
+    const double v_row = H[4] * y + H[5];
+    const double w_row = H[7] * y + H[8];
+
+    const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 du = _mm256_set1_ps(static_cast<float>(H[0]));
+    const __m256 dv = _mm256_set1_ps(static_cast<float>(H[3]));
+    const __m256 dw = _mm256_set1_ps(static_cast<float>(H[6]));
+    const __m256i max_x = _mm256_set1_epi32(src.width - 1);
+    const __m256i max_y = _mm256_set1_epi32(src.height - 1);
+    const __m256i stride = _mm256_set1_epi32(static_cast<int>(src.stride));
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i one_i = _mm256_set1_epi32(1);
+    const __m256i none = _mm256_set1_epi32(-1);
+    const __m256i width = _mm256_set1_epi32(src.width);
+    const __m256i height = _mm256_set1_epi32(src.height);
+
+    int x = x_begin;
+    for (; x + 8 <= x_end; x += 8) {
+        // rounded position inside the image, the test of warpRowScalar and warpMaskRow
+        alignas(32) int32_t xn[8], yn[8];
+        roundedCoords8(H, u_row, v_row, w_row, x, xn, yn);
+        const __m256i near_x = _mm256_load_si256(reinterpret_cast<const __m256i*>(xn));
+        const __m256i near_y = _mm256_load_si256(reinterpret_cast<const __m256i*>(yn));
+        const __m256 valid = _mm256_castsi256_ps(_mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(near_x, none), _mm256_cmpgt_epi32(width, near_x)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(near_y, none), _mm256_cmpgt_epi32(height, near_y))));
+        int valid_bits = _mm256_movemask_ps(valid);
+        T* out = dest + (x - x_begin) * 3;
+        if (valid_bits == 0) {
+            std::fill(out, out + 24, T(0));
+            std::fill(mask + (x - x_begin), mask + (x - x_begin) + 8, 0);
+            continue;
+        }
+
+        __m256 c0, c1, c2;
+        if (mode == WarpInterp::Nearest) {
+            __m256i xi = clampEpi32AVX2(near_x, max_x);
+            __m256i yi = clampEpi32AVX2(near_y, max_y);
+            __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(yi, stride), _mm256_mullo_epi32(xi, three));
+            gather3AVX2(src.data, idx, c0, c1, c2);
+        } else {
+            // homogeneous coordinates: block start in double, lanes stepped by the first column of H
+            __m256 u = _mm256_fmadd_ps(lane, du, _mm256_set1_ps(static_cast<float>(H[0] * x + u_row)));
+            __m256 v = _mm256_fmadd_ps(lane, dv, _mm256_set1_ps(static_cast<float>(H[3] * x + v_row)));
+            __m256 w = _mm256_fmadd_ps(lane, dw, _mm256_set1_ps(static_cast<float>(H[6] * x + w_row)));
+            __m256 sx = _mm256_div_ps(u, w);
+            __m256 sy = _mm256_div_ps(v, w);
+            __m256 fx = _mm256_floor_ps(sx);
+            __m256 fy = _mm256_floor_ps(sy);
+            __m256 ax = _mm256_sub_ps(sx, fx);
+            __m256 ay = _mm256_sub_ps(sy, fy);
+            __m256i x0 = _mm256_cvttps_epi32(fx);
+            __m256i y0 = _mm256_cvttps_epi32(fy);
+
+            if (mode == WarpInterp::Bilinear) {
+                __m256i xa = _mm256_mullo_epi32(clampEpi32AVX2(x0, max_x), three);
+                __m256i xb = _mm256_mullo_epi32(clampEpi32AVX2(_mm256_add_epi32(x0, one_i), max_x), three);
+                __m256i ya = _mm256_mullo_epi32(clampEpi32AVX2(y0, max_y), stride);
+                __m256i yb = _mm256_mullo_epi32(clampEpi32AVX2(_mm256_add_epi32(y0, one_i), max_y), stride);
+                __m256 p00[3], p01[3], p10[3], p11[3];
+                gather3AVX2(src.data, _mm256_add_epi32(ya, xa), p00[0], p00[1], p00[2]);
+                gather3AVX2(src.data, _mm256_add_epi32(ya, xb), p01[0], p01[1], p01[2]);
+                gather3AVX2(src.data, _mm256_add_epi32(yb, xa), p10[0], p10[1], p10[2]);
+                gather3AVX2(src.data, _mm256_add_epi32(yb, xb), p11[0], p11[1], p11[2]);
+                __m256 c[3];
+                for (int k = 0; k < 3; ++k) {
+                    __m256 top = _mm256_fmadd_ps(ax, _mm256_sub_ps(p01[k], p00[k]), p00[k]);
+                    __m256 bottom = _mm256_fmadd_ps(ax, _mm256_sub_ps(p11[k], p10[k]), p10[k]);
+                    c[k] = _mm256_fmadd_ps(ay, _mm256_sub_ps(bottom, top), top);
+                }
+                c0 = c[0];
+                c1 = c[1];
+                c2 = c[2];
+            } else {
+                __m256 wx[4], wy[4];
+                cubicWeightsAVX2(ax, wx);
+                cubicWeightsAVX2(ay, wy);
+                __m256i cols[4];
+                for (int i = 0; i < 4; ++i) {
+                    cols[i] = _mm256_mullo_epi32(clampEpi32AVX2(_mm256_add_epi32(x0, _mm256_set1_epi32(i - 1)), max_x), three);
+                }
+                __m256 acc[3] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+                for (int j = 0; j < 4; ++j) {
+                    __m256i row = _mm256_mullo_epi32(clampEpi32AVX2(_mm256_add_epi32(y0, _mm256_set1_epi32(j - 1)), max_y), stride);
+                    for (int i = 0; i < 4; ++i) {
+                        __m256 p[3];
+                        gather3AVX2(src.data, _mm256_add_epi32(row, cols[i]), p[0], p[1], p[2]);
+                        __m256 wgt = _mm256_mul_ps(wx[i], wy[j]);
+                        for (int k = 0; k < 3; ++k) {
+                            acc[k] = _mm256_fmadd_ps(wgt, p[k], acc[k]);
+                        }
+                    }
+                }
+                const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(WarpPixel<T>::kMax);
+                c0 = _mm256_min_ps(_mm256_max_ps(acc[0], zero), one);
+                c1 = _mm256_min_ps(_mm256_max_ps(acc[1], zero), one);
+                c2 = _mm256_min_ps(_mm256_max_ps(acc[2], zero), one);
+            }
+        }
+
+        // zero the invalid lanes, then interleave the three planes into BGR pixels
+        alignas(32) float plane[3][8];
+        _mm256_store_ps(plane[0], _mm256_and_ps(c0, valid));
+        _mm256_store_ps(plane[1], _mm256_and_ps(c1, valid));
+        _mm256_store_ps(plane[2], _mm256_and_ps(c2, valid));
+        for (int i = 0; i < 8; ++i) {
+            out[i * 3] = WarpPixel<T>::store(plane[0][i]);
+            out[i * 3 + 1] = WarpPixel<T>::store(plane[1][i]);
+            out[i * 3 + 2] = WarpPixel<T>::store(plane[2][i]);
+            mask[x - x_begin + i] = (valid_bits >> i) & 1;
+        }
+    }
+
+    warpRowScalar(src, H, y, x, x_end, dest + (x - x_begin) * 3, mask + (x - x_begin), mode);
+}
+
+/////////////////////////////////////////////////////////////
+// AVX-512: 16 pixels per iteration
+/////////////////////////////////////////////////////////////
+
+__attribute__((target("avx512f")))
+inline __m512i clampEpi32AVX512(__m512i v, __m512i hi) {
+    return _mm512_max_epi32(_mm512_setzero_si512(), _mm512_min_epi32(v, hi));
+}
+
+__attribute__((target("avx512f")))
+inline void gather3AVX512(const float* base, __m512i idx, __m512& c0, __m512& c1, __m512& c2) {
+    c0 = _mm512_i32gather_ps(idx, base, 4);
+    c1 = _mm512_i32gather_ps(idx, base + 1, 4);
+    c2 = _mm512_i32gather_ps(idx, base + 2, 4);
+}
+
+__attribute__((target("avx512f")))
+inline void gather3AVX512(const uint8_t* base, __m512i idx, __m512& c0, __m512& c1, __m512& c2) {
+    alignas(64) int32_t offset[16], p[3][16];
+    _mm512_store_si512(offset, idx);
+    for (int i = 0; i < 16; ++i) {
+        const uint8_t* q = base + offset[i];
+        p[0][i] = q[0];
+        p[1][i] = q[1];
+        p[2][i] = q[2];
+    }
+    c0 = _mm512_cvtepi32_ps(_mm512_load_si512(p[0]));
+    c1 = _mm512_cvtepi32_ps(_mm512_load_si512(p[1]));
+    c2 = _mm512_cvtepi32_ps(_mm512_load_si512(p[2]));
+}
+
+__attribute__((target("avx512f")))
+inline void cubicWeightsAVX512(__m512 t, __m512 w[4]) {
+    const __m512 a = _mm512_set1_ps(kCubicA);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 a2 = _mm512_set1_ps(kCubicA + 2), a3 = _mm512_set1_ps(kCubicA + 3);
+    __m512 t1 = _mm512_add_ps(t, one);
+    __m512 s = _mm512_sub_ps(one, t);
+    w[0] = _mm512_fmsub_ps(_mm512_fmadd_ps(_mm512_fmsub_ps(a, t1, _mm512_set1_ps(5 * kCubicA)), t1, _mm512_set1_ps(8 * kCubicA)), t1,
+                           _mm512_set1_ps(4 * kCubicA));
+    w[1] = _mm512_fmadd_ps(_mm512_mul_ps(_mm512_fmsub_ps(a2, t, a3), t), t, one);
+    w[2] = _mm512_fmadd_ps(_mm512_mul_ps(_mm512_fmsub_ps(a2, s, a3), s), s, one);
+    w[3] = _mm512_sub_ps(_mm512_sub_ps(_mm512_sub_ps(one, w[0]), w[1]), w[2]);
+}
+
+template <typename T>
+__attribute__((target("avx512f")))
+void warpRowAVX512(const WarpSourceT<T>& src, const double* H, int y, int x_begin, int x_end,
+                   T* dest, uint8_t* mask, WarpInterp mode) {
+    const double u_row = H[1] * y + H[2];
+    const double v_row = H[4] * y + H[5];
+    const double w_row = H[7] * y + H[8];
+
+    const __m512 lane = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512 du = _mm512_set1_ps(static_cast<float>(H[0]));
+    const __m512 dv = _mm512_set1_ps(static_cast<float>(H[3]));
+    const __m512 dw = _mm512_set1_ps(static_cast<float>(H[6]));
+    const __m512i max_x = _mm512_set1_epi32(src.width - 1);
+    const __m512i max_y = _mm512_set1_epi32(src.height - 1);
+    const __m512i stride = _mm512_set1_epi32(static_cast<int>(src.stride));
+    const __m512i three = _mm512_set1_epi32(3);
+    const __m512i one_i = _mm512_set1_epi32(1);
+
+    const __m512i zero_i = _mm512_setzero_si512();
+
+    int x = x_begin;
+    for (; x + 16 <= x_end; x += 16) {
+        // rounded position inside the image, the test of warpRowScalar and warpMaskRow
+        alignas(64) int32_t xn[16], yn[16];
+        roundedCoords8(H, u_row, v_row, w_row, x, xn, yn);
+        roundedCoords8(H, u_row, v_row, w_row, x + 8, xn + 8, yn + 8);
+        const __m512i near_x = _mm512_load_si512(xn);
+        const __m512i near_y = _mm512_load_si512(yn);
+        const __mmask16 valid = _mm512_cmpge_epi32_mask(near_x, zero_i) & _mm512_cmple_epi32_mask(near_x, max_x) &
+                                _mm512_cmpge_epi32_mask(near_y, zero_i) & _mm512_cmple_epi32_mask(near_y, max_y);
+        T* out = dest + (x - x_begin) * 3;
+        if (valid == 0) {
+            std::fill(out, out + 48, T(0));
+            std::fill(mask + (x - x_begin), mask + (x - x_begin) + 16, 0);
+            continue;
+        }
+
+        __m512 c0, c1, c2;
+        if (mode == WarpInterp::Nearest) {
+            __m512i xi = clampEpi32AVX512(near_x, max_x);
+            __m512i yi = clampEpi32AVX512(near_y, max_y);
+            __m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(yi, stride), _mm512_mullo_epi32(xi, three));
+            gather3AVX512(src.data, idx, c0, c1, c2);
+        } else {
+            __m512 u = _mm512_fmadd_ps(lane, du, _mm512_set1_ps(static_cast<float>(H[0] * x + u_row)));
+            __m512 v = _mm512_fmadd_ps(lane, dv, _mm512_set1_ps(static_cast<float>(H[3] * x + v_row)));
+            __m512 w = _mm512_fmadd_ps(lane, dw, _mm512_set1_ps(static_cast<float>(H[6] * x + w_row)));
+            __m512 sx = _mm512_div_ps(u, w);
+            __m512 sy = _mm512_div_ps(v, w);
+            __m512 fx = _mm512_floor_ps(sx);
+            __m512 fy = _mm512_floor_ps(sy);
+            __m512 ax = _mm512_sub_ps(sx, fx);
+            __m512 ay = _mm512_sub_ps(sy, fy);
+            __m512i x0 = _mm512_cvttps_epi32(fx);
+            __m512i y0 = _mm512_cvttps_epi32(fy);
+
+            if (mode == WarpInterp::Bilinear) {
+                __m512i xa = _mm512_mullo_epi32(clampEpi32AVX512(x0, max_x), three);
+                __m512i xb = _mm512_mullo_epi32(clampEpi32AVX512(_mm512_add_epi32(x0, one_i), max_x), three);
+                __m512i ya = _mm512_mullo_epi32(clampEpi32AVX512(y0, max_y), stride);
+                __m512i yb = _mm512_mullo_epi32(clampEpi32AVX512(_mm512_add_epi32(y0, one_i), max_y), stride);
+                __m512 p00[3], p01[3], p10[3], p11[3];
+                gather3AVX512(src.data, _mm512_add_epi32(ya, xa), p00[0], p00[1], p00[2]);
+                gather3AVX512(src.data, _mm512_add_epi32(ya, xb), p01[0], p01[1], p01[2]);
+                gather3AVX512(src.data, _mm512_add_epi32(yb, xa), p10[0], p10[1], p10[2]);
+                gather3AVX512(src.data, _mm512_add_epi32(yb, xb), p11[0], p11[1], p11[2]);
+                __m512 c[3];
+                for (int k = 0; k < 3; ++k) {
+                    __m512 top = _mm512_fmadd_ps(ax, _mm512_sub_ps(p01[k], p00[k]), p00[k]);
+                    __m512 bottom = _mm512_fmadd_ps(ax, _mm512_sub_ps(p11[k], p10[k]), p10[k]);
+                    c[k] = _mm512_fmadd_ps(ay, _mm512_sub_ps(bottom, top), top);
+                }
+                c0 = c[0];
+                c1 = c[1];
+                c2 = c[2];
+            } else {
+                __m512 wx[4], wy[4];
+                cubicWeightsAVX512(ax, wx);
+                cubicWeightsAVX512(ay, wy);
+                __m512i cols[4];
+                for (int i = 0; i < 4; ++i) {
+                    cols[i] = _mm512_mullo_epi32(clampEpi32AVX512(_mm512_add_epi32(x0, _mm512_set1_epi32(i - 1)), max_x), three);
+                }
+                __m512 acc[3] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+                for (int j = 0; j < 4; ++j) {
+                    __m512i row = _mm512_mullo_epi32(clampEpi32AVX512(_mm512_add_epi32(y0, _mm512_set1_epi32(j - 1)), max_y), stride);
+                    for (int i = 0; i < 4; ++i) {
+                        __m512 p[3];
+                        gather3AVX512(src.data, _mm512_add_epi32(row, cols[i]), p[0], p[1], p[2]);
+                        __m512 wgt = _mm512_mul_ps(wx[i], wy[j]);
+                        for (int k = 0; k < 3; ++k) {
+                            acc[k] = _mm512_fmadd_ps(wgt, p[k], acc[k]);
+                        }
+                    }
+                }
+                const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(WarpPixel<T>::kMax);
+                c0 = _mm512_min_ps(_mm512_max_ps(acc[0], zero), one);
+                c1 = _mm512_min_ps(_mm512_max_ps(acc[1], zero), one);
+                c2 = _mm512_min_ps(_mm512_max_ps(acc[2], zero), one);
+            }
+        }
+
+        alignas(64) float plane[3][16];
+        _mm512_store_ps(plane[0], _mm512_maskz_mov_ps(valid, c0));
+        _mm512_store_ps(plane[1], _mm512_maskz_mov_ps(valid, c1));
+        _mm512_store_ps(plane[2], _mm512_maskz_mov_ps(valid, c2));
+        for (int i = 0; i < 16; ++i) {
+            out[i * 3] = WarpPixel<T>::store(plane[0][i]);
+            out[i * 3 + 1] = WarpPixel<T>::store(plane[1][i]);
+            out[i * 3 + 2] = WarpPixel<T>::store(plane[2][i]);
+            mask[x - x_begin + i] = (valid >> i) & 1;
+        }
+    }
+
+    warpRowScalar(src, H, y, x, x_end, dest + (x - x_begin) * 3, mask + (x - x_begin), mode);
+}
+
+bool isaSupported(WarpIsa isa) {
+    switch (isa) {
+        case WarpIsa::AVX512:
+            return __builtin_cpu_supports("avx512f");
+        case WarpIsa::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        default:
+            return true;
+    }
+}
+
+WarpIsa detectIsa() {
+    if (isaSupported(WarpIsa::AVX512)) return WarpIsa::AVX512;
+    if (isaSupported(WarpIsa::AVX2)) return WarpIsa::AVX2;
+    return WarpIsa::Scalar;
+}
+
+WarpIsa& selectedIsa() {
+    static WarpIsa isa = detectIsa();
+    return isa;
+}
+
+template <typename T>
+void warpRowDispatch(const WarpSourceT<T>& src, const double destToSrc_H[9], int y, int x_begin, int x_end,
+                     T* dest, uint8_t* mask, WarpInterp mode) {
+    switch (selectedIsa()) {
+        case WarpIsa::AVX512:
+            warpRowAVX512(src, destToSrc_H, y, x_begin, x_end, dest, mask, mode);
+            break;
+        case WarpIsa::AVX2:
+            warpRowAVX2(src, destToSrc_H, y, x_begin, x_end, dest, mask, mode);
+            break;
+        default:
+            warpRowScalar(src, destToSrc_H, y, x_begin, x_end, dest, mask, mode);
+            break;
+    }
+}
+
+} // namespace
+
+void warpRow(const WarpSource& src, const double destToSrc_H[9], int y, int x_begin, int x_end,
+             float* dest, uint8_t* mask, WarpInterp mode) {
+    warpRowDispatch(src, destToSrc_H, y, x_begin, x_end, dest, mask, mode);
+}
+
+void warpRow(const WarpSource8& src, const double destToSrc_H[9], int y, int x_begin, int x_end,
+             uint8_t* dest, uint8_t* mask, WarpInterp mode) {
+    warpRowDispatch(src, destToSrc_H, y, x_begin, x_end, dest, mask, mode);
+}
+
+void warpMaskRow(int src_width, int src_height, const double destToSrc_H[9], int y, int x_begin, int x_end, uint8_t* mask) {
+    const double* H = destToSrc_H;
+    const double u_row = H[1] * y + H[2];
+    const double v_row = H[4] * y + H[5];
+    const double w_row = H[7] * y + H[8];
+
+    for (int x = x_begin; x < x_end; ++x) {
+        double w = H[6] * x + w_row;
+        int sx_int = static_cast<int>(std::round((H[0] * x + u_row) / w));
+        int sy_int = static_cast<int>(std::round((H[3] * x + v_row) / w));
+        mask[x - x_begin] = (sx_int >= 0 && sx_int < src_width && sy_int >= 0 && sy_int < src_height) ? 1 : 0;
+    }
+}
+
+WarpIsa warpIsa() {
+    return selectedIsa();
+}
+
+void setWarpIsa(WarpIsa isa) {
+    selectedIsa() = isaSupported(isa) ? isa : detectIsa();
+}
+
+const char* warpIsaName(WarpIsa isa) {
+    switch (isa) {
+        case WarpIsa::AVX512: return "avx512";
+        case WarpIsa::AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+const char* warpInterpName(WarpInterp mode) {
+    switch (mode) {
+        case WarpInterp::Bilinear: return "bilinear";
+        case WarpInterp::Bicubic: return "bicubic";
+        default: return "nearest";
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef WARP_KERNEL_H
+#define WARP_KERNEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Sampling mode of the backward warp
+enum class WarpInterp {
+    Nearest,   // nearest source pixel (the original backwardWarpImg behaviour)
+    Bilinear,  // 2x2 taps
+    Bicubic    // 4x4 taps, Keys kernel with a = -0.75 (same as cv::INTER_CUBIC), clamped to [0, 1]
+};
+
+// Instruction set used by the warp kernel, picked at runtime from the CPU features
+enum class WarpIsa {
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+// Source image view: 3-channel pixels, row stride in elements
+template <typename T>
+struct WarpSourceT {
+    const T* data;
+    size_t stride;
+    int width;
+    int height;
+};
+using WarpSource = WarpSourceT<float>;     // float32, range [0, 1]
+using WarpSource8 = WarpSourceT<uint8_t>;  // uint8, range [0, 255]
+
+// Value range and output conversion of the warp pixel formats.
+// Interpolation always runs in float, only the loads and stores differ.
+template <typename T>
+struct WarpPixel;
+
+template <>
+struct WarpPixel<float> {
+    static constexpr float kMax = 1.0f;
+    static float store(float v) { return v; }
+};
+
+template <>
+struct WarpPixel<uint8_t> {
+    static constexpr float kMax = 255.0f;
+    // values are inside [0, 255] up to rounding, round half up
+    static uint8_t store(float v) { return static_cast<uint8_t>(std::max(0.0f, std::min(v, kMax)) + 0.5f); }
+};
+
+// Warp the pixels [x_begin, x_end) of canvas row y.
+// destToSrc_H is the row-major 3x3 homography from canvas to source coordinates.
+// dest points at the 3-channel float32 output pixel of x_begin, mask at its mask byte.
+// A pixel is valid (mask = 1) when its nearest source pixel lies inside the image, for every mode,
+// so the footprint does not depend on the interpolation. Invalid pixels get mask 0 and color 0.
+// The homogeneous source coordinates are stepped incrementally along the row; the SIMD paths
+// process 8 (AVX2) or 16 (AVX-512) pixels per instruction.
+void warpRow(const WarpSource& src, const double destToSrc_H[9], int y, int x_begin, int x_end,
+             float* dest, uint8_t* mask, WarpInterp mode);
+// 8-bit source and output: same kernels (interpolation in float registers), the result is rounded to uint8
+void warpRow(const WarpSource8& src, const double destToSrc_H[9], int y, int x_begin, int x_end,
+             uint8_t* dest, uint8_t* mask, WarpInterp mode);
+
+// Footprint mask only (no sampling) of the pixels [x_begin, x_end) of canvas row y: the validity test of warpRow
+void warpMaskRow(int src_width, int src_height, const double destToSrc_H[9], int y, int x_begin, int x_end, uint8_t* mask);
+
+// Instruction set selected for warpRow
+WarpIsa warpIsa();
+// Override the selection (benchmarks and comparisons), falls back to the best supported one if unavailable
+void setWarpIsa(WarpIsa isa);
+const char* warpIsaName(WarpIsa isa);
+const char* warpInterpName(WarpInterp mode);
+
+#endif // WARP_KERNEL_H
@@ -0,0 +1,350 @@
+#include "warpMap.h"
+#include "taskGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <omp.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'W', 'A', 'R', 'P', 'M', 'A', 'P', '1'};
+constexpr uint32_t kVersion = 1;
+constexpr int kFracOne = 1 << WarpMap::kFracBits;
+// Runs per task of apply(), canvas rows per task of the construction
+constexpr int kRunGrain = 64;
+constexpr int kBuildRowGrain = 16;
+
+struct WarpMapFileHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t mode;
+    int32_t canvas_width, canvas_height;
+    int32_t src_width, src_height;
+    int32_t roi_x, roi_y, roi_width, roi_height;
+    double H[9];
+    uint64_t run_count;
+    uint64_t tap_count;
+};
+
+// Keys cubic weights for every stored fraction, same kernel as the warp kernel (a = -0.75)
+struct CubicTable {
+    float w[kFracOne + 1][4];
+
+    CubicTable() {
+        constexpr float a = -0.75f;
+        for (int f = 0; f <= kFracOne; ++f) {
+            const float t = static_cast<float>(f) / kFracOne;
+            w[f][0] = ((a * (t + 1) - 5 * a) * (t + 1) + 8 * a) * (t + 1) - 4 * a;
+            w[f][1] = ((a + 2) * t - (a + 3)) * t * t + 1;
+            w[f][2] = ((a + 2) * (1 - t) - (a + 3)) * (1 - t) * (1 - t) + 1;
+            w[f][3] = 1.0f - w[f][0] - w[f][1] - w[f][2];
+        }
+    }
+};
+
+const CubicTable& cubicTable() {
+    static const CubicTable table;
+    return table;
+}
+
+inline int clampIndex(int v, int hi) {
+    return std::max(0, std::min(v, hi));
+}
+
+// Integer and fixed-point fractional part of a source coordinate
+inline void splitCoord(double s, int& i, int& f) {
+    i = static_cast<int>(std::floor(s));
+    f = static_cast<int>(std::lround((s - i) * kFracOne));
+    if (f == kFracOne) {
+        ++i;
+        f = 0;
+    }
+}
+
+// Bilinear taps never need clamping at apply time: positions left of / above the image collapse onto pixel 0,
+// positions on the last pixel move one pixel back with weight 1 (same result as the clamped taps)
+inline void normalizeBilinear(int& i, int& f, int size) {
+    if (i < 0) {
+        i = 0;
+        f = 0;
+    } else if (i >= size - 1) {
+        i = size - 2;
+        f = kFracOne;
+    }
+}
+
+bool validTap(const WarpMap::Tap& t, WarpInterp mode, const cv::Size& src) {
+    if (t.fx > kFracOne || t.fy > kFracOne) {
+        return false;
+    }
+    switch (mode) {
+        case WarpInterp::Nearest:
+            return t.x >= 0 && t.x < src.width && t.y >= 0 && t.y < src.height;
+        case WarpInterp::Bilinear:
+            return t.x >= 0 && t.x <= src.width - 2 && t.y >= 0 && t.y <= src.height - 2;
+        default:
+            return t.x >= -1 && t.x < src.width && t.y >= -1 && t.y < src.height;
+    }
+}
+
+} // namespace
+
+WarpMap WarpMap::build(const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, const cv::Size& src_size, WarpInterp mode) {
+    if (src_size.width <= 0 || src_size.height <= 0 || src_size.width > std::numeric_limits<int16_t>::max() ||
+        src_size.height > std::numeric_limits<int16_t>::max()) {
+        throw std::invalid_argument("Error: warp maps need a source size between 1 and 32767 pixels.");
+    }
+    if (mode != WarpInterp::Nearest && (src_size.width < 2 || src_size.height < 2)) {
+        throw std::invalid_argument("Error: interpolated warp maps need a source of at least 2 x 2 pixels.");
+    }
+    WarpMap map;
+    map.destToSrc_H_ = destToSrc_H;
+    map.canvas_shape_ = canvas_shape;
+    map.src_size_ = src_size;
+    map.mode_ = mode;
+
+    // 1. footprint spans, then the valid pixels of every row, same validity test and coordinates as warpRow
+    std::vector<WarpSpan> spans = warpFootprintSpans(src_size, destToSrc_H, canvas_shape, map.roi_);
+    const int rows = map.roi_.height;
+    const double H[9] = {destToSrc_H(0, 0), destToSrc_H(0, 1), destToSrc_H(0, 2),
+                         destToSrc_H(1, 0), destToSrc_H(1, 1), destToSrc_H(1, 2),
+                         destToSrc_H(2, 0), destToSrc_H(2, 1), destToSrc_H(2, 2)};
+    std::vector<std::vector<Run>> row_runs(rows);
+    std::vector<std::vector<Tap>> row_taps(rows);
+
+    parallelFor(LoopStage::WarpMapBuild, rows, kBuildRowGrain, [&](int r) {
+        const int y = map.roi_.y + r;
+        const double u_row = H[1] * y + H[2];
+        const double v_row = H[4] * y + H[5];
+        const double w_row = H[7] * y + H[8];
+        std::vector<Run>& runs = row_runs[r];
+        std::vector<Tap>& taps = row_taps[r];
+        for (int x = spans[r].x_begin; x < spans[r].x_end; ++x) {
+            const double w = H[6] * x + w_row;
+            const double sx = (H[0] * x + u_row) / w;
+            const double sy = (H[3] * x + v_row) / w;
+            const int sx_int = static_cast<int>(std::round(sx));
+            const int sy_int = static_cast<int>(std::round(sy));
+            if (sx_int < 0 || sx_int >= src_size.width || sy_int < 0 || sy_int >= src_size.height) {
+                continue;
+            }
+            int ix = sx_int, iy = sy_int, fx = 0, fy = 0;
+            if (mode != WarpInterp::Nearest) {
+                splitCoord(sx, ix, fx);
+                splitCoord(sy, iy, fy);
+                if (mode == WarpInterp::Bilinear) {
+                    normalizeBilinear(ix, fx, src_size.width);
+                    normalizeBilinear(iy, fy, src_size.height);
+                }
+            }
+            if (runs.empty() || runs.back().x_begin + runs.back().count != x) {
+                runs.push_back(Run{y, x, 0, static_cast<uint32_t>(taps.size())});
+            }
+            ++runs.back().count;
+            taps.push_back(Tap{static_cast<int16_t>(ix), static_cast<int16_t>(iy), static_cast<uint16_t>(fx), static_cast<uint16_t>(fy)});
+        }
+    });
+
+    // 2. concatenate the rows
+    size_t run_count = 0, tap_count = 0;
+    for (int r = 0; r < rows; ++r) {
+        run_count += row_runs[r].size();
+        tap_count += row_taps[r].size();
+    }
+    if (tap_count > std::numeric_limits<uint32_t>::max()) {
+        throw std::invalid_argument("Error: warp footprint too large for a warp map.");
+    }
+    map.runs_.reserve(run_count);
+    map.taps_.reserve(tap_count);
+    for (int r = 0; r < rows; ++r) {
+        const uint32_t offset = static_cast<uint32_t>(map.taps_.size());
+        for (Run run : row_runs[r]) {
+            run.first += offset;
+            map.runs_.push_back(run);
+        }
+        map.taps_.insert(map.taps_.end(), row_taps[r].begin(), row_taps[r].end());
+    }
+    return map;
+}
+
+WarpROI WarpMap::apply(const cv::Mat& src_img) const {
+    if (src_img.type() != CV_32FC3 && src_img.type() != CV_8UC3) {
+        throw std::invalid_argument("Error: src_img must be of type CV_32FC3 (3-channel, float32) or CV_8UC3 (3-channel, uint8).");
+    }
+    if (src_img.size() != src_size_) {
+        throw std::invalid_argument("Error: src_img size does not match the warp map.");
+    }
+    WarpROI result;
+    result.roi = roi_;
+    result.img = cv::Mat::zeros(roi_.size(), src_img.type());
+    result.mask = cv::Mat::zeros(roi_.size(), CV_8U);
+    if (src_img.type() == CV_8UC3) {
+        gather<uint8_t>(src_img, result);
+    } else {
+        gather<float>(src_img, result);
+    }
+    return result;
+}
+
+template <typename T>
+void WarpMap::gather(const cv::Mat& src_img, WarpROI& result) const {
+    const float inv_one = 1.0f / kFracOne;
+    const int w_max = src_size_.width - 1;
+    const int h_max = src_size_.height - 1;
+    const int n_runs = static_cast<int>(runs_.size());
+
+    // OpenMP tasks of runs, gather only
+    parallelFor(LoopStage::WarpMapGather, n_runs, kRunGrain, [&](int k) {
+        const Run& run = runs_[k];
+        T* out = result.img.ptr<T>(run.y - roi_.y) + (run.x_begin - roi_.x) * 3;
+        uchar* mask = result.mask.ptr<uchar>(run.y - roi_.y) + (run.x_begin - roi_.x);
+        const Tap* taps = taps_.data() + run.first;
+        std::fill(mask, mask + run.count, 1);
+
+        if (mode_ == WarpInterp::Nearest) {
+            for (int i = 0; i < run.count; ++i) {
+                const T* p = src_img.ptr<T>(taps[i].y) + taps[i].x * 3;
+                out[3 * i] = p[0];
+                out[3 * i + 1] = p[1];
+                out[3 * i + 2] = p[2];
+            }
+        } else if (mode_ == WarpInterp::Bilinear) {
+            for (int i = 0; i < run.count; ++i) {
+                const Tap& t = taps[i];
+                const float ax = t.fx * inv_one;
+                const float ay = t.fy * inv_one;
+                const T* p0 = src_img.ptr<T>(t.y) + t.x * 3;
+                const T* p1 = src_img.ptr<T>(t.y + 1) + t.x * 3;
+                for (int c = 0; c < 3; ++c) {
+                    const float top = p0[c] + ax * (float(p0[c + 3]) - p0[c]);
+                    const float bottom = p1[c] + ax * (float(p1[c + 3]) - p1[c]);
+                    out[3 * i + c] = WarpPixel<T>::store(top + ay * (bottom - top));
+                }
+            }
+        } else {
+            const CubicTable& table = cubicTable();
+            for (int i = 0; i < run.count; ++i) {
+                const Tap& t = taps[i];
+                const float* wx = table.w[t.fx];
+                const float* wy = table.w[t.fy];
+                float acc[3] = {0.0f, 0.0f, 0.0f};
+                for (int j = 0; j < 4; ++j) {
+                    const T* row = src_img.ptr<T>(clampIndex(t.y - 1 + j, h_max));
+                    for (int q = 0; q < 4; ++q) {
+                        const T* p = row + clampIndex(t.x - 1 + q, w_max) * 3;
+                        const float w = wx[q] * wy[j];
+                        acc[0] += w * p[0];
+                        acc[1] += w * p[1];
+                        acc[2] += w * p[2];
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    out[3 * i + c] = WarpPixel<T>::store(std::max(0.0f, std::min(acc[c], WarpPixel<T>::kMax)));
+                }
+            }
+        }
+    });
+}
+
+bool WarpMap::matches(const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, const cv::Size& src_size, WarpInterp mode) const {
+    return canvas_shape == canvas_shape_ && src_size == src_size_ && mode == mode_ &&
+           (destToSrc_H - destToSrc_H_).norm() <= 1e-12 * destToSrc_H_.norm();
+}
+
+bool WarpMap::save(const std::string& path) const {
+    WarpMapFileHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.mode = static_cast<int32_t>(mode_);
+    header.canvas_width = canvas_shape_.width;
+    header.canvas_height = canvas_shape_.height;
+    header.src_width = src_size_.width;
+    header.src_height = src_size_.height;
+    header.roi_x = roi_.x;
+    header.roi_y = roi_.y;
+    header.roi_width = roi_.width;
+    header.roi_height = roi_.height;
+    for (int i = 0; i < 9; ++i) {
+        header.H[i] = destToSrc_H_(i / 3, i % 3);
+    }
+    header.run_count = runs_.size();
+    header.tap_count = taps_.size();
+
+    // written next to the target and renamed, a reader never sees a partial map
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary);
+        if (!out) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(runs_.data()), runs_.size() * sizeof(Run));
+        out.write(reinterpret_cast<const char*>(taps_.data()), taps_.size() * sizeof(Tap));
+        if (!out) {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool WarpMap::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return false;
+    }
+    const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    WarpMapFileHeader header;
+    if (file_size < sizeof(header) || !in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.mode < 0 || header.mode > static_cast<int32_t>(WarpInterp::Bicubic)) {
+        return false;
+    }
+    // bound each count by the payload before multiplying, so a corrupt header cannot overflow the size check
+    const uint64_t payload = file_size - sizeof(header);
+    if (header.run_count > payload / sizeof(Run) || header.tap_count > payload / sizeof(Tap) ||
+        header.run_count * sizeof(Run) + header.tap_count * sizeof(Tap) != payload) {
+        return false;
+    }
+
+    WarpMap map;
+    map.mode_ = static_cast<WarpInterp>(header.mode);
+    map.canvas_shape_ = cv::Size(header.canvas_width, header.canvas_height);
+    map.src_size_ = cv::Size(header.src_width, header.src_height);
+    map.roi_ = cv::Rect(header.roi_x, header.roi_y, header.roi_width, header.roi_height);
+    for (int i = 0; i < 9; ++i) {
+        map.destToSrc_H_(i / 3, i % 3) = header.H[i];
+    }
+    map.runs_.resize(header.run_count);
+    map.taps_.resize(header.tap_count);
+    if (!in.read(reinterpret_cast<char*>(map.runs_.data()), map.runs_.size() * sizeof(Run)) ||
+        !in.read(reinterpret_cast<char*>(map.taps_.data()), map.taps_.size() * sizeof(Tap))) {
+        return false;
+    }
+
+    // apply() trusts the map, reject anything that would read or write out of bounds
+    if ((map.roi_ & cv::Rect(0, 0, map.canvas_shape_.width, map.canvas_shape_.height)) != map.roi_) {
+        return false;
+    }
+    for (const Run& run : map.runs_) {
+        if (run.count < 0 || run.y < map.roi_.y || run.y >= map.roi_.y + map.roi_.height || run.x_begin < map.roi_.x ||
+            run.x_begin + static_cast<int64_t>(run.count) > map.roi_.x + map.roi_.width ||
+            run.first + static_cast<uint64_t>(run.count) > map.taps_.size()) {
+            return false;
+        }
+    }
+    for (const Tap& tap : map.taps_) {
+        if (!validTap(tap, map.mode_, map.src_size_)) {
+            return false;
+        }
+    }
+    *this = std::move(map);
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef WARP_MAP_H
+#define WARP_MAP_H
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Dense>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "backwardWarpImg.h"
+#include "warpKernel.h"
+
+// Precomputed backward warp for a fixed (destToSrc_H, canvas_shape, source size, interpolation).
+// build() runs the projective math once and keeps, for the valid canvas pixels only, the fixed-point source
+// position of every pixel; the pixels are grouped in runs of consecutive valid pixels of a canvas row, so empty
+// canvas costs nothing. apply() is then a pure gather: the same WarpROI as backwardWarpImgROI without a single
+// division. The map can be saved to disk and loaded by a later run.
+class WarpMap {
+public:
+    // Fraction bits of the stored source positions (bilinear / bicubic weights)
+    static constexpr int kFracBits = 10;
+
+    // Consecutive valid pixels [x_begin, x_begin + count) of canvas row y; taps [first, first + count)
+    struct Run {
+        int32_t y;
+        int32_t x_begin;
+        int32_t count;
+        uint32_t first;
+    };
+
+    // Source position of one valid pixel: integer part (nearest pixel for Nearest, floor otherwise)
+    // and fractional part in 1 / 2^kFracBits
+    struct Tap {
+        int16_t x;
+        int16_t y;
+        uint16_t fx;
+        uint16_t fy;
+    };
+
+    WarpMap() = default;
+
+    // Throws std::invalid_argument for an empty or too large source
+    static WarpMap build(const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, const cv::Size& src_size,
+                         WarpInterp mode = WarpInterp::Nearest);
+
+    // Warp src_img (of the source size the map was built for): CV_32FC3, range [0.0f, 1.0f], or CV_8UC3
+    // (the result has the type of src_img)
+    WarpROI apply(const cv::Mat& src_img) const;
+
+    // True if the map was built for this geometry
+    bool matches(const Eigen::Matrix3d& destToSrc_H, const cv::Size& canvas_shape, const cv::Size& src_size, WarpInterp mode) const;
+
+    // Binary file, returns false if the file could not be written / read or is not a warp map
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    bool empty() const { return runs_.empty(); }
+    cv::Rect roi() const { return roi_; }
+    cv::Size canvasSize() const { return canvas_shape_; }
+    cv::Size srcSize() const { return src_size_; }
+    WarpInterp mode() const { return mode_; }
+    const Eigen::Matrix3d& homography() const { return destToSrc_H_; }
+    size_t pixels() const { return taps_.size(); }
+    size_t bytes() const { return runs_.size() * sizeof(Run) + taps_.size() * sizeof(Tap); }
+
+private:
+    template <typename T>
+    void gather(const cv::Mat& src_img, WarpROI& result) const;
+
+    Eigen::Matrix3d destToSrc_H_ = Eigen::Matrix3d::Identity();
+    cv::Size canvas_shape_;
+    cv::Size src_size_;
+    WarpInterp mode_ = WarpInterp::Nearest;
+    cv::Rect roi_;
+    std::vector<Run> runs_;
+    std::vector<Tap> taps_;
+};
+
+#endif // WARP_MAP_H